@@ -70,6 +70,8 @@ void exit_help(int rt)
     log_err("--format,f             Format json for human readability with multiple lines and indentions. [default]");
     log_err("--compact,c            Compact output by removing whitespace.");
     log_err("--mem,m                Prints out memory stats.");
+    log_err("--lazy,l               Defer number conversion, numbers are written out exactly as read.");
+    log_err("--intern,n             String interning policy: 'all' [default], 'keys' or 'adaptive'.");
     log_err("--verbose,v            Verbose logging.");
     exit(rt);
 }
@@ -89,6 +91,8 @@ int main(int argc, char* argv[])
         {"compact",     no_argument,        0, 'c'},
         {"verbose",     no_argument,        0, 'v'},
         {"mem",         no_argument,        0, 'm'},
+        {"lazy",        no_argument,        0, 'l'},
+        {"intern",      required_argument,  0, 'n'},
         {0,0,0,0}
     };
 
@@ -96,13 +100,14 @@ int main(int argc, char* argv[])
     int outflags = JPRINT_PRETTY;
     int suppress = 0;
     int memstats = 0;
+    int jsnflags = 0;
 
     int use_stdin = 0;
     FILE* outfile = stdout;
 
     int idx;
     int c;
-    while ((c = getopt_long(argc, argv, "xhio:sufcvm", options, &idx)) != -1)
+    while ((c = getopt_long(argc, argv, "xhio:sufcvmln:", options, &idx)) != -1)
     {
         switch(c)
         {
@@ -149,6 +154,21 @@ int main(int argc, char* argv[])
                 memstats = 1;
                 break;
 
+            case 'l':
+                jsnflags |= JFLAG_LAZY_NUMS;
+                break;
+
+            case 'n':
+                jsonc_assert(optarg, "must provide a policy for option: --intern,n");
+                jsnflags &= ~(JFLAG_INTERN_KEYS|JFLAG_INTERN_ADAPTIVE);
+                if (strcmp(optarg, "keys") == 0)
+                    jsnflags |= JFLAG_INTERN_KEYS;
+                else if (strcmp(optarg, "adaptive") == 0)
+                    jsnflags |= JFLAG_INTERN_ADAPTIVE;
+                else
+                    jsonc_assert(strcmp(optarg, "all") == 0, "unknown interning policy: '%s'", optarg);
+                break;
+
             case '?':
                 break;
 
@@ -159,7 +179,7 @@ int main(int argc, char* argv[])
 
     jerr_t err;
     json_t jsn;
-    json_init(&jsn);
+    json_init_flags(&jsn, jsnflags);
 
     int rt = -1;
     if (use_stdin)
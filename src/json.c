@@ -44,6 +44,49 @@
 #include <stdio.h>
 #include <time.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define J_USE_SSE2 1
+#endif
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+    #define J_USE_AVX2 1
+#endif
+
+#if defined(_MSC_VER)
+    #include <intrin.h>
+#endif
+
+// the concurrent string table (jcmap_t) needs atomics to be shared by threads
+#if defined(__GNUC__) || defined(__clang__)
+    #define J_USE_ATOMICS 1
+#endif
+
+// without atomics the shared tables fall back to plain loads and stores, they
+// can then only be used from one thread at a time like jspin_lock.
+#if J_USE_ATOMICS
+    #define jatomic_load(PTR) __atomic_load_n(PTR, __ATOMIC_ACQUIRE)
+    #define jatomic_store(PTR, VAL) __atomic_store_n(PTR, VAL, __ATOMIC_RELEASE)
+    #define jatomic_inc(PTR) __atomic_fetch_add(PTR, 1, __ATOMIC_RELAXED)
+#else
+    #define jatomic_load(PTR) (*(PTR))
+    #define jatomic_store(PTR, VAL) (*(PTR) = (VAL))
+    #define jatomic_inc(PTR) ((*(PTR))++)
+#endif
+
+#if defined(__cplusplus)
+    #define JTHREAD_LOCAL thread_local
+#elif defined(_MSC_VER)
+    #define JTHREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__) || defined(__clang__)
+    #define JTHREAD_LOCAL __thread
+#elif (__STDC_VERSION__ >= 201112L)
+    #define JTHREAD_LOCAL _Thread_local
+#else
+    #define JTHREAD_LOCAL // no thread local storage, not thread safe
+#endif
+
 #pragma mark - macros
 
 #ifdef __cplusplus
@@ -57,6 +100,7 @@ extern "C" {
     #include <unistd.h>
     #include <fcntl.h>
     #include <sys/time.h>
+    #include <sched.h>
     #if (_POSIX_VERSION >= 199506L)
         #define J_USE_POSIX 1
     #endif
@@ -72,23 +116,89 @@ const char JVER[32] = "0.9.1.1";
 #define JINLINE static __inline
 
 #define BUF_SIZE ((size_t)6)
-#define MAX_VAL_IDX 268435456 // 2^28
-#define MAX_KEY_IDX UINT32_MAX
+#define MAX_VAL_IDX ((size_t)1 << (sizeof(jidx_t)*8 - 4)) // 2^28, or 2^60 with JSON_WIDE_INDEX
+#define MAX_KEY_IDX ((size_t)(jidx_t)-1)
+#define MAX_CONTAINER_LEN ((size_t)(jsize_t)-1)
+#if JSON_WIDE_KEYS
+    #define JKEY_INLINE ((size_t)16) // keys shorter than this are packed into the key slot
+#else
+    #define JKEY_INLINE sizeof(jidx_t) // keys shorter than this are packed into the key index
+#endif
+#define JKEY_MISSING 0 // jkey_t.kind, the key is not in the doc
+#define JKEY_ID 1 // jkey_t.kind, kidx is the key's string id
+#define JKEY_PACKED 2 // jkey_t.kind, kidx holds the key's bytes
+
+#if JSON_WIDE_INDEX
+    #define JSTR_INLINE_MAX 7 // string values this short are stored in the value itself
+    #define JSTR_INLINE_LEN 0x7 // mask of their length, stored above the bytes
+#else
+    #define JSTR_INLINE_MAX 3 // string values this short are stored in the value itself
+    #define JSTR_INLINE_LEN 0x3 // mask of their length, stored above the bytes
+#endif
+#define JSTR_INLINE ((jidx_t)(MAX_VAL_IDX >> 1)) // set in the index of an inline string, the string ids stay below it
+#define jstr_is_inline(IDX) (((IDX) & JSTR_INLINE) != 0)
 
 #define MAX_JSHORT 134217727 // 2^27-1
 #define MIN_JSHORT -134217727 // -2^27-1
 
-#define JMAP_MAX_LOADFACTOR 0.8f
-#define JMAP_IDEAL_LOADFACTOR 0.3f
+#define JLEX_LAZY 0x80000000u // number lexeme has not been converted yet
+
+#define JMAP_GROUP_SIZE 16 // control bytes probed at once
+#define JMAP_MIN_CAP 16 // must be a power of 2 >= JMAP_GROUP_SIZE
+#define JMAP_EMPTY ((uint8_t)0x80) // control byte of an empty slot
+#define jmap_max_load(CAP) ((CAP) - (CAP)/8) // 7/8 max load factor
+#define JMAP_MIGRATE_MIN 4096 // smaller tables are always rehashed at once
+#define JMAP_MIGRATE_STEP 64 // old slots moved per insert while growing incrementally
+
+#define JOBJ_INDEX_MIN 32 // objects with at least this many keys are searched through a hash index
+#define JSHAPE_SEEN 64 // key lists the parser remembers seeing once, must be a power of 2
+
+#define JINTERN_WINDOW 4096 // string values sampled per adaptive interning decision
+#define JINTERN_MIN_HITS (JINTERN_WINDOW/4) // keep interning values above this many hits
+
+#define JCMAP_STRIPE_BITS 6 // the concurrent table is split into 64 independently locked stripes
+#define JCMAP_STRIPES (1 << JCMAP_STRIPE_BITS)
+#define JCMAP_MIN_CAP 16 // initial slots per stripe, must be a power of 2
+#define JCMAP_SEG_BITS 10 // first string segment holds 1024 strings, each following one twice as many
+#define JCMAP_SEGS 19 // 2^28 strings in all segments
+#define JCMAP_MAX_IDX ((((size_t)1 << JCMAP_SEGS) - 1) << JCMAP_SEG_BITS)
+#define JCACHE_LINE 64
+
+#define JPOOL_CACHE_SIZE 8 // docs kept by each thread before going to the shared list
+#define JPOOL_MAX_KEEP (4*1024*1024) // docs holding more are emptied when released
 
 #define IO_BUF_SIZE 4096
+
+// Build with J_HASH_MURMUR=1 to hash strings with MurmurHash3-32 instead of
+// the default 64-bit block hash.
+#if J_HASH_MURMUR
+    #define JHASH_BLOCK 4
+#else
+    #define JHASH_BLOCK 8
+#endif
+
+#define JCHUNK_MIN_SIZE 4096 // first string chunk
+#define JCHUNK_MAX_SIZE (16*1024*1024) // chunks double in size up to this
 #define JMAX_SRC_STR 128
 
 #pragma mark - structs
 
 //------------------------------------------------------------------------------
-typedef uint32_t jhash_t;
-typedef uint32_t jsize_t;
+typedef uint64_t jhash_t;
+
+// the high half of a string hash, kept with the string. The table position
+// comes from these bits and the tag from the low ones.
+#define jhash_hi(HASH) ((uint32_t)((HASH) >> 32))
+typedef jidx_t jsize_t;
+
+//------------------------------------------------------------------------------
+/// incremental string hash state, see jhash_init/jhash_block/jhash_final.
+struct jhasher_t
+{
+    uint64_t h;
+    uint64_t s;
+};
+typedef struct jhasher_t jhasher_t;
 
 //------------------------------------------------------------------------------
 struct jbuf_t
@@ -134,23 +244,34 @@ struct jcontext_t
     jbool_t is_stream;
 
     jbuf_t strbuf; // buffer for temporarily storing the key string
+
+    // children of the containers still being parsed. A container takes its
+    // own off the top when it is closed, and allocates for them only then.
+    jbuf_t vals; // jval_t
+    jbuf_t keys; // jokey_t, for objects only
+    jidx_t shape; // last shape given to an object, records in a row repeat it
+    uint32_t seen[JSHAPE_SEEN]; // hashes of key lists met once, by their low bits
+    jidx_t predict; // index + 1 of an object the next one likely has the keys of
 };
 typedef struct jcontext_t jcontext_t;
 
 //------------------------------------------------------------------------------
-struct jmapbucket_t
+struct jchunk_t
 {
+    struct jchunk_t* next; // the previous chunk
     size_t len;
     size_t cap;
-    size_t* slots;
+    // followed by cap bytes of string data
 };
-typedef struct jmapbucket_t jmapbucket_t;
+typedef struct jchunk_t jchunk_t;
+
+#define jchunk_data(CHUNK) ((char*)((CHUNK)+1))
 
 //------------------------------------------------------------------------------
 struct jstr_t
 {
-    jsize_t len;
-    jhash_t hash;
+    uint32_t len;
+    uint32_t hash; // jhash_hi of the string's hash
     union
     {
         char* chars;
@@ -160,49 +281,118 @@ struct jstr_t
 typedef struct jstr_t jstr_t;
 
 //------------------------------------------------------------------------------
-struct jkv_t
+struct jdict_t
 {
-    union
-    {
-        uint32_t kidx;
-        char kstr[4]; // used to pack short keys into the value directly
-    } key;
-    jval_t val;
+    jmap_t map;
+    jbool_t frozen;
+};
+
+//------------------------------------------------------------------------------
+// key of an object member, the string id of the key, or short keys packed in
+// directly. Packed keys are flagged in the high bit of the member's value type.
+// Either way the unused bytes are zero, so keys are compared whole.
+union jokey_t
+{
+    jidx_t kidx;
+    char kstr[JKEY_INLINE];
+#if JSON_WIDE_KEYS
+    uint64_t w[2];
+#endif
+};
+typedef union jokey_t jokey_t;
+
+#if JSON_WIDE_KEYS
+    #define jokey_equals(A, B) ((A).w[0] == (B).w[0] && (A).w[1] == (B).w[1])
+    #define jokey_bits(K) ((K).w[0] ^ ((K).w[1] * 0xC2B2AE3D27D4EB4FULL))
+#else
+    #define jokey_equals(A, B) ((A).kidx == (B).kidx)
+    #define jokey_bits(K) ((uint64_t)(K).kidx)
+#endif
+
+//------------------------------------------------------------------------------
+// open addressing table from a key to its position in a large object, built
+// once the object is big enough and kept current as it changes, so lookups
+// only read. Slots hold the position + 1, 0 is empty.
+struct jobj_index_t
+{
+    size_t mask;
+    int shift;
+    jidx_t slots[];
 };
-typedef struct jkv_t jkv_t;
+typedef struct jobj_index_t jobj_index_t;
 
 //------------------------------------------------------------------------------
+// the header of an object, its keys and values live in the children pool of
+// the doc. They are kept in parallel arrays so that keys can be searched
+// several at a time: cap keys followed by cap values, after the pointer to the
+// index for objects big enough to get one. An object with a shape has no keys
+// of its own, they belong to the shape and its block only holds the values.
 struct _jobj_t
 {
     jsize_t cap;
     jsize_t len;
-    union
-    {
-        jkv_t* ptr;
-        jkv_t buf[BUF_SIZE];
-    } kvs;
+    jidx_t off; // of the children, in 8 byte units
+    jidx_t shape; // index + 1 of the shape owning the keys, or 0
 };
 typedef struct _jobj_t _jobj_t;
 
+#define _jobj_is_shaped(OBJ) ((OBJ)->shape != 0)
+
+//------------------------------------------------------------------------------
+// a key list shared by the parsed objects that have the same keys in the same
+// order, such as the records of one array. The objects keep only their values.
+// The first object with a new key list keeps its own keys, the shape is made
+// when a second one shows up.
+struct jshape_t
+{
+    jsize_t len;
+    uint32_t hash;
+    jokey_t* keys; // followed by len flags, set for packed keys
+    jobj_index_t* index; // only for at least JOBJ_INDEX_MIN keys, NULL otherwise
+};
+typedef struct jshape_t jshape_t;
+
 //------------------------------------------------------------------------------
+// the header of an array, its values live in the children pool of the doc.
+// An array of numbers that are stored one after another in the nums or ints
+// pool does not keep its values at all, only where the run of numbers starts.
+// Such arrays have a cap of 0 and a len > 0, their offset holds the first
+// number shifted up by one with the low bit set for ints.
 struct _jarray_t
 {
     jsize_t cap;
     jsize_t len;
-    union
-    {
-        jval_t* ptr;
-        jval_t buf[BUF_SIZE];
-    } vals;
+    jidx_t off; // of the values in 8 byte units, or the start of the run
 };
 typedef struct _jarray_t _jarray_t;
 
+#define _jarray_is_run(A) ((A)->cap == 0 && (A)->len > 0)
+#define _jarray_run_first(A) ((A)->off >> 1)
+#define _jarray_run_type(A) (((A)->off & 1) ? JTYPE_INT : JTYPE_NUM)
+#define _jarray_run_off(FIRST, TYPE) ((jidx_t)((FIRST) << 1 | ((TYPE) == JTYPE_INT)))
+
+//------------------------------------------------------------------------------
+struct jlex_t
+{
+    jidx_t off; // offset of the raw number text in json_t.lexs
+    uint32_t len; // length of the raw text, OR'ed with JLEX_LAZY until converted
+};
+typedef struct jlex_t jlex_t;
+
+#define jlex_len(LEX) ((LEX)->len & ~JLEX_LAZY)
+
 #pragma mark - function prototypes
 
 //------------------------------------------------------------------------------
 JINLINE jval_t parse_val( json_t* jsn, jcontext_t* ctx );
+JINLINE int jlex_convert( const char* str, size_t len, jnum_t* num, jint_t* i );
+JINLINE const jlex_t* json_get_lex( const json_t* jsn, jval_t val );
 JINLINE void _jobj_print(jprint_t* ctx, jobj_t obj, size_t depth);
 JINLINE void _jarray_print(jprint_t* ctx, jarray_t array, size_t depth );
+JINLINE const char* json_get_strl_buf( const json_t* jsn, jval_t val, size_t* len, char* buf );
+JINLINE const jstr_t* jcmap_get_jstr( const jcmap_t* map, size_t idx );
+JINLINE size_t jcmap_find_hash( const jcmap_t* map, jhash_t hash, const char* str, size_t slen );
+JINLINE size_t jcmap_add_hash( jcmap_t* map, jhash_t hash, const char* str, size_t slen );
 
 #pragma mark - memory
 
@@ -246,6 +436,39 @@ JINLINE void* jrealloc( void* ptr, size_t s )
 //#define jsnprintf(BUF, BLEN, FMT, ...) { snprintf(BUF, BLEN, FMT, ## __VA_ARGS__); BUF[BLEN-1] = '\0'; }
 //#define json_assert(A, STR, ...) { if (!(A)) {jsnprintf(ctx->err->msg, sizeof(ctx->err->msg), "" STR, ## __VA_ARGS__ ); json_do_err(ctx); } }
 
+//------------------------------------------------------------------------------
+JINLINE void jspin_lock( int* lock )
+{
+#if J_USE_ATOMICS
+    unsigned spins = 0;
+    while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE))
+    {
+        while (__atomic_load_n(lock, __ATOMIC_RELAXED))
+        {
+            // the holder might not be running, give up our time slice
+            if (++spins < 64) continue;
+#if J_USE_POSIX
+            sched_yield();
+#endif
+            spins = 0;
+        }
+    }
+#else
+    assert(!*lock); // no atomics, single threaded use only
+    *lock = 1;
+#endif
+}
+
+//------------------------------------------------------------------------------
+JINLINE void jspin_unlock( int* lock )
+{
+#if J_USE_ATOMICS
+    __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+#else
+    *lock = 0;
+#endif
+}
+
 //------------------------------------------------------------------------------
 uint32_t jint_to_short( jint_t num )
 {
@@ -310,6 +533,10 @@ JINLINE size_t jsnprintf( char* buf, size_t blen, const char* fmt, ... )
 #define json_assert(...) jcontext_assert(ctx, __VA_ARGS__)
 #define json_passert(...) jcontext_passert(ctx, __VA_ARGS__)
 
+// values are addressed by a 28-bit index into their pool unless built with
+// JSON_WIDE_INDEX, fail the load cleanly instead of wrapping around.
+#define json_check_idx(IDX) json_assert((IDX) < MAX_VAL_IDX, "too many values of one type, the limit is %zu (see JSON_WIDE_INDEX)", (size_t)MAX_VAL_IDX)
+
 //------------------------------------------------------------------------------
 JINLINE void jcontext_fmt_msg(jcontext_t* ctx, const char* fmt, va_list args)
 {
@@ -356,72 +583,6 @@ JINLINE void jcontext_passert(jcontext_t* ctx, jbool_t b, const char* fmt, ...)
     json_do_err(ctx);
 }
 
-//------------------------------------------------------------------------------
-JINLINE jbool_t is_prime( size_t x )
-{
-    size_t o = 4;
-    for (size_t i = 5; JTRUE; i += o)
-    {
-        size_t q = x / i;
-        if (q < i) return JTRUE;
-        if (x == q * i) return JFALSE;
-        o ^= 6;
-    }
-    return JTRUE;
-}
-
-//------------------------------------------------------------------------------
-JINLINE size_t next_prime(size_t x)
-{
-    // find small prime numbers
-    switch (x)
-    {
-        case 0:
-        case 1:
-        case 2: return 2;
-        case 3: return 3;
-        case 4:
-        case 5: return 5;
-        case 6:
-        case 7: return 7;
-        case 8:
-        case 9:
-        case 10:
-        case 11: return 11;
-        case 12:
-        case 13: return 13;
-        case 14:
-        case 15:
-        case 16:
-        case 17: return 17;
-        case 18:
-        case 19: return 19;
-        case 20:
-        case 21:
-        case 22:
-        case 23: return 23;
-        case 24:
-        case 25:
-        case 26:
-        case 27:
-        case 28:
-        case 29: return 29;
-        default:
-        {
-            // calculate the nearest prime number larger than our current num
-            size_t k = x / 6;
-            size_t i = x - 6 * k;
-            size_t o = i < 2 ? 1 : 5;
-            x = 6 * k + o;
-            for (i = (3 + o) / 2; !is_prime(x); x += i)
-            {
-                i ^= 6;
-            }
-            return x;
-        }
-    }
-}
-
 //------------------------------------------------------------------------------
 JINLINE int utf8_bytes( int ch )
 {
@@ -530,21 +691,7 @@ JINLINE size_t grow( size_t min, size_t cur )
 #pragma mark - jstr_t
 
 //------------------------------------------------------------------------------
-void jstr_destroy(jstr_t* jstr)
-{
-    assert(jstr);
-    if (jstr->len > BUF_SIZE)
-    {
-        jfree(jstr->str.chars);
-        jstr->str.chars = NULL;
-    }
-    jstr->str.buf[0] = '\0';
-    jstr->len = 0;
-    jstr->hash = 0;
-}
-
-//------------------------------------------------------------------------------
-const char* jstr_get_cstr( jstr_t* jstr )
+const char* jstr_get_cstr( const jstr_t* jstr )
 {
     assert(jstr);
     return (jstr->len > BUF_SIZE) ? jstr->str.chars : jstr->str.buf;
@@ -565,6 +712,109 @@ int jstr_cmp( jstr_t* s1, jstr_t* s2 )
     return rt;
 }
 
+//------------------------------------------------------------------------------
+/// an inline string keeps its bytes in the low JSTR_INLINE_MAX bytes of the
+/// index, the first one lowest, and its length in the bits above them.
+JINLINE jidx_t jstr_inline_make( const char* str, size_t slen )
+{
+    assert(slen <= JSTR_INLINE_MAX);
+    jidx_t idx = JSTR_INLINE | ((jidx_t)slen << (JSTR_INLINE_MAX * 8));
+    for ( size_t i = 0; i < slen; i++ )
+    {
+        idx |= (jidx_t)(unsigned char)str[i] << (i * 8);
+    }
+    return idx;
+}
+
+//------------------------------------------------------------------------------
+#define jstr_inline_len(IDX) ((size_t)((IDX) >> (JSTR_INLINE_MAX * 8)) & JSTR_INLINE_LEN)
+
+//------------------------------------------------------------------------------
+/// writes the bytes of an inline string and a NUL to buf, returns its length.
+JINLINE size_t jstr_inline_unpack( jidx_t idx, char* buf )
+{
+    const size_t len = jstr_inline_len(idx);
+    for ( size_t i = 0; i < len; i++ )
+    {
+        buf[i] = (char)(idx >> (i * 8));
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+//------------------------------------------------------------------------------
+/// every string of up to 3 bytes has a single NUL terminated copy, shared by
+/// all docs, that json_get_strl can point to. A shorter string shares the copy
+/// of its bytes padded with zeros, its length tells them apart. Segment n
+/// holds the 256 strings whose last two bytes are n, it is allocated the first
+/// time one of them is read and never freed.
+static char* jstr_inline_segs[1 << 16];
+
+#if JSON_WIDE_INDEX
+//------------------------------------------------------------------------------
+/// 4 to 7 byte strings are too many to lay out in advance, the ones that are
+/// read get a copy in a concurrent table shared by all docs instead.
+static jcmap_t* jstr_inline_map;
+#endif
+
+//------------------------------------------------------------------------------
+JINLINE const char* jstr_inline_cstr( jidx_t idx )
+{
+#if JSON_WIDE_INDEX
+    if (jstr_inline_len(idx) > 3)
+    {
+        jcmap_t* map = jatomic_load(&jstr_inline_map);
+        if (!map)
+        {
+            // several threads can race to create it, one of them wins
+            map = jcmap_new();
+#if J_USE_ATOMICS
+            jcmap_t* expected = NULL;
+            if (!__atomic_compare_exchange_n(&jstr_inline_map, &expected, map, JFALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            {
+                jcmap_free(map);
+                map = expected;
+            }
+#else
+            jstr_inline_map = map;
+#endif
+        }
+
+        char buf[JSTR_INLINE_MAX+1];
+        size_t len = jstr_inline_unpack(idx, buf);
+        return jcmap_get_strl(map, jcmap_addl(map, buf, len), &len);
+    }
+#endif
+
+    const size_t lo = idx & 0xFF;
+    const size_t hi = (idx >> 8) & 0xFFFF;
+    char* seg = jatomic_load(&jstr_inline_segs[hi]);
+    if (!seg)
+    {
+        seg = (char*)jmalloc(256 * 4);
+        for ( size_t i = 0; i < 256; i++ )
+        {
+            seg[i*4] = (char)i;
+            seg[i*4+1] = (char)(hi & 0xFF);
+            seg[i*4+2] = (char)(hi >> 8);
+            seg[i*4+3] = '\0';
+        }
+
+        // several threads can race to fill it, one of them wins
+#if J_USE_ATOMICS
+        char* expected = NULL;
+        if (!__atomic_compare_exchange_n(&jstr_inline_segs[hi], &expected, seg, JFALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            jfree(seg);
+            seg = expected;
+        }
+#else
+        jstr_inline_segs[hi] = seg;
+#endif
+    }
+    return seg + lo * 4;
+}
+
 #pragma mark - jprint_t
 
 //------------------------------------------------------------------------------
@@ -669,251 +919,587 @@ JINLINE void jprint_newline(jprint_t* ctx)
     jprint_write(ctx, ctx->newline, ctx->nnewline);
 }
 
-#pragma mark - jstr_t
+#pragma mark - jchunk_t
 
 //------------------------------------------------------------------------------
-JINLINE jhash_t jstr_hash(const char *key, size_t len, jhash_t seed)
-{
-    // https://en.wikipedia.org/wiki/MurmurHash
-    // MurmurHash is a non-cryptographic hash function suitable for general
-    // hash-based lookup.
-
-    // MurmurHash3-32 - version 3 of the Murmur Hash with a 32 bit hash value.
-	static const uint32_t c1 = 0xcc9e2d51;
-	static const uint32_t c2 = 0x1b873593;
-	static const uint32_t r1 = 15;
-	static const uint32_t r2 = 13;
-	static const uint32_t m = 5;
-	static const uint32_t n = 0xe6546b64;
- 
-	jhash_t hash = seed;
- 
-	const size_t nblocks = len / sizeof(jhash_t);
-
-	for (size_t i = 0; i < nblocks; i++)
-    {
-        jhash_t k;
-        // use memcpy here to avoid unaligned read issues
-        memcpy(&k, key + i * sizeof(jhash_t), sizeof(jhash_t)); // k = blocks[i]
-
-		k *= c1;
-		k = (k << r1) | (k >> (32 - r1));
-		k *= c2;
- 
-		hash ^= k;
-		hash = ((hash << r2) | (hash >> (32 - r2))) * m + n;
-	}
- 
-	const uint8_t *tail = (const uint8_t *) (key + nblocks * 4);
-	jhash_t k1 = 0;
- 
-	switch (len & 0x3u)
+/// allocates string bytes from an arena. Strings are never freed individually,
+/// the chunks are released all at once with jchunk_free_all.
+JINLINE char* jchunk_alloc( jchunk_t** chunks, size_t len )
+{
+    assert(chunks);
+
+    jchunk_t* chunk = *chunks;
+    if (chunk && chunk->cap - chunk->len >= len)
     {
-        case 3:
-            k1 ^= (tail[2] << 16u);
-        case 2:
-            k1 ^= (tail[1] << 8u);
-        case 1:
-            k1 ^= tail[0];
-            k1 *= c1;
-            k1 = (k1 << r1) | (k1 >> (32 - r1));
-            k1 *= c2;
-            hash ^= k1;
-            break;
-	}
- 
-	hash ^= len;
-	hash ^= (hash >> 16u);
-	hash *= 0x85ebca6b;
-	hash ^= (hash >> 13u);
-	hash *= 0xc2b2ae35;
-	hash ^= (hash >> 16u);
- 
-	return hash;
-}
+        char* ptr = jchunk_data(chunk) + chunk->len;
+        chunk->len += len;
+        return ptr;
+    }
 
-//------------------------------------------------------------------------------
-JINLINE void jstr_init_str_hash( jstr_t* jstr, const char* cstr, size_t len, jhash_t hash )
-{
-    assert(jstr);
-    assert(cstr);
-    // TODO: verify the length does not exceed our max
+    size_t cap = chunk ? jmins(chunk->cap*2, JCHUNK_MAX_SIZE) : JCHUNK_MIN_SIZE;
+    jchunk_t* next = (jchunk_t*)jmalloc(sizeof(jchunk_t) + jmaxs(cap, len));
+    next->len = len;
+    next->cap = jmaxs(cap, len);
 
-    jstr->len = (jsize_t)len;
-    jstr->hash = hash;
-    if (len > BUF_SIZE)
+    if (chunk && len > cap/2)
     {
-        char* buf = (char*)jmalloc( len * sizeof(char) + 1 );
-        memcpy(buf, cstr, len * sizeof(char));
-        buf[len] = '\0';
-        jstr->str.chars = buf;
+        // a huge string gets a chunk of its own, keep filling the current one
+        next->next = chunk->next;
+        chunk->next = next;
     }
     else
     {
-        memcpy(jstr->str.buf, cstr, len * sizeof(char));
-        jstr->str.buf[len] = '\0';
+        next->next = chunk;
+        *chunks = next;
     }
+    return jchunk_data(next);
 }
 
-#pragma mark - jmap_t
-
 //------------------------------------------------------------------------------
-JINLINE void jmap_init(jmap_t* map)
+JINLINE void jchunk_free_all( jchunk_t** chunks )
 {
-    assert(map);
+    assert(chunks);
+    for ( jchunk_t* chunk = *chunks; chunk; )
+    {
+        jchunk_t* next = chunk->next;
+        jfree(chunk);
+        chunk = next;
+    }
+    *chunks = NULL;
+}
 
-    clock_t val = clock();
-    jhash_t seed = jstr_hash((const char*)&val, sizeof(val), (unsigned int)(time(NULL)&0xFFFFFFFF));
-    srand(seed); // seed our random number
+#pragma mark - jstr_t
 
-    map->seed = (uint32_t)rand();
+#if J_HASH_MURMUR
 
-    map->blen = 0;
-    map->bcap = 0;
-    map->buckets = NULL;
+//------------------------------------------------------------------------------
+// https://en.wikipedia.org/wiki/MurmurHash
+// MurmurHash is a non-cryptographic hash function suitable for general
+// hash-based lookup.
 
-    map->slen = 0;
-    map->scap = 0;
-    map->strs = NULL;
-}
+// MurmurHash3-32 - version 3 of the Murmur Hash with a 32 bit hash value.
+#define JHASH_C1 0xcc9e2d51
+#define JHASH_C2 0x1b873593
 
 //------------------------------------------------------------------------------
-JINLINE void jmap_destroy(jmap_t* map)
+JINLINE void jhash_init( jhasher_t* hs, uint32_t seed )
 {
-    assert(map);
+    hs->h = seed;
+    hs->s = 0;
+}
 
-    // clean up bucket slots
-    for ( size_t i = 0; i < map->bcap; i++ )
-    {
-        jmapbucket_t* bucket = &map->buckets[i];
-        if (bucket->slots)
-        {
-            jfree(bucket->slots); bucket->slots = NULL;
-        }
-    }
+//------------------------------------------------------------------------------
+JINLINE void jhash_block( jhasher_t* hs, const char* block )
+{
+    uint32_t k;
+    // use memcpy here to avoid unaligned read issues
+    memcpy(&k, block, sizeof(k));
 
-    // clean up buckets
-    jfree(map->buckets); map->buckets = NULL;
+    k *= JHASH_C1;
+    k = (k << 15) | (k >> (32 - 15));
+    k *= JHASH_C2;
 
-    if (map->strs)
-    {
-        // cleanup strings
-        for ( size_t i = 0; i < map->slen; i++ )
-        {
-            jstr_destroy(&map->strs[i]);
-        }
-        jfree(map->strs); map->strs = NULL;
-    }
-    map->slen = map->scap = 0;
-    map->blen = map->bcap = 0;
+    uint32_t hash = (uint32_t)hs->h ^ k;
+    hs->h = ((hash << 13) | (hash >> (32 - 13))) * 5 + 0xe6546b64;
 }
 
 //------------------------------------------------------------------------------
-JINLINE void jmap_reserve_str( jmap_t* map, size_t len )
+JINLINE jhash_t jhash_final( jhasher_t* hs, const char* tail, size_t len )
 {
-    assert(map);
-
-    // not found, create a new one
-    if (map->slen+len <= map->scap)
-        return;
+    const uint8_t* t = (const uint8_t*)tail;
+    uint32_t hash = (uint32_t)hs->h;
+    uint32_t k1 = 0;
 
-    size_t cap = grow(map->slen+len, map->scap);
-    jstr_t* ptr = (jstr_t*)jrealloc(map->strs, sizeof(jstr_t)*cap);
-    assert(ptr);
-    if (ptr)
+    switch (len & 0x3u)
     {
-        map->scap = cap;
-        map->strs = ptr;
+        case 3:
+            k1 ^= (t[2] << 16u);
+        case 2:
+            k1 ^= (t[1] << 8u);
+        case 1:
+            k1 ^= t[0];
+            k1 *= JHASH_C1;
+            k1 = (k1 << 15) | (k1 >> (32 - 15));
+            k1 *= JHASH_C2;
+            hash ^= k1;
+            break;
     }
+
+    hash ^= (uint32_t)len;
+    hash ^= (hash >> 16u);
+    hash *= 0x85ebca6b;
+    hash ^= (hash >> 13u);
+    hash *= 0xc2b2ae35;
+    hash ^= (hash >> 16u);
+
+    // only 32 bits of hash, the tag is taken from a remix of them
+    return ((jhash_t)hash << 32) | ((hash * 0x9E3779B9u) >> 25);
 }
 
-//------------------------------------------------------------------------------
-JINLINE size_t _jmap_add_str(jmap_t* map, const char* cstr, size_t len, uint32_t hash)
-{
-    assert(map);
-    assert(cstr);
+#else
 
-    // not found, create a new one
-    jmap_reserve_str(map, 1);
+//------------------------------------------------------------------------------
+// 64-bit block hash in the style of wyhash. Each 8 byte block costs a single
+// 64x64->128 bit multiply. The seed is expanded into a secret that is mixed
+// into every block, so collisions cannot be crafted without knowing it.
+#define JHASH_P0 0xa0761d6478bd642full
+#define JHASH_P1 0xe7037ed1a0b428dbull
+#define JHASH_P2 0x8ebc6af09c88c6e3ull
+#define JHASH_P3 0x589965cc75374cc3ull
 
-    size_t idx = map->slen++;
-    jstr_init_str_hash(&map->strs[idx], cstr, len, hash);
-    return idx;
+//------------------------------------------------------------------------------
+/// multiplies two 64-bit values and folds the 128-bit result into 64 bits.
+JINLINE uint64_t jhash_mix( uint64_t a, uint64_t b )
+{
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = (__uint128_t)a * b;
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else
+    uint64_t ha = a >> 32, hb = b >> 32, la = (uint32_t)a, lb = (uint32_t)b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32);
+    uint64_t c = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    c += lo < t;
+    uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+    return lo ^ hi;
+#endif
 }
 
 //------------------------------------------------------------------------------
-JINLINE void jmap_bucket_reserve( jmapbucket_t* bucket, size_t len )
+JINLINE void jhash_init( jhasher_t* hs, uint32_t seed )
 {
-    assert(bucket);
-
-    if ( bucket->len+len <= bucket->cap )
-        return;
-
-    // grow bucket now
-
-    size_t cap = grow(bucket->len+len, bucket->cap);
-    size_t* ptr = (size_t*)jrealloc( bucket->slots, sizeof(size_t) * cap );
-    if (ptr)
-    {
-        bucket->cap = cap;
-        bucket->slots = ptr;
-    }
-    assert(ptr);
+    hs->s = ((uint64_t)seed ^ JHASH_P0) * JHASH_P1;
+    hs->h = hs->s ^ JHASH_P2;
 }
 
 //------------------------------------------------------------------------------
-JINLINE void _jmap_add_key(jmap_t* map, uint32_t hash, size_t val)
+JINLINE void jhash_block( jhasher_t* hs, const char* block )
 {
-    assert(map);
-    assert(map->buckets);
-    assert(map->bcap > 0);
-
-    jmapbucket_t* bucket = &map->buckets[hash % map->bcap];
-    jmap_bucket_reserve(bucket, 1);
-    assert(bucket->slots);
-
-    if (bucket->len == 0) map->blen++; // empty bucket, we are about to add it, increment
-    bucket->slots[bucket->len++] = val;
+    uint64_t k;
+    // use memcpy here to avoid unaligned read issues
+    memcpy(&k, block, sizeof(k));
+    hs->h = jhash_mix(k ^ hs->s, hs->h ^ JHASH_P1);
 }
 
 //------------------------------------------------------------------------------
-JINLINE void jmap_rehash(jmap_t* map, size_t hint)
+JINLINE jhash_t jhash_final( jhasher_t* hs, const char* tail, size_t len )
 {
-    assert(map);
-
-    // if there is an empty hashmap, no need to check the load factor!
-    if (map->bcap > 0)
+    // read the 0-7 trailing bytes with fixed size loads, a variable length
+    // memcpy is an out of line call and costs more than the hash itself.
+    const uint8_t* p = (const uint8_t*)tail;
+    const size_t r = len % JHASH_BLOCK;
+    uint64_t t = 0;
+    if (r >= 4)
     {
-        float load = map->blen / (float)map->bcap;
-        if (load <= JMAP_MAX_LOADFACTOR)
-            return;
+        uint32_t lo, hi;
+        memcpy(&lo, p, sizeof(lo));
+        memcpy(&hi, p + r - 4, sizeof(hi));
+        t = ((uint64_t)hi << 32) | lo;
+    }
+    else if (r > 0)
+    {
+        t = ((uint64_t)p[0] << 16) | ((uint64_t)p[r >> 1] << 8) | p[r - 1];
     }
 
-    // TODO: reuse allocations
-    size_t _target = (size_t)ceilf(map->bcap / JMAP_IDEAL_LOADFACTOR);
-    size_t target = next_prime(_target);
+    uint64_t h = jhash_mix(t ^ hs->s ^ JHASH_P3, hs->h ^ len);
+    return jhash_mix(h ^ JHASH_P0, hs->s ^ JHASH_P2);
+}
 
-    size_t max = map->bcap;
-    jmapbucket_t* buckets = map->buckets;
+#endif
+
+//------------------------------------------------------------------------------
+/// hashes a whole string at once. Gives the same result as feeding the string
+/// through jhash_block/jhash_final a block at a time.
+JINLINE jhash_t jstr_hash(const char *key, size_t len, uint32_t seed)
+{
+    jhasher_t hs;
+    jhash_init(&hs, seed);
+
+    const size_t nblocks = len / JHASH_BLOCK;
+    for ( size_t i = 0; i < nblocks; i++ )
+    {
+        jhash_block(&hs, key + i * JHASH_BLOCK);
+    }
+    return jhash_final(&hs, key + nblocks * JHASH_BLOCK, len);
+}
+
+//------------------------------------------------------------------------------
+uint32_t json_hash( const void* buf, size_t len, uint32_t seed )
+{
+    assert(buf || len == 0);
+    return jhash_hi(jstr_hash((const char*)buf, len, seed));
+}
+
+//------------------------------------------------------------------------------
+JINLINE void jstr_init_str_hash( jchunk_t** chunks, jstr_t* jstr, const char* cstr, size_t len, jhash_t hash )
+{
+    assert(jstr);
+    assert(cstr);
+    assert(len <= UINT32_MAX);
+
+    jstr->len = (uint32_t)len;
+    jstr->hash = jhash_hi(hash);
+    if (len > BUF_SIZE)
+    {
+        char* buf = jchunk_alloc(chunks, len + 1);
+        memcpy(buf, cstr, len * sizeof(char));
+        buf[len] = '\0';
+        jstr->str.chars = buf;
+    }
+    else
+    {
+        memcpy(jstr->str.buf, cstr, len * sizeof(char));
+        jstr->str.buf[len] = '\0';
+    }
+}
+
+#pragma mark - jmap_t
+
+//------------------------------------------------------------------------------
+JINLINE uint32_t jctz( uint32_t x )
+{
+    assert(x);
+#if defined(__GNUC__) || defined(__clang__)
+    return (uint32_t)__builtin_ctz(x);
+#elif defined(_MSC_VER)
+    unsigned long idx;
+    _BitScanForward(&idx, x);
+    return (uint32_t)idx;
+#else
+    uint32_t n = 0;
+    while (!(x & 1)) { x >>= 1; n++; }
+    return n;
+#endif
+}
+
+//------------------------------------------------------------------------------
+/// bitmask of the control bytes in the group that match the given tag. Bit i
+/// is set if ctrl[i] matches.
+JINLINE uint32_t jmap_group_match( const uint8_t* ctrl, uint8_t tag )
+{
+#if J_USE_SSE2
+    __m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)tag)));
+#else
+    uint32_t mask = 0;
+    for ( uint32_t i = 0; i < JMAP_GROUP_SIZE; i++ )
+    {
+        mask |= (uint32_t)(ctrl[i] == tag) << i;
+    }
+    return mask;
+#endif
+}
+
+//------------------------------------------------------------------------------
+/// bitmask of the empty slots in the group.
+JINLINE uint32_t jmap_group_empty( const uint8_t* ctrl )
+{
+#if J_USE_SSE2
+    // empty is the only control byte with the high bit set
+    return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)ctrl));
+#else
+    return jmap_group_match(ctrl, JMAP_EMPTY);
+#endif
+}
+
+//------------------------------------------------------------------------------
+/// the high half of the hash picks the starting slot, so tables of up to 2^32
+/// slots spread evenly. The low 7 bits are kept in the control byte as a tag
+/// to filter out nearly all mismatches before touching a string. A table being
+/// rebuilt takes the position from jstr_t.hash and the tag from the old
+/// control byte.
+#define jmap_hash_pos(HI) ((size_t)(HI))
+#define jmap_hash_tag(HASH) ((uint8_t)((HASH) & 0x7F))
+
+//------------------------------------------------------------------------------
+static JTHREAD_LOCAL uint64_t jseed_state = 0;
+
+//------------------------------------------------------------------------------
+/// picks a random seed for a new string table. Each thread steps its own
+/// splitmix64 generator, so no syscalls, locks or libc rand state are
+/// involved. The generator is seeded once per thread from the time and the
+/// address of its state (randomized by ASLR).
+JINLINE uint32_t jmap_new_seed(void)
+{
+    if (jseed_state == 0)
+    {
+        jseed_state = (uint64_t)(uintptr_t)&jseed_state ^ ((uint64_t)time(NULL) << 32);
+    }
+
+    uint64_t z = (jseed_state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return (uint32_t)(z ^ (z >> 31));
+}
+
+//------------------------------------------------------------------------------
+JINLINE void jmap_init(jmap_t* map)
+{
+    assert(map);
+
+    map->seed = jmap_new_seed();
 
-    map->bcap = jmaxs( jmaxs(hint, 13), target);
-    map->buckets = (jmapbucket_t*)jcalloc(map->bcap, sizeof(jmapbucket_t));
     map->blen = 0;
+    map->bcap = 0;
+    map->slots = NULL;
+    map->ctrl = NULL;
+    map->chunks = NULL;
 
-    for ( size_t i = 0; i < max; i++ )
+    map->slen = 0;
+    map->scap = 0;
+    map->strs = NULL;
+
+    map->dict = NULL;
+    map->shared = NULL;
+
+    map->old_slots = NULL;
+    map->old_ctrl = NULL;
+    map->old_cap = 0;
+    map->moved = 0;
+    map->incremental = 0;
+}
+
+//------------------------------------------------------------------------------
+/// strings of the shared dictionary come first, the map's own strings are
+/// numbered after them. A map backed by a concurrent table has no strings of
+/// its own.
+#define jmap_base(MAP) ((MAP)->dict ? (MAP)->dict->slen : (MAP)->shared ? jcmap_len((MAP)->shared) : 0)
+
+//------------------------------------------------------------------------------
+/// the number of strings visible through the map, including the dictionary.
+#define jmap_len(MAP) (jmap_base(MAP) + (MAP)->slen)
+
+//------------------------------------------------------------------------------
+JINLINE void jmap_set_dict(jmap_t* map, const jmap_t* dict)
+{
+    assert(map);
+    assert(map->slen == 0); // string ids would shift
+    assert(!dict || !dict->dict); // dictionaries do not chain
+    assert(!dict || !map->shared);
+
+    map->dict = dict;
+    if (dict)
+    {
+        // hashes are computed once and checked against both tables
+        map->seed = dict->seed;
+    }
+}
+
+//------------------------------------------------------------------------------
+/// every string of the map goes to the concurrent table, the map's own arrays
+/// and slots stay empty.
+JINLINE void jmap_set_shared(jmap_t* map, jcmap_t* shared, uint32_t seed)
+{
+    assert(map);
+    assert(map->slen == 0); // string ids would shift
+    assert(!shared || !map->dict);
+
+    map->shared = shared;
+    if (shared) map->seed = seed;
+}
+
+//------------------------------------------------------------------------------
+/// empties the map but keeps the strings array, the table and the newest
+/// chunk of string bytes for reuse.
+JINLINE void jmap_reset(jmap_t* map)
+{
+    assert(map);
+
+    map->slen = 0;
+    map->blen = 0;
+    jfree(map->old_slots); map->old_slots = NULL;
+    map->old_ctrl = NULL;
+    map->old_cap = map->moved = 0;
+    if (map->ctrl)
+    {
+        memset(map->ctrl, JMAP_EMPTY, map->bcap + JMAP_GROUP_SIZE);
+    }
+
+    jchunk_t* chunk = map->chunks;
+    if (chunk)
+    {
+        jchunk_free_all(&chunk->next);
+        chunk->len = 0;
+    }
+
+    // the table is empty, a new seed costs nothing
+    if (!map->dict && !map->shared) map->seed = jmap_new_seed();
+}
+
+//------------------------------------------------------------------------------
+JINLINE void jmap_destroy(jmap_t* map)
+{
+    assert(map);
+
+    // the control bytes share the slot allocation
+    jfree(map->slots); map->slots = NULL;
+    map->ctrl = NULL;
+    jfree(map->old_slots); map->old_slots = NULL;
+    map->old_ctrl = NULL;
+    map->old_cap = map->moved = 0;
+
+    // cleanup strings
+    jchunk_free_all(&map->chunks);
+    jfree(map->strs); map->strs = NULL;
+    map->slen = map->scap = 0;
+    map->blen = map->bcap = 0;
+}
+
+//------------------------------------------------------------------------------
+JINLINE void jmap_reserve_str( jmap_t* map, size_t len )
+{
+    assert(map);
+
+    // not found, create a new one
+    if (map->slen+len <= map->scap)
+        return;
+
+    size_t cap = grow(map->slen+len, map->scap);
+    jstr_t* ptr = (jstr_t*)jrealloc(map->strs, sizeof(jstr_t)*cap);
+    assert(ptr);
+    if (ptr)
+    {
+        map->scap = cap;
+        map->strs = ptr;
+    }
+}
+
+//------------------------------------------------------------------------------
+JINLINE size_t _jmap_add_str(jmap_t* map, const char* cstr, size_t len, jhash_t hash)
+{
+    assert(map);
+    assert(cstr);
+
+    // not found, create a new one
+    jmap_reserve_str(map, 1);
+
+    size_t idx = map->slen++;
+    jstr_init_str_hash(&map->chunks, &map->strs[idx], cstr, len, hash);
+    return idx;
+}
+
+//------------------------------------------------------------------------------
+/// finds the first empty slot in the probe sequence of the hash.
+JINLINE size_t jmap_find_empty(const jmap_t* map, uint32_t hi)
+{
+    assert(map->bcap > 0);
+
+    const size_t mask = map->bcap-1;
+    size_t pos = jmap_hash_pos(hi) & mask;
+    for ( size_t step = JMAP_GROUP_SIZE; JTRUE; step += JMAP_GROUP_SIZE )
     {
-        jmapbucket_t* bucket = &buckets[i];
-        for ( size_t n = 0; n < bucket->len; n++ )
+        uint32_t empty = jmap_group_empty(map->ctrl + pos);
+        if (empty)
         {
-            size_t idx = bucket->slots[n];
-            _jmap_add_key(map, map->strs[idx].hash, idx);
+            return (pos + jctz(empty)) & mask;
         }
+        pos = (pos + step) & mask;
+    }
+}
+
+//------------------------------------------------------------------------------
+/// stores the index in the current table without counting it.
+JINLINE void _jmap_put_key(jmap_t* map, uint32_t hi, uint8_t tag, size_t val)
+{
+    assert(map);
+    assert(map->slots);
+    assert(val <= MAX_KEY_IDX);
+
+    size_t slot = jmap_find_empty(map, hi);
+    map->ctrl[slot] = tag;
+
+    // the first group is mirrored past the end so that a group can always be
+    // loaded without wrapping around.
+    if (slot < JMAP_GROUP_SIZE)
+    {
+        map->ctrl[map->bcap + slot] = tag;
+    }
+    map->slots[slot] = (jidx_t)val;
+}
+
+//------------------------------------------------------------------------------
+JINLINE void _jmap_add_key(jmap_t* map, jhash_t hash, size_t val)
+{
+    _jmap_put_key(map, jhash_hi(hash), jmap_hash_tag(hash), val);
+    map->blen++;
+}
+
+//------------------------------------------------------------------------------
+/// moves up to count slots of the previous table into the current one, and
+/// frees the previous table once all of them have been moved.
+JINLINE void jmap_migrate(jmap_t* map, size_t count)
+{
+    if (!map->old_slots) return;
+
+    const size_t end = (count < map->old_cap - map->moved) ? map->moved + count : map->old_cap;
+    for ( size_t i = map->moved; i < end; i++ )
+    {
+        if (map->old_ctrl[i] == JMAP_EMPTY) continue;
+        size_t idx = map->old_slots[i];
+        _jmap_put_key(map, map->strs[idx].hash, map->old_ctrl[i], idx);
+    }
+    map->moved = end;
+
+    if (end == map->old_cap)
+    {
+        jfree(map->old_slots); map->old_slots = NULL;
+        map->old_ctrl = NULL;
+        map->old_cap = map->moved = 0;
+    }
+}
+
+//------------------------------------------------------------------------------
+/// grows the table if it cannot fit hint strings, or one more string.
+JINLINE void jmap_rehash(jmap_t* map, size_t hint)
+{
+    assert(map);
+    if (map->shared) return;
 
-        bucket->len = 0;
-        bucket->cap = 0;
-        jfree(bucket->slots); bucket->slots = NULL;
+    size_t len = jmaxs(map->blen+1, hint);
+    if (len <= jmap_max_load(map->bcap))
+    {
+        // an incremental resize moves a few more slots with each insert
+        jmap_migrate(map, JMAP_MIGRATE_STEP);
+        return;
+    }
+
+    // the new table is sized so a resize finishes long before the next one,
+    // unless a hint asks for more room. Either way, finish it first.
+    jmap_migrate(map, SIZE_MAX);
+
+    size_t cap = jmaxs(map->bcap, JMAP_MIN_CAP);
+    while ( len > jmap_max_load(cap) ) cap <<= 1;
+
+    size_t max = map->bcap;
+    jidx_t* slots = map->slots;
+    uint8_t* ctrl = map->ctrl;
+
+    // slots and control bytes are kept in a single allocation
+    map->bcap = cap;
+    map->slots = (jidx_t*)jmalloc(cap * sizeof(jidx_t) + cap + JMAP_GROUP_SIZE);
+    map->ctrl = (uint8_t*)(map->slots + cap);
+    memset(map->ctrl, JMAP_EMPTY, cap + JMAP_GROUP_SIZE);
+
+    if (map->incremental && max >= JMAP_MIGRATE_MIN)
+    {
+        // keep the old table around and search both until it is drained,
+        // instead of stalling on moving every string right now.
+        map->old_slots = slots;
+        map->old_ctrl = ctrl;
+        map->old_cap = max;
+        map->moved = 0;
+        jmap_migrate(map, JMAP_MIGRATE_STEP);
+        return;
+    }
+
+    for ( size_t i = 0; i < max; i++ )
+    {
+        if (ctrl[i] == JMAP_EMPTY) continue;
+        size_t idx = slots[i];
+        _jmap_put_key(map, map->strs[idx].hash, ctrl[i], idx);
     }
-    jfree(buckets); buckets = NULL;
+    jfree(slots); slots = NULL;
 }
 
 //------------------------------------------------------------------------------
@@ -921,27 +1507,27 @@ JINLINE jmem_t jmap_get_mem( jmap_t* map )
 {
     jmem_t mem = {0,0};
 
-    for ( size_t i = 0; i < map->slen; i++ )
+    for ( jchunk_t* chunk = map->chunks; chunk; chunk = chunk->next )
     {
-        jstr_t* str = &map->strs[i];
-        if (str->len > BUF_SIZE)
-        {
-            mem.used += str->len;
-            mem.reserved += str->len;
-        }
+        mem.used += chunk->len;
+        mem.reserved += sizeof(jchunk_t) + chunk->cap;
     }
     mem.used += map->slen * sizeof(jstr_t);
     mem.reserved += map->scap * sizeof(jstr_t);
 
-    for ( size_t n = 0; n < map->bcap; n++ )
+    if (map->bcap > 0)
     {
-        jmapbucket_t* bucket = &map->buckets[n];
-        mem.used += bucket->len * sizeof(*bucket->slots);
-        mem.reserved += bucket->cap * sizeof(*bucket->slots);
+        const size_t ctrl = map->bcap + JMAP_GROUP_SIZE;
+        mem.used += map->blen * sizeof(jidx_t) + ctrl;
+        mem.reserved += map->bcap * sizeof(jidx_t) + ctrl;
     }
 
-    mem.used += map->bcap * sizeof(jmapbucket_t);
-    mem.reserved += map->bcap * sizeof(jmapbucket_t);
+    if (map->old_slots)
+    {
+        const size_t old = map->old_cap * sizeof(jidx_t) + map->old_cap + JMAP_GROUP_SIZE;
+        mem.used += old;
+        mem.reserved += old;
+    }
 
     return mem;
 }
@@ -950,49 +1536,120 @@ JINLINE jmem_t jmap_get_mem( jmap_t* map )
 JINLINE jstr_t* jmap_get_str(const jmap_t* map, size_t idx)
 {
     assert(map);
+
+    // the concurrent table never moves its strings, handing out a mutable
+    // pointer is fine as long as nobody writes through it
+    if (map->shared)
+        return (jstr_t*)jcmap_get_jstr(map->shared, idx);
+
+    const size_t base = jmap_base(map);
+    if (idx < base)
+        return &map->dict->strs[idx];
+
+    idx -= base;
     assert(idx < map->slen);
     return &map->strs[idx];
 }
 
 //------------------------------------------------------------------------------
-JINLINE size_t jmap_find_hash(jmap_t* map, jhash_t hash, const char* cstr, size_t slen)
+/// searches one table of the map for the string.
+JINLINE size_t jmap_probe(const jmap_t* map, const jidx_t* slots, const uint8_t* ctrl, size_t cap, jhash_t hash, const char* cstr, size_t slen)
 {
-    assert(cstr);
-    if (map->blen == 0) return SIZE_MAX;
-
-    assert(map->bcap > 0);
-    jmapbucket_t* bucket = &map->buckets[hash % map->bcap];
+    assert(cap > 0);
+    const size_t mask = cap-1;
+    const uint8_t tag = jmap_hash_tag(hash);
+    const uint32_t hi = jhash_hi(hash);
 
-    for ( size_t i = 0; i < bucket->len; ++i )
+    size_t pos = jmap_hash_pos(hi) & mask;
+    for ( size_t step = JMAP_GROUP_SIZE; JTRUE; step += JMAP_GROUP_SIZE )
     {
-        // find our string
-        size_t idx = bucket->slots[i];
-        jstr_t* str = &map->strs[idx];
-
-        if (str->hash == hash && str->len == slen)
+        const uint8_t* group = ctrl + pos;
+        for ( uint32_t match = jmap_group_match(group, tag); match; match &= match-1 )
         {
-            const char* chars = (str->len > BUF_SIZE) ? str->str.chars : str->str.buf;
-            assert(chars);
-            if (memcmp(chars, cstr, slen) == 0)
+            // find our string
+            size_t idx = slots[(pos + jctz(match)) & mask];
+            jstr_t* str = &map->strs[idx];
+
+            if (str->hash == hi && str->len == slen)
             {
-                return idx;
+                const char* chars = (str->len > BUF_SIZE) ? str->str.chars : str->str.buf;
+                assert(chars);
+                if (memcmp(chars, cstr, slen) == 0)
+                {
+                    return idx;
+                }
             }
         }
+
+        // an empty slot ends the probe sequence, nothing is ever removed
+        if (jmap_group_empty(group))
+            return SIZE_MAX;
+
+        // triangular probing over groups, visits every group exactly once
+        // since the capacity is a power of 2.
+        pos = (pos + step) & mask;
     }
+}
 
-    return SIZE_MAX;
+//------------------------------------------------------------------------------
+/// searches only the map's own strings, the result is not offset by the
+/// dictionary.
+JINLINE size_t _jmap_find_hash(const jmap_t* map, jhash_t hash, const char* cstr, size_t slen)
+{
+    assert(cstr);
+    if (map->blen == 0) return SIZE_MAX;
+
+    size_t idx = jmap_probe(map, map->slots, map->ctrl, map->bcap, hash, cstr, slen);
+
+    // while growing incrementally, strings not moved yet are only in the old
+    // table. Moved ones are in both, the old table is never written to.
+    if (idx == SIZE_MAX && map->old_slots)
+    {
+        idx = jmap_probe(map, map->old_slots, map->old_ctrl, map->old_cap, hash, cstr, slen);
+    }
+    return idx;
+}
+
+//------------------------------------------------------------------------------
+JINLINE size_t jmap_find_hash(const jmap_t* map, jhash_t hash, const char* cstr, size_t slen)
+{
+    if (map->shared)
+        return jcmap_find_hash(map->shared, hash, cstr, slen);
+
+    // the shared dictionary is checked first
+    if (map->dict)
+    {
+        size_t idx = _jmap_find_hash(map->dict, hash, cstr, slen);
+        if (idx != SIZE_MAX)
+            return idx;
+    }
+
+    size_t idx = _jmap_find_hash(map, hash, cstr, slen);
+    return (idx == SIZE_MAX) ? idx : jmap_base(map) + idx;
 }
 
 //------------------------------------------------------------------------------
 #define jmap_find_str(MAP, CSTR, SLEN) jmap_find_hash(MAP, jstr_hash(CSTR, SLEN, (MAP)->seed), CSTR, SLEN)
 
 //------------------------------------------------------------------------------
-JINLINE size_t jmap_add_str(jmap_t* map, const char* cstr, size_t slen)
+/// appends a string without interning it. A concurrent table interns it
+/// anyway, the caller may not have hashed it.
+JINLINE size_t jmap_append_str(jmap_t* map, const char* cstr, size_t slen, jhash_t hash)
+{
+    if (map->shared)
+        return jcmap_add_hash(map->shared, jstr_hash(cstr, slen, map->seed), cstr, slen);
+
+    return jmap_base(map) + _jmap_add_str(map, cstr, slen, hash);
+}
+
+//------------------------------------------------------------------------------
+JINLINE size_t jmap_add_str_hash(jmap_t* map, const char* cstr, size_t slen, jhash_t hash)
 {
     assert(map);
     assert(cstr);
 
-    jhash_t hash = jstr_hash(cstr, slen, map->seed);
+    if (map->shared)
+        return jcmap_add_hash(map->shared, hash, cstr, slen);
 
     size_t idx = jmap_find_hash(map, hash, cstr, slen);
     if (idx != SIZE_MAX)
@@ -1003,13 +1660,350 @@ JINLINE size_t jmap_add_str(jmap_t* map, const char* cstr, size_t slen)
     // did not find an existing entry, create a new one
     idx = _jmap_add_str(map, cstr, slen, hash);
     _jmap_add_key(map, hash, idx);
-    return idx;
+    return jmap_base(map) + idx;
 }
 
-#pragma mark - jval_t
+//------------------------------------------------------------------------------
+#define jmap_add_str(MAP, CSTR, SLEN) jmap_add_str_hash(MAP, CSTR, SLEN, jstr_hash(CSTR, SLEN, (MAP)->seed))
+
+#pragma mark - jdict_t
 
 //------------------------------------------------------------------------------
-JINLINE void json_print_strl( jprint_t* ctx, const char* str, size_t len )
+jdict_t* jdict_new(void)
+{
+    jdict_t* dict = (jdict_t*)jmalloc(sizeof(jdict_t));
+    if (!dict) return NULL;
+
+    jmap_init(&dict->map);
+    dict->frozen = JFALSE;
+    return dict;
+}
+
+//------------------------------------------------------------------------------
+void jdict_free( jdict_t* dict )
+{
+    if (!dict) return;
+    jmap_destroy(&dict->map);
+    jfree(dict);
+}
+
+//------------------------------------------------------------------------------
+size_t jdict_addl( jdict_t* dict, const char* str, size_t slen )
+{
+    assert(dict);
+    assert(str);
+    assert(!dict->frozen); // docs may be reading it
+    return jmap_add_str(&dict->map, str, slen);
+}
+
+//------------------------------------------------------------------------------
+void jdict_add_keys( jdict_t* dict, const json_t* sample )
+{
+    assert(sample);
+
+    // every object of the doc lives in the same pool, no need to walk the tree
+    json_t* jsn = (json_t*)sample;
+    for ( size_t i = 0; i < jsn->objs.len; i++ )
+    {
+        jobj_t obj = {jsn, i};
+        for ( size_t k = 0; k < jobj_len(obj); k++ )
+        {
+            jval_t val;
+            size_t klen;
+            const char* key = jobj_get(obj, k, &val, &klen);
+            jdict_addl(dict, key, klen);
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+void jdict_freeze( jdict_t* dict )
+{
+    assert(dict);
+    dict->frozen = JTRUE;
+}
+
+//------------------------------------------------------------------------------
+size_t jdict_len( const jdict_t* dict )
+{
+    assert(dict);
+    return dict->map.slen;
+}
+
+//------------------------------------------------------------------------------
+size_t jdict_findl( const jdict_t* dict, const char* str, size_t slen )
+{
+    assert(dict);
+    assert(str);
+    return jmap_find_str(&dict->map, str, slen);
+}
+
+#pragma mark - jcmap_t
+
+//------------------------------------------------------------------------------
+/// open addressing table of a single stripe. A slot holds the string's hash in
+/// the upper 32 bits and its index+1 in the lower 32 bits, 0 is an empty slot.
+/// Slots are published with a release store, so a reader seeing a slot also
+/// sees the string it refers to.
+struct jctable_t
+{
+    size_t cap;
+    size_t len;
+    struct jctable_t* retired; // replaced tables, readers may still be using them
+    uint64_t slots[1];
+};
+typedef struct jctable_t jctable_t;
+
+//------------------------------------------------------------------------------
+/// each stripe sits on its own cache line, they are written by different threads.
+union jcstripe_t
+{
+    struct
+    {
+        int lock;
+        jctable_t* table;
+        jchunk_t* chunks;
+    } s;
+    char pad[JCACHE_LINE];
+};
+typedef union jcstripe_t jcstripe_t;
+
+//------------------------------------------------------------------------------
+/// strings are stored in segments that never move once allocated, so indices
+/// and string pointers stay valid while other threads keep adding strings.
+struct jcmap_t
+{
+    jcstripe_t stripes[JCMAP_STRIPES];
+    jstr_t* segs[JCMAP_SEGS];
+    size_t len;
+    uint32_t seed;
+};
+
+//------------------------------------------------------------------------------
+/// segment k holds (1 << JCMAP_SEG_BITS) << k strings.
+JINLINE size_t jcmap_seg( size_t idx, size_t* offset )
+{
+    const size_t n = (idx >> JCMAP_SEG_BITS) + 1;
+#if defined(__GNUC__) || defined(__clang__)
+    const size_t k = (sizeof(unsigned long long)*8 - 1) - (size_t)__builtin_clzll(n);
+#else
+    size_t k = 0;
+    while (n >> (k+1)) k++;
+#endif
+    *offset = idx - (((size_t)1 << JCMAP_SEG_BITS) * (((size_t)1 << k) - 1));
+    return k;
+}
+
+//------------------------------------------------------------------------------
+JINLINE const jstr_t* jcmap_get_jstr( const jcmap_t* map, size_t idx )
+{
+    size_t offset;
+    size_t k = jcmap_seg(idx, &offset);
+    const jstr_t* seg = jatomic_load(&map->segs[k]);
+    assert(seg);
+    return seg + offset;
+}
+
+//------------------------------------------------------------------------------
+/// returns the storage for a new string, allocating its segment if this is the
+/// first string in it. Several threads can race to allocate, one of them wins.
+JINLINE jstr_t* jcmap_new_jstr( jcmap_t* map, size_t idx )
+{
+    size_t offset;
+    size_t k = jcmap_seg(idx, &offset);
+    assert(k < JCMAP_SEGS);
+
+    jstr_t* seg = jatomic_load(&map->segs[k]);
+    if (!seg)
+    {
+        seg = (jstr_t*)jmalloc(sizeof(jstr_t) * (((size_t)1 << JCMAP_SEG_BITS) << k));
+#if J_USE_ATOMICS
+        jstr_t* expected = NULL;
+        if (!__atomic_compare_exchange_n(&map->segs[k], &expected, seg, JFALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            jfree(seg);
+            seg = expected;
+        }
+#else
+        map->segs[k] = seg;
+#endif
+    }
+    return seg + offset;
+}
+
+//------------------------------------------------------------------------------
+JINLINE jctable_t* jctable_new( size_t cap )
+{
+    assert((cap & (cap-1)) == 0);
+    jctable_t* table = (jctable_t*)jcalloc(1, sizeof(jctable_t) + (cap-1) * sizeof(uint64_t));
+    table->cap = cap;
+    return table;
+}
+
+//------------------------------------------------------------------------------
+/// stores a slot into the table, the caller holds the stripe lock.
+JINLINE void jctable_put( jctable_t* table, uint64_t slot )
+{
+    const size_t mask = table->cap-1;
+    size_t pos = (size_t)(slot >> 32) & mask;
+    while (table->slots[pos]) pos = (pos+1) & mask;
+
+    jatomic_store(&table->slots[pos], slot);
+    table->len++;
+}
+
+//------------------------------------------------------------------------------
+/// lock free lookup, safe while other threads are adding strings.
+JINLINE size_t jctable_find( const jcmap_t* map, const jctable_t* table, jhash_t hash, const char* cstr, size_t slen )
+{
+    if (!table) return SIZE_MAX;
+
+    // the low bits of the hash picked the stripe, the high half the slot
+    const size_t mask = table->cap-1;
+    const uint32_t hi = jhash_hi(hash);
+    for ( size_t pos = hi & mask; JTRUE; pos = (pos+1) & mask )
+    {
+        uint64_t slot = jatomic_load(&table->slots[pos]);
+        if (!slot)
+            return SIZE_MAX;
+
+        if ((uint32_t)(slot >> 32) == hi)
+        {
+            size_t idx = (uint32_t)slot - 1;
+            const jstr_t* str = jcmap_get_jstr(map, idx);
+            if (str->len == slen && memcmp(jstr_get_cstr(str), cstr, slen) == 0)
+            {
+                return idx;
+            }
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+jcmap_t* jcmap_new(void)
+{
+    jcmap_t* map = (jcmap_t*)jcalloc(1, sizeof(jcmap_t));
+    if (!map) return NULL;
+    map->seed = jmap_new_seed();
+    return map;
+}
+
+//------------------------------------------------------------------------------
+void jcmap_free( jcmap_t* map )
+{
+    if (!map) return;
+
+    for ( size_t i = 0; i < JCMAP_STRIPES; i++ )
+    {
+        jcstripe_t* stripe = &map->stripes[i];
+        for ( jctable_t* table = stripe->s.table; table; )
+        {
+            jctable_t* next = table->retired;
+            jfree(table);
+            table = next;
+        }
+        jchunk_free_all(&stripe->s.chunks);
+    }
+
+    for ( size_t k = 0; k < JCMAP_SEGS; k++ )
+    {
+        jfree(map->segs[k]);
+    }
+    jfree(map);
+}
+
+//------------------------------------------------------------------------------
+/// the hash must come from the map's seed, its low bits pick the stripe.
+JINLINE size_t jcmap_find_hash( const jcmap_t* map, jhash_t hash, const char* str, size_t slen )
+{
+    const jcstripe_t* stripe = &map->stripes[hash & (JCMAP_STRIPES-1)];
+    return jctable_find(map, jatomic_load(&stripe->s.table), hash, str, slen);
+}
+
+//------------------------------------------------------------------------------
+JINLINE size_t jcmap_add_hash( jcmap_t* map, jhash_t hash, const char* str, size_t slen )
+{
+    jcstripe_t* stripe = &map->stripes[hash & (JCMAP_STRIPES-1)];
+
+    // most strings are already there, no need to lock
+    size_t idx = jctable_find(map, jatomic_load(&stripe->s.table), hash, str, slen);
+    if (idx != SIZE_MAX)
+        return idx;
+
+    jspin_lock(&stripe->s.lock);
+
+    // another thread may have added it in the meantime
+    jctable_t* table = stripe->s.table;
+    idx = jctable_find(map, table, hash, str, slen);
+    if (idx != SIZE_MAX)
+    {
+        jspin_unlock(&stripe->s.lock);
+        return idx;
+    }
+
+    if (!table || table->len+1 > table->cap - table->cap/4)
+    {
+        // readers can still be probing the old table, it is kept until the
+        // map is freed. Together they are smaller than the new one.
+        jctable_t* grown = jctable_new(table ? table->cap*2 : JCMAP_MIN_CAP);
+        for ( size_t i = 0; table && i < table->cap; i++ )
+        {
+            if (table->slots[i]) jctable_put(grown, table->slots[i]);
+        }
+        grown->retired = table;
+        jatomic_store(&stripe->s.table, grown);
+        table = grown;
+    }
+
+    idx = jatomic_inc(&map->len);
+    assert(idx < JCMAP_MAX_IDX);
+
+    // the string bytes come from the stripe's own arena, guarded by its lock
+    jstr_init_str_hash(&stripe->s.chunks, jcmap_new_jstr(map, idx), str, slen, hash);
+    jctable_put(table, ((uint64_t)jhash_hi(hash) << 32) | (idx+1));
+
+    jspin_unlock(&stripe->s.lock);
+    return idx;
+}
+
+//------------------------------------------------------------------------------
+size_t jcmap_findl( const jcmap_t* map, const char* str, size_t slen )
+{
+    assert(map);
+    assert(str);
+    return jcmap_find_hash(map, jstr_hash(str, slen, map->seed), str, slen);
+}
+
+//------------------------------------------------------------------------------
+size_t jcmap_addl( jcmap_t* map, const char* str, size_t slen )
+{
+    assert(map);
+    assert(str);
+    return jcmap_add_hash(map, jstr_hash(str, slen, map->seed), str, slen);
+}
+
+//------------------------------------------------------------------------------
+const char* jcmap_get_strl( const jcmap_t* map, size_t idx, size_t* slen )
+{
+    assert(map);
+    assert(slen);
+
+    const jstr_t* str = jcmap_get_jstr(map, idx);
+    *slen = str->len;
+    return jstr_get_cstr(str);
+}
+
+//------------------------------------------------------------------------------
+size_t jcmap_len( const jcmap_t* map )
+{
+    assert(map);
+    return jatomic_load(&map->len);
+}
+
+#pragma mark - jval_t
+
+//------------------------------------------------------------------------------
+JINLINE void json_print_strl( jprint_t* ctx, const char* str, size_t len )
 {
     jprint_char(ctx, '\"');
     for ( size_t i = 0; i < len; i++ )
@@ -1183,15 +2177,25 @@ void _jval_print( jprint_t* ctx, const struct json_t* jsn, jval_t val, size_t de
         case JTYPE_STR:
         {
             size_t slen;
-            const char* str = json_get_strl(jsn, val, &slen);
+            char buf[JSTR_INLINE_MAX+1];
+            const char* str = json_get_strl_buf(jsn, val, &slen, buf);
             assert(str);
             json_print_strl(ctx, str, slen);
             break;
         }
 
         case JTYPE_INT:
+        {
+            const jlex_t* lex = json_get_lex(jsn, val);
+            if (lex)
+            {
+                // untouched source text, print it verbatim
+                jprint_write(ctx, jsn->lexs.ptr + lex->off, jlex_len(lex));
+                break;
+            }
             jprint_fmt(ctx, "%lld", json_get_int(jsn, val));
             break;
+        }
 
         case JTYPE_SHORT:
             jprint_fmt(ctx, "%d", jshort_to_int(val.idx));
@@ -1199,6 +2203,14 @@ void _jval_print( jprint_t* ctx, const struct json_t* jsn, jval_t val, size_t de
 
         case JTYPE_NUM:
         {
+            const jlex_t* lex = json_get_lex(jsn, val);
+            if (lex)
+            {
+                // untouched source text, print it verbatim
+                jprint_write(ctx, jsn->lexs.ptr + lex->off, jlex_len(lex));
+                break;
+            }
+
             char buf[32] = {0};
             size_t len = _jnum_tostr(buf, sizeof(buf), json_get_num(jsn, val), /* default */ 0);
             jprint_write(ctx, buf, len);
@@ -1243,6 +2255,50 @@ json_t* json_new()
     return js;
 }
 
+//------------------------------------------------------------------------------
+#define jchildren_units(BYTES) (((BYTES) + sizeof(uint64_t)-1) / sizeof(uint64_t))
+
+//------------------------------------------------------------------------------
+/// takes units from the end of the children pool and returns their offset.
+/// The pool may move, pointers into it must be fetched again.
+JINLINE size_t jchildren_alloc( json_t* jsn, size_t units )
+{
+    assert(jsn);
+    if (jsn->children.len+units > jsn->children.cap)
+    {
+        // jrealloc frees the old block and asserts on failure, the offset
+        // returned below is always written through
+        size_t cap = grow(jsn->children.len+units, jsn->children.cap);
+        jsn->children.ptr = (uint64_t*)jrealloc(jsn->children.ptr, cap * sizeof(uint64_t));
+        jsn->children.cap = cap;
+    }
+
+    size_t off = jsn->children.len;
+    jsn->children.len += units;
+    assert(jsn->children.len <= MAX_KEY_IDX);
+    return off;
+}
+
+//------------------------------------------------------------------------------
+/// gives back the block of a container. Only the last block of the pool can
+/// be reused right away, any other is left behind until json_gc.
+JINLINE void jchildren_free( json_t* jsn, size_t off, size_t units )
+{
+    if (units == 0) return;
+    if (off + units == jsn->children.len) jsn->children.len = off;
+    else jsn->children.garbage += units;
+}
+
+//------------------------------------------------------------------------------
+/// a new block for a container that grows. The last block of the pool grows
+/// in place and keeps its offset, any other is left behind. Either way the
+/// children are still where they were, the caller moves them.
+JINLINE size_t jchildren_regrow( json_t* jsn, size_t off, size_t units, size_t new_units )
+{
+    jchildren_free(jsn, off, units);
+    return jchildren_alloc(jsn, new_units);
+}
+
 //------------------------------------------------------------------------------
 JINLINE void json_objs_reserve( json_t* jsn, size_t res )
 {
@@ -1276,12 +2332,14 @@ JINLINE size_t json_add_obj( json_t* jsn )
     size_t idx = jsn->objs.len++;
     _jobj_t* obj = _json_get_obj(jsn, idx);
     assert(obj);
-    obj->cap = BUF_SIZE;
+    obj->cap = 0;
     obj->len = 0;
+    obj->off = 0;
+    obj->shape = 0;
 
     if (jval_is_nil(jsn->root))
     {
-        jsn->root = (jval_t){JTYPE_OBJ, (uint32_t)idx};
+        jsn->root = (jval_t){JTYPE_OBJ, (jidx_t)idx};
     }
     return idx;
 }
@@ -1319,12 +2377,13 @@ JINLINE size_t json_add_array( json_t* jsn )
     size_t idx = jsn->arrays.len++;
     _jarray_t* array = _json_get_array(jsn, idx);
     assert(array);
-    array->cap = BUF_SIZE;
+    array->cap = 0;
     array->len = 0;
+    array->off = 0;
 
     if (jval_is_nil(jsn->root))
     {
-        jsn->root = (jval_t){JTYPE_ARRAY, (uint32_t)idx};
+        jsn->root = (jval_t){JTYPE_ARRAY, (jidx_t)idx};
     }
     return idx;
 }
@@ -1340,11 +2399,29 @@ JINLINE void json_ints_reserve( json_t* jsn, size_t len )
     jint_t* ptr = (jint_t*)jrealloc(jsn->ints.ptr, cap * sizeof(jint_t));
     if (ptr)
     {
-        jsn->ints.cap = cap;
         jsn->ints.ptr = ptr;
+        if (jsn->flags & JFLAG_LAZY_NUMS)
+        {
+            jlex_t* lex = (jlex_t*)jrealloc(jsn->ints.lex, cap * sizeof(jlex_t));
+            if (!lex) return;
+            jsn->ints.lex = lex;
+        }
+        jsn->ints.cap = cap;
     }
 }
 
+//------------------------------------------------------------------------------
+/// position of src within the first len items of a pool, or SIZE_MAX if it is
+/// not in it. Used for spans of a doc added back to it, they have to be read
+/// from their position once the pool has grown and moved.
+JINLINE size_t jpool_find( const void* pool, size_t len, size_t size, const void* src )
+{
+    const uintptr_t p = (uintptr_t)pool;
+    const uintptr_t s = (uintptr_t)src;
+    if (!pool || s < p || s >= p + len * size) return SIZE_MAX;
+    return (s - p) / size;
+}
+
 //------------------------------------------------------------------------------
 JINLINE void json_nums_reserve( json_t* jsn, size_t len )
 {
@@ -1356,11 +2433,41 @@ JINLINE void json_nums_reserve( json_t* jsn, size_t len )
     jnum_t* ptr = (jnum_t*)jrealloc(jsn->nums.ptr, cap * sizeof(jnum_t));
     if (ptr)
     {
-        jsn->nums.cap = cap;
         jsn->nums.ptr = ptr;
+        if (jsn->flags & JFLAG_LAZY_NUMS)
+        {
+            jlex_t* lex = (jlex_t*)jrealloc(jsn->nums.lex, cap * sizeof(jlex_t));
+            if (!lex) return;
+            jsn->nums.lex = lex;
+        }
+        jsn->nums.cap = cap;
+    }
+}
+
+//------------------------------------------------------------------------------
+JINLINE void json_lexs_reserve( json_t* jsn, size_t len )
+{
+    assert(jsn);
+    if (jsn->lexs.len+len <= jsn->lexs.cap)
+        return;
+
+    size_t cap = grow(jsn->lexs.len+len, jsn->lexs.cap);
+    char* ptr = (char*)jrealloc(jsn->lexs.ptr, cap);
+    if (ptr)
+    {
+        jsn->lexs.cap = cap;
+        jsn->lexs.ptr = ptr;
     }
 }
 
+//------------------------------------------------------------------------------
+JINLINE void json_lexs_add( json_t* jsn, char ch )
+{
+    assert(jsn);
+    json_lexs_reserve(jsn, 1);
+    jsn->lexs.ptr[jsn->lexs.len++] = ch;
+}
+
 
 //------------------------------------------------------------------------------
 JINLINE size_t json_add_int( json_t* jsn, jint_t n )
@@ -1369,6 +2476,7 @@ JINLINE size_t json_add_int( json_t* jsn, jint_t n )
     json_ints_reserve(jsn, 1);
     size_t idx = jsn->ints.len++;
     jsn->ints.ptr[idx] = n;
+    if (jsn->ints.lex) jsn->ints.lex[idx] = (jlex_t){0, 0};
     return idx;
 }
 
@@ -1379,62 +2487,176 @@ JINLINE size_t json_add_num( json_t* jsn, jnum_t n )
     json_nums_reserve(jsn, 1);
     size_t idx = jsn->nums.len++;
     jsn->nums.ptr[idx] = n;
+    if (jsn->nums.lex) jsn->nums.lex[idx] = (jlex_t){0, 0};
     return idx;
 }
 
 //------------------------------------------------------------------------------
-JINLINE size_t json_add_strl( json_t* jsn, const char* str, size_t slen )
-{
-    assert(jsn);
-    assert(str);
-    size_t idx = jmap_add_str(&jsn->strmap, str, slen);
-    assert (idx != SIZE_MAX);
-    return idx;
-}
-
-//------------------------------------------------------------------------------
-const char* json_get_strl( const json_t* jsn, jval_t val, size_t* len )
-{
-    if (!jval_is_str(val)) return NULL;
-
-    jstr_t* jstr = jmap_get_str(&jsn->strmap, val.idx);
-    if (!jstr) return NULL;
-    *len = jstr->len;
-    return jstr_get_cstr(jstr);
-}
-
-//------------------------------------------------------------------------------
-jint_t json_get_int( const json_t* jsn, jval_t val )
+/// gets the raw source text of a number, or NULL if it has none.
+JINLINE const jlex_t* json_get_lex( const json_t* jsn, jval_t val )
 {
+    const jlex_t* lex;
     switch (jval_type(val))
     {
         case JTYPE_NUM:
-            return (jint_t)jsn->nums.ptr[val.idx];
+            lex = jsn->nums.lex ? jsn->nums.lex + val.idx : NULL;
+            break;
 
         case JTYPE_INT:
-            return jsn->ints.ptr[val.idx];
-
-        case JTYPE_SHORT:
-            return jshort_to_int(val.idx);
+            lex = jsn->ints.lex ? jsn->ints.lex + val.idx : NULL;
+            break;
 
         default:
-            return 0;
+            return NULL;
     }
+    return (lex && jlex_len(lex) > 0) ? lex : NULL;
 }
 
 //------------------------------------------------------------------------------
-jnum_t json_get_num( const json_t* jsn, jval_t val )
+JINLINE jint_t _json_get_int( const json_t* jsn, size_t idx )
 {
-    switch (jval_type(val))
+    jlex_t* lex = jsn->ints.lex;
+    if (lex && (lex[idx].len & JLEX_LAZY))
     {
-        case JTYPE_NUM:
-            return jsn->nums.ptr[val.idx];
-
-        case JTYPE_INT:
-            return (jnum_t)jsn->ints.ptr[val.idx];
-
-        case JTYPE_SHORT:
-            return jshort_to_int(val.idx);
+        jnum_t unused;
+        int type = jlex_convert(jsn->lexs.ptr + lex[idx].off, jlex_len(lex+idx), &unused, jsn->ints.ptr + idx);
+        assert(type == JTYPE_INT || type == JTYPE_SHORT); // validated while parsing
+        lex[idx].len = jlex_len(lex+idx);
+    }
+    return jsn->ints.ptr[idx];
+}
+
+//------------------------------------------------------------------------------
+JINLINE jnum_t _json_get_num( const json_t* jsn, size_t idx )
+{
+    jlex_t* lex = jsn->nums.lex;
+    if (lex && (lex[idx].len & JLEX_LAZY))
+    {
+        jint_t unused;
+        int type = jlex_convert(jsn->lexs.ptr + lex[idx].off, jlex_len(lex+idx), jsn->nums.ptr + idx, &unused);
+        assert(type == JTYPE_NUM); // validated while parsing
+        lex[idx].len = jlex_len(lex+idx);
+    }
+    return jsn->nums.ptr[idx];
+}
+
+//------------------------------------------------------------------------------
+JINLINE size_t json_add_strl_hash( json_t* jsn, const char* str, size_t slen, jhash_t hash )
+{
+    assert(jsn);
+    assert(str);
+    size_t idx = jmap_add_str_hash(&jsn->strmap, str, slen, hash);
+    assert (idx != SIZE_MAX);
+    return idx;
+}
+
+//------------------------------------------------------------------------------
+#define json_add_strl(JSN, STR, SLEN) json_add_strl_hash(JSN, STR, SLEN, jstr_hash(STR, SLEN, (JSN)->strmap.seed))
+
+//------------------------------------------------------------------------------
+/// adds a string value according to the document's interning policy. Strings
+/// that are not interned are appended to the pool without a table lookup.
+JINLINE size_t json_add_val_strl_hash( json_t* jsn, const char* str, size_t slen, jhash_t hash )
+{
+    assert(jsn);
+    assert(str);
+
+    // short strings are not added at all, see jstr_inline_make
+    if (slen <= JSTR_INLINE_MAX)
+        return jstr_inline_make(str, slen);
+
+    if ((jsn->flags & JFLAG_INTERN_KEYS) || jsn->intern.off)
+        return jmap_append_str(&jsn->strmap, str, slen, hash);
+
+    if (!(jsn->flags & JFLAG_INTERN_ADAPTIVE))
+        return json_add_strl_hash(jsn, str, slen, hash);
+
+    // new strings are always appended at the end, anything before it was a hit
+    size_t len = jmap_len(&jsn->strmap);
+    size_t idx = json_add_strl_hash(jsn, str, slen, hash);
+    jsn->intern.hits += (idx < len);
+
+    if (++jsn->intern.count == JINTERN_WINDOW)
+    {
+        jsn->intern.off = (jsn->intern.hits < JINTERN_MIN_HITS);
+        jsn->intern.count = jsn->intern.hits = 0;
+    }
+    return idx;
+}
+
+//------------------------------------------------------------------------------
+JINLINE size_t json_add_val_strl( json_t* jsn, const char* str, size_t slen )
+{
+    // skip the hash altogether when the string will not be interned
+    jhash_t hash = ((jsn->flags & JFLAG_INTERN_KEYS) || jsn->intern.off || slen <= JSTR_INLINE_MAX) ? 0 : jstr_hash(str, slen, jsn->strmap.seed);
+    size_t idx = json_add_val_strl_hash(jsn, str, slen, hash);
+    assert(slen <= JSTR_INLINE_MAX || idx < JSTR_INLINE);
+    return idx;
+}
+
+//------------------------------------------------------------------------------
+const char* json_get_strl( const json_t* jsn, jval_t val, size_t* len )
+{
+    if (!jval_is_str(val)) return NULL;
+
+    if (jstr_is_inline(val.idx))
+    {
+        *len = jstr_inline_len(val.idx);
+        return jstr_inline_cstr(val.idx);
+    }
+
+    jstr_t* jstr = jmap_get_str(&jsn->strmap, val.idx);
+    if (!jstr) return NULL;
+    *len = jstr->len;
+    return jstr_get_cstr(jstr);
+}
+
+//------------------------------------------------------------------------------
+/// same as json_get_strl, but an inline string is unpacked into buf instead of
+/// going through its shared copy. buf must hold JSTR_INLINE_MAX+1 bytes and
+/// the result is only valid as long as it is.
+JINLINE const char* json_get_strl_buf( const json_t* jsn, jval_t val, size_t* len, char* buf )
+{
+    if (jval_is_str(val) && jstr_is_inline(val.idx))
+    {
+        *len = jstr_inline_unpack(val.idx, buf);
+        return buf;
+    }
+    return json_get_strl(jsn, val, len);
+}
+
+//------------------------------------------------------------------------------
+jint_t json_get_int( const json_t* jsn, jval_t val )
+{
+    switch (jval_type(val))
+    {
+        case JTYPE_NUM:
+            return (jint_t)_json_get_num(jsn, val.idx);
+
+        case JTYPE_INT:
+            return _json_get_int(jsn, val.idx);
+
+        case JTYPE_SHORT:
+            return jshort_to_int(val.idx);
+
+        default:
+            return 0;
+    }
+}
+
+//------------------------------------------------------------------------------
+jnum_t json_get_num( const json_t* jsn, jval_t val )
+{
+    switch (jval_type(val))
+    {
+        case JTYPE_NUM:
+            return _json_get_num(jsn, val.idx);
+
+        case JTYPE_INT:
+            return (jnum_t)_json_get_int(jsn, val.idx);
+
+        case JTYPE_SHORT:
+            return jshort_to_int(val.idx);
 
         default:
             return 0;
@@ -1470,14 +2692,64 @@ jarray_t json_get_array( json_t* jsn, jval_t val )
     return (jarray_t){.json=jsn, .idx=val.idx};
 }
 
+//------------------------------------------------------------------------------
+jval_t json_make_num( json_t* jsn, jnum_t num )
+{
+    size_t idx = json_add_num(jsn, num);
+    assert(idx < MAX_VAL_IDX);
+    return (jval_t){JTYPE_NUM, (jidx_t)idx};
+}
+
+//------------------------------------------------------------------------------
+jval_t json_make_int( json_t* jsn, jint_t num )
+{
+    if (MIN_JSHORT <= num && num <= MAX_JSHORT)
+    {
+        return (jval_t){JTYPE_SHORT, (jidx_t)jint_to_short(num)};
+    }
+
+    size_t idx = json_add_int(jsn, num);
+    assert(idx < MAX_VAL_IDX);
+    return (jval_t){JTYPE_INT, (jidx_t)idx};
+}
+
+//------------------------------------------------------------------------------
+jval_t json_make_strl( json_t* jsn, const char* str, size_t slen )
+{
+    assert(str);
+    size_t idx = json_add_val_strl(jsn, str, slen);
+    assert(idx < MAX_VAL_IDX);
+    return (jval_t){JTYPE_STR, (jidx_t)idx};
+}
+
+//------------------------------------------------------------------------------
+jval_t json_make_obj( json_t* jsn )
+{
+    size_t idx = json_add_obj(jsn);
+    assert(idx < MAX_VAL_IDX);
+    return (jval_t){JTYPE_OBJ, (jidx_t)idx};
+}
+
+//------------------------------------------------------------------------------
+jval_t json_make_array( json_t* jsn )
+{
+    size_t idx = json_add_array(jsn);
+    assert(idx < MAX_VAL_IDX);
+    return (jval_t){JTYPE_ARRAY, (jidx_t)idx};
+}
+
 //------------------------------------------------------------------------------
 JINLINE int _json_compare_val( const json_t* j1, jval_t v1, const json_t* j2, jval_t v2 )
 {
-    int tdif = jval_type(v1) != jval_type(v2);
+    // a short is just a packed int, the two must compare by value
+    int t1 = (jval_type(v1) == JTYPE_SHORT) ? JTYPE_INT : jval_type(v1);
+    int t2 = (jval_type(v2) == JTYPE_SHORT) ? JTYPE_INT : jval_type(v2);
+
+    int tdif = t1 != t2;
     if (tdif != 0) return tdif;
-    if (j1 == j2 && v1.idx == v2.idx) return 0;
+    if (j1 == j2 && v1.type == v2.type && v1.idx == v2.idx) return 0;
 
-    switch(jval_type(v1))
+    switch(t1)
     {
         case JTYPE_NIL:
             return 0;
@@ -1487,9 +2759,20 @@ JINLINE int _json_compare_val( const json_t* j1, jval_t v1, const json_t* j2, jv
 
         case JTYPE_STR:
         {
-            jstr_t* s1 = jmap_get_str(&j1->strmap, v1.idx);
-            jstr_t* s2 = jmap_get_str(&j2->strmap, v2.idx);
-            return jstr_cmp(s1, s2);
+            if (!jstr_is_inline(v1.idx) && !jstr_is_inline(v2.idx))
+            {
+                jstr_t* s1 = jmap_get_str(&j1->strmap, v1.idx);
+                jstr_t* s2 = jmap_get_str(&j2->strmap, v2.idx);
+                return jstr_cmp(s1, s2);
+            }
+
+            size_t len1, len2;
+            char buf1[JSTR_INLINE_MAX+1], buf2[JSTR_INLINE_MAX+1];
+            const char* b1 = json_get_strl_buf(j1, v1, &len1, buf1);
+            const char* b2 = json_get_strl_buf(j2, v2, &len2, buf2);
+            int rt = memcmp(b1, b2, jmins(len1, len2));
+            if (rt == 0 && len1 != len2) return (len1 < len2) ? -1 : 1;
+            return rt;
         }
 
         case JTYPE_NUM:
@@ -1501,11 +2784,14 @@ JINLINE int _json_compare_val( const json_t* j1, jval_t v1, const json_t* j2, jv
             return 0;
         }
 
-        case JTYPE_SHORT:
-            return (int)(jshort_to_int(v1.idx)-jshort_to_int(v2.idx));
-
         case JTYPE_INT:
-            return (int)(json_get_int(j1, v1) - json_get_int(j2, v2));
+        {
+            jint_t i1 = json_get_int(j1, v1);
+            jint_t i2 = json_get_int(j2, v2);
+            if (i1 < i2) return -1;
+            if (i1 > i2) return 1;
+            return 0;
+        }
 
         case JTYPE_ARRAY:
         {
@@ -1518,1008 +2804,2865 @@ JINLINE int _json_compare_val( const json_t* j1, jval_t v1, const json_t* j2, jv
             if (len1 < len2) return -1;
             if (len1 > len2) return 1;
 
-            for ( size_t i = 0; i < len1; i++ )
-            {
-                jval_t v31 = jarray_get(a1, i);
-                jval_t v32 = jarray_get(a2, i);
-                int c = _json_compare_val(j1, v31, j2, v32);
-                if (c != 0) return c;
-            }
-            return 0;
-        }
+            for ( size_t i = 0; i < len1; i++ )
+            {
+                jval_t v31 = jarray_get(a1, i);
+                jval_t v32 = jarray_get(a2, i);
+                int c = _json_compare_val(j1, v31, j2, v32);
+                if (c != 0) return c;
+            }
+            return 0;
+        }
+
+        case JTYPE_OBJ:
+        {
+            jobj_t o1 = json_get_obj((json_t*)j1, v1);
+            jobj_t o2 = json_get_obj((json_t*)j2, v2);
+
+            size_t len1 = jobj_len(o1);
+            size_t len2 = jobj_len(o2);
+
+            if (len1 < len2) return -1;
+            if (len1 > len2) return 1;
+
+            for ( size_t i = 0; i < len1; i++ )
+            {
+                jval_t v31 = jobj_get_val(o1, i);
+                jval_t v32 = jobj_get_val(o2, i);
+                int c = _json_compare_val(j1, v31, j2, v32);
+                if (c != 0) return c;
+            }
+            return 0;
+        }
+
+        default:
+            return 0;
+    }
+}
+
+//------------------------------------------------------------------------------
+int json_compare( const json_t* j1, const json_t* j2 )
+{
+    if (j1 == j2) return 0;
+    return _json_compare_val(j1, json_root(j1), j2, json_root(j2));
+}
+
+//------------------------------------------------------------------------------
+int json_compare_val( const json_t* jsn, jval_t v1, jval_t v2 )
+{
+    return _json_compare_val(jsn, v1, jsn, v2);
+}
+
+#pragma mark - jobj_t
+
+//------------------------------------------------------------------------------
+JINLINE _jobj_t* jobj_get_obj(jobj_t obj)
+{
+    const json_t* jsn = jobj_get_json(obj);
+    assert(jsn);
+    assert(obj.idx < jsn->objs.len);
+    return _json_get_obj(jsn, obj.idx);
+}
+
+//------------------------------------------------------------------------------
+/// units of the block of an object with room for cap keys and values. Only
+/// objects big enough to be searched through an index keep a pointer to it.
+JINLINE size_t _jobj_units_for( size_t cap, jbool_t shaped )
+{
+    if (shaped) return jchildren_units(cap * sizeof(jval_t));
+    return (cap >= JOBJ_INDEX_MIN) + jchildren_units(cap * (sizeof(jokey_t) + sizeof(jval_t)));
+}
+
+#define _jobj_units(OBJ) _jobj_units_for((OBJ)->cap, _jobj_is_shaped(OBJ))
+
+//------------------------------------------------------------------------------
+/// the slot holding the object's own index, NULL if it cannot have one.
+JINLINE jobj_index_t** _jobj_own_index( const json_t* jsn, const _jobj_t* obj )
+{
+    if (_jobj_is_shaped(obj) || obj->cap < JOBJ_INDEX_MIN) return NULL;
+    return (jobj_index_t**)(jsn->children.ptr + obj->off);
+}
+
+//------------------------------------------------------------------------------
+JINLINE jokey_t* _jobj_keys( const json_t* jsn, const _jobj_t* obj )
+{
+    if (_jobj_is_shaped(obj)) return jsn->shapes.ptr[obj->shape-1].keys;
+    return (jokey_t*)(jsn->children.ptr + obj->off + (obj->cap >= JOBJ_INDEX_MIN));
+}
+
+//------------------------------------------------------------------------------
+JINLINE jval_t* _jobj_vals( const json_t* jsn, const _jobj_t* obj )
+{
+    if (_jobj_is_shaped(obj)) return (jval_t*)(jsn->children.ptr + obj->off);
+    return (jval_t*)(_jobj_keys(jsn, obj) + obj->cap);
+}
+
+//------------------------------------------------------------------------------
+#define jval_is_packed_key(VAL) (((VAL).type & ~JTYPE_MASK) != 0)
+
+//------------------------------------------------------------------------------
+size_t jobj_len( jobj_t obj )
+{
+    _jobj_t* _obj = jobj_get_obj(obj);
+    assert(_obj);
+    return _obj->len;
+}
+
+//------------------------------------------------------------------------------
+jbool_t jobj_contains_key( jobj_t obj, const char* key )
+{
+    size_t outlen;
+    const char* str = jobj_find_strl(obj, key, &outlen);
+    return (str) ? JTRUE : JFALSE;
+}
+
+//------------------------------------------------------------------------------
+const char* jobj_get(jobj_t obj, size_t idx, jval_t* val, size_t* klen)
+{
+    assert(val);
+    assert(klen);
+
+    _jobj_t* _obj = jobj_get_obj(obj);
+    const json_t* jsn = jobj_get_json(obj);
+
+    jokey_t* key = &_jobj_keys(jsn, _obj)[idx];
+
+    *val = _jobj_vals(jsn, _obj)[idx];
+    if (jval_is_packed_key(*val))
+    {
+        *klen = strlen(key->kstr);
+        return key->kstr;
+    }
+
+    jstr_t* jstr = jmap_get_str(&jsn->strmap, key->kidx);
+    assert(jstr);
+    *klen = jstr->len;
+    return jstr_get_cstr(jstr);
+}
+
+//------------------------------------------------------------------------------
+size_t jobj_get_key_id(jobj_t obj, size_t idx)
+{
+    _jobj_t* _obj = jobj_get_obj(obj);
+    const json_t* jsn = jobj_get_json(obj);
+
+    assert(idx < _obj->len);
+    jokey_t* key = &_jobj_keys(jsn, _obj)[idx];
+
+    if (jval_is_packed_key(_jobj_vals(jsn, _obj)[idx]))
+    {
+        // packed keys never go through the string table, only the dictionary
+        // or the concurrent table can give them an id
+        const jmap_t* dict = jsn->strmap.dict;
+        if (jsn->strmap.shared) return jcmap_find(jsn->strmap.shared, key->kstr);
+        if (!dict) return SIZE_MAX;
+        return jmap_find_str(dict, key->kstr, strlen(key->kstr));
+    }
+    return key->kidx;
+}
+
+//------------------------------------------------------------------------------
+JINLINE void jobj_index_free( const json_t* jsn, _jobj_t* obj )
+{
+    assert(obj);
+    jobj_index_t** index = _jobj_own_index(jsn, obj);
+    if (index && *index)
+    {
+        jfree(*index);
+        *index = NULL;
+    }
+}
+
+//------------------------------------------------------------------------------
+JINLINE jbool_t jobj_key_equals( const jokey_t* keys, const jval_t* vals, size_t pos, const jokey_t* key, jbool_t packed )
+{
+    return jokey_equals(keys[pos], *key) && jval_is_packed_key(vals[pos]) == packed;
+}
+
+//------------------------------------------------------------------------------
+/// position of the first key from next on that is the same as key, or len if
+/// there is none. Keys are compared 8 (AVX2) or 4 (SSE2) at a time, half as
+/// many with JSON_WIDE_INDEX. A 16 byte slot of JSON_WIDE_KEYS is compared a
+/// byte at a time, all 16 must match.
+JINLINE size_t jokeys_find( const jokey_t* keys, size_t next, size_t len, const jokey_t* key )
+{
+    size_t i = next;
+#if J_USE_AVX2 && JSON_WIDE_KEYS
+    const __m256i k = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)key));
+    for ( ; i + 2 <= len; i += 2 )
+    {
+        __m256i eq = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)&keys[i]), k);
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(eq);
+        if ((mask & 0xFFFF) == 0xFFFF) return i;
+        if ((mask >> 16) == 0xFFFF) return i + 1;
+    }
+#elif J_USE_SSE2 && JSON_WIDE_KEYS
+    const __m128i k = _mm_loadu_si128((const __m128i*)key);
+    for ( ; i < len; i++ )
+    {
+        __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)&keys[i]), k);
+        if (_mm_movemask_epi8(eq) == 0xFFFF) return i;
+    }
+#elif J_USE_AVX2 && JSON_WIDE_INDEX
+    const jidx_t kidx = key->kidx;
+    const __m256i k = _mm256_set1_epi64x((long long)kidx);
+    for ( ; i + 4 <= len; i += 4 )
+    {
+        __m256i eq = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i*)&keys[i]), k);
+        uint32_t mask = (uint32_t)_mm256_movemask_pd(_mm256_castsi256_pd(eq));
+        if (mask) return i + jctz(mask);
+    }
+#elif J_USE_AVX2
+    const jidx_t kidx = key->kidx;
+    const __m256i k = _mm256_set1_epi32((int)kidx);
+    for ( ; i + 8 <= len; i += 8 )
+    {
+        __m256i eq = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)&keys[i]), k);
+        uint32_t mask = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(eq));
+        if (mask) return i + jctz(mask);
+    }
+#elif J_USE_SSE2 && JSON_WIDE_INDEX
+    // no 64-bit compare before SSE4.1, both halves must match
+    const jidx_t kidx = key->kidx;
+    const __m128i k = _mm_set1_epi64x((long long)kidx);
+    for ( ; i + 2 <= len; i += 2 )
+    {
+        __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)&keys[i]), k);
+        eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+        uint32_t mask = (uint32_t)_mm_movemask_pd(_mm_castsi128_pd(eq));
+        if (mask) return i + jctz(mask);
+    }
+#elif J_USE_SSE2
+    const jidx_t kidx = key->kidx;
+    const __m128i k = _mm_set1_epi32((int)kidx);
+    for ( ; i + 4 <= len; i += 4 )
+    {
+        __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)&keys[i]), k);
+        uint32_t mask = (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(eq));
+        if (mask) return i + jctz(mask);
+    }
+#endif
+    for ( ; i < len; i++ )
+    {
+        if (jokey_equals(keys[i], *key)) return i;
+    }
+    return len;
+}
+
+//------------------------------------------------------------------------------
+/// first slot to probe for a key. Interned ids are sequential and packed keys
+/// are their own bytes, so both are scrambled before taking the top bits.
+JINLINE size_t jobj_index_start( const jobj_index_t* index, const jokey_t* key, jbool_t packed )
+{
+    uint64_t k = jokey_bits(*key) ^ (packed ? 0x5BD1E9955BD1E995ULL : 0);
+    return (size_t)((k * 0x9E3779B97F4A7C15ULL) >> index->shift);
+}
+
+//------------------------------------------------------------------------------
+JINLINE void jobj_index_put( jobj_index_t* index, const jokey_t* keys, const jval_t* vals, size_t pos )
+{
+    const jokey_t* key = &keys[pos];
+    jbool_t packed = jval_is_packed_key(vals[pos]);
+    for ( size_t i = jobj_index_start(index, key, packed); ; i = (i+1) & index->mask )
+    {
+        jidx_t slot = index->slots[i];
+        if (!slot)
+        {
+            index->slots[i] = (jidx_t)(pos+1);
+            return;
+        }
+
+        // a repeated key keeps resolving to its first occurrence, just like a
+        // linear search would
+        if (jobj_key_equals(keys, vals, slot-1, key, packed)) return;
+    }
+}
+
+//------------------------------------------------------------------------------
+JINLINE jobj_index_t* jobj_index_build( const jokey_t* keys, const jval_t* vals, size_t len )
+{
+    // at most half full, so probes stay short
+    int bits = 1;
+    while (((size_t)1 << bits) < len*2) bits++;
+    size_t cap = (size_t)1 << bits;
+
+    jobj_index_t* index = (jobj_index_t*)jmalloc(sizeof(jobj_index_t) + cap * sizeof(jidx_t));
+    index->mask = cap - 1;
+    index->shift = 64 - bits;
+    memset(index->slots, 0, cap * sizeof(jidx_t));
+
+    for ( size_t i = 0; i < len; i++ )
+    {
+        jobj_index_put(index, keys, vals, i);
+    }
+    return index;
+}
+
+//------------------------------------------------------------------------------
+/// builds the index of an object that is big enough to be searched through
+/// one and does not have it yet.
+JINLINE void jobj_index_ensure( const json_t* jsn, _jobj_t* obj )
+{
+    jobj_index_t** index = _jobj_own_index(jsn, obj);
+    if (index && !*index && obj->len >= JOBJ_INDEX_MIN)
+    {
+        *index = jobj_index_build(_jobj_keys(jsn, obj), _jobj_vals(jsn, obj), obj->len);
+    }
+}
+
+//------------------------------------------------------------------------------
+JINLINE size_t jobj_index_find( const json_t* jsn, const _jobj_t* obj, const jokey_t* key, jbool_t packed )
+{
+    const jokey_t* keys = _jobj_keys(jsn, obj);
+    const jval_t* vals = _jobj_vals(jsn, obj);
+
+    // objects of one shape share its index. Indexes are built as objects
+    // change, never here, so lookups do not write to the doc.
+    const jobj_index_t* index = obj->shape ? jsn->shapes.ptr[obj->shape-1].index : *_jobj_own_index(jsn, obj);
+    assert(index);
+    for ( size_t i = jobj_index_start(index, key, packed); ; i = (i+1) & index->mask )
+    {
+        jidx_t slot = index->slots[i];
+        if (!slot) return SIZE_MAX;
+        if (jobj_key_equals(keys, vals, slot-1, key, packed)) return slot-1;
+    }
+}
+
+//------------------------------------------------------------------------------
+/// moves the keys and values into a block with room for cap of each. The
+/// index stays valid, positions do not change. An object with a shape gets
+/// its own copy of the keys and leaves the shape.
+JINLINE void _jobj_realloc( json_t* jsn, _jobj_t* obj, size_t cap )
+{
+    assert(cap >= obj->len);
+    assert(cap <= MAX_CONTAINER_LEN);
+
+    // where the children are now, the pool may move
+    const size_t len = obj->len;
+    const jokey_t* shared = _jobj_is_shaped(obj) ? _jobj_keys(jsn, obj) : NULL;
+    const size_t kpos = shared ? 0 : (size_t)((char*)_jobj_keys(jsn, obj) - (char*)jsn->children.ptr);
+    const size_t vpos = (size_t)((char*)_jobj_vals(jsn, obj) - (char*)jsn->children.ptr);
+    jobj_index_t** own = _jobj_own_index(jsn, obj);
+    jobj_index_t* index = own ? *own : NULL;
+
+    const size_t off = jchildren_regrow(jsn, obj->off, _jobj_units(obj), _jobj_units_for(cap, JFALSE));
+    obj->off = (jidx_t)off;
+    obj->cap = (jsize_t)cap;
+    obj->shape = 0;
+
+    // a block that grew in place overlaps the old one, but both keys and
+    // values only move up and the values go first
+    char* base = (char*)jsn->children.ptr;
+    jokey_t* keys = _jobj_keys(jsn, obj);
+    memmove(_jobj_vals(jsn, obj), base + vpos, len * sizeof(jval_t));
+    memmove(keys, shared ? (const void*)shared : (const void*)(base + kpos), len * sizeof(jokey_t));
+
+    own = _jobj_own_index(jsn, obj);
+    if (own) *own = index;
+    else jfree(index);
+}
+
+//------------------------------------------------------------------------------
+JINLINE uint64_t jshape_mix( uint64_t h, const jokey_t* key, jbool_t packed )
+{
+    return (h ^ (jokey_bits(*key) << 1 | (uint64_t)packed)) * 0x9E3779B97F4A7C15ULL;
+}
+
+//------------------------------------------------------------------------------
+JINLINE uint32_t jshape_hash( const jokey_t* keys, const jval_t* vals, size_t len )
+{
+    uint64_t h = len;
+    for ( size_t i = 0; i < len; i++ )
+    {
+        h = jshape_mix(h, &keys[i], jval_is_packed_key(vals[i]));
+    }
+    return (uint32_t)(h >> 32);
+}
+
+//------------------------------------------------------------------------------
+JINLINE jbool_t jshape_equals( const jshape_t* shape, const jokey_t* keys, const jval_t* vals, size_t len )
+{
+    if (shape->len != len) return JFALSE;
+
+    const uint8_t* packed = (const uint8_t*)(shape->keys + len);
+    for ( size_t i = 0; i < len; i++ )
+    {
+        if (!jokey_equals(shape->keys[i], keys[i]) || packed[i] != jval_is_packed_key(vals[i])) return JFALSE;
+    }
+    return JTRUE;
+}
+
+//------------------------------------------------------------------------------
+/// puts a shape into the lookup table, which is kept at most half full.
+JINLINE void jshapes_put( json_t* jsn, size_t idx )
+{
+    const uint32_t hash = jsn->shapes.ptr[idx].hash;
+    for ( size_t i = hash & jsn->shapes.mask; ; i = (i+1) & jsn->shapes.mask )
+    {
+        if (!jsn->shapes.slots[i])
+        {
+            jsn->shapes.slots[i] = (jidx_t)(idx+1);
+            return;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+JINLINE void jshapes_rehash( json_t* jsn )
+{
+    size_t cap = 16;
+    while (cap <= jsn->shapes.len * 2) cap *= 2;
+
+    jfree(jsn->shapes.slots);
+    jsn->shapes.slots = (jidx_t*)jmalloc(cap * sizeof(jidx_t));
+    memset(jsn->shapes.slots, 0, cap * sizeof(jidx_t));
+    jsn->shapes.mask = cap - 1;
+
+    for ( size_t i = 0; i < jsn->shapes.len; i++ )
+    {
+        jshapes_put(jsn, i);
+    }
+}
+
+//------------------------------------------------------------------------------
+/// finds the shape of a list of keys. Returns its index + 1, or 0 for a list
+/// seen for the first time: it only pays off once another object shares it.
+/// The hint is checked first, without hashing the keys.
+JINLINE jidx_t jshape_get( json_t* jsn, jidx_t hint, uint32_t* seen, const jokey_t* keys, const jval_t* vals, size_t len )
+{
+    if (hint && hint <= jsn->shapes.len && jshape_equals(&jsn->shapes.ptr[hint-1], keys, vals, len)) return hint;
+
+    const uint32_t hash = jshape_hash(keys, vals, len);
+    if (jsn->shapes.slots)
+    {
+        for ( size_t i = hash & jsn->shapes.mask; jsn->shapes.slots[i]; i = (i+1) & jsn->shapes.mask )
+        {
+            const jidx_t slot = jsn->shapes.slots[i];
+            const jshape_t* shape = &jsn->shapes.ptr[slot-1];
+            if (shape->hash == hash && jshape_equals(shape, keys, vals, len)) return slot;
+        }
+    }
+
+    // a colliding list only gets its shape one object sooner or later
+    uint32_t* first = &seen[hash & (JSHAPE_SEEN-1)];
+    if (*first != hash)
+    {
+        *first = hash;
+        return 0;
+    }
+
+    if (jsn->shapes.len == jsn->shapes.cap)
+    {
+        size_t cap = grow(jsn->shapes.len+1, jsn->shapes.cap);
+        jsn->shapes.ptr = (jshape_t*)jrealloc(jsn->shapes.ptr, cap * sizeof(jshape_t));
+        jsn->shapes.cap = cap;
+    }
+
+    const size_t idx = jsn->shapes.len++;
+    jshape_t* shape = &jsn->shapes.ptr[idx];
+    shape->len = (jsize_t)len;
+    shape->hash = hash;
+    shape->keys = (jokey_t*)jmalloc(len * (sizeof(jokey_t) + 1));
+    memcpy(shape->keys, keys, len * sizeof(jokey_t));
+
+    uint8_t* packed = (uint8_t*)(shape->keys + len);
+    for ( size_t i = 0; i < len; i++ )
+    {
+        packed[i] = jval_is_packed_key(vals[i]);
+    }
+    shape->index = (len >= JOBJ_INDEX_MIN) ? jobj_index_build(shape->keys, vals, len) : NULL;
+
+    if (jsn->shapes.len * 2 > jsn->shapes.mask) jshapes_rehash(jsn);
+    else jshapes_put(jsn, idx);
+    return (jidx_t)(idx+1);
+}
+
+//------------------------------------------------------------------------------
+/// frees every shape, their objects must be gone or have their own keys.
+JINLINE void jshapes_clear( json_t* jsn )
+{
+    for ( size_t i = 0; i < jsn->shapes.len; i++ )
+    {
+        jfree(jsn->shapes.ptr[i].keys);
+        jfree(jsn->shapes.ptr[i].index);
+    }
+    jsn->shapes.len = 0;
+    if (jsn->shapes.slots) memset(jsn->shapes.slots, 0, (jsn->shapes.mask+1) * sizeof(jidx_t));
+}
+
+//------------------------------------------------------------------------------
+/// gives an empty object exactly len keys and values, used by the parser once
+/// all of them are known. Objects with more than a few keys share them through
+/// a shape and only store their values, once their keys are seen again.
+JINLINE void _jobj_assign( json_t* jsn, jidx_t* shape_hint, uint32_t* seen, _jobj_t* obj, const jokey_t* keys, const jval_t* vals, size_t len )
+{
+    assert(obj);
+    assert(obj->len == 0 && obj->cap == 0);
+    if (len == 0) return;
+
+    obj->shape = (len > BUF_SIZE) ? jshape_get(jsn, *shape_hint, seen, keys, vals, len) : 0;
+    if (obj->shape) *shape_hint = obj->shape;
+    obj->cap = (jsize_t)len;
+    obj->len = (jsize_t)len;
+    obj->off = (jidx_t)jchildren_alloc(jsn, _jobj_units(obj));
+
+    jobj_index_t** index = _jobj_own_index(jsn, obj);
+    if (index) *index = NULL;
+    if (!obj->shape) memcpy(_jobj_keys(jsn, obj), keys, sizeof(jokey_t) * len);
+    memcpy(_jobj_vals(jsn, obj), vals, sizeof(jval_t) * len);
+    jobj_index_ensure(jsn, obj);
+}
+
+//------------------------------------------------------------------------------
+JINLINE void _jobj_reserve( json_t* jsn, _jobj_t* obj, size_t cap )
+{
+    assert(obj);
+    // shared keys are copied before they can change
+    if ( obj->len+cap <= obj->cap && !_jobj_is_shaped(obj) )
+        return;
+
+    // the first block is small, most objects never grow past it
+    const size_t len = obj->len+cap;
+    _jobj_realloc(jsn, obj, (obj->cap == 0 && len <= BUF_SIZE) ? BUF_SIZE : grow(len, obj->cap));
+}
+
+//------------------------------------------------------------------------------
+void jobj_reserve( jobj_t obj, size_t cap )
+{
+    _jobj_reserve(jobj_get_json(obj), jobj_get_obj(obj), cap);
+}
+
+//------------------------------------------------------------------------------
+JINLINE jval_t* _jobj_get_val( const json_t* jsn, _jobj_t* obj, size_t idx )
+{
+    return (idx < obj->len) ? &_jobj_vals(jsn, obj)[idx] : NULL;
+}
+
+//------------------------------------------------------------------------------
+#define jobj_add_key(OBJ, KEY) jobj_add_keyl(OBJ, KEY, strlen(KEY))
+
+//------------------------------------------------------------------------------
+/// fills in the key of a new entry, returns JTRUE if the key is packed into it
+/// rather than added to the string map.
+JINLINE jbool_t jokey_make( json_t* jsn, jokey_t* k, const char* key, size_t klen, jhash_t hash )
+{
+    memset(k, 0, sizeof(jokey_t));
+    if (klen < JKEY_INLINE)
+    {
+        memcpy(k->kstr, key, klen);
+        return JTRUE;
+    }
+
+    size_t kidx = json_add_strl_hash(jsn, key, klen, hash);
+    assert (kidx < MAX_KEY_IDX);
+    k->kidx = (jidx_t)kidx;
+    return JFALSE;
+}
+
+//------------------------------------------------------------------------------
+JINLINE size_t jobj_add_keyl_hash( jobj_t o, const char* key, size_t klen, jhash_t hash )
+{
+    json_t* jsn = jobj_get_json(o);
+    _jobj_t* obj = jobj_get_obj(o);
+
+    assert(obj);
+    assert(key);
+
+    // the key is made first, it may point into the children that are moved
+    jokey_t k;
+    const jbool_t packed = jokey_make(jsn, &k, key, klen, hash);
+
+    _jobj_reserve(jsn, obj, 1);
+    size_t idx = obj->len++;
+
+    jokey_t* keys = _jobj_keys(jsn, obj);
+    jval_t* vals = _jobj_vals(jsn, obj);
+    keys[idx] = k;
+    vals[idx].type = JTYPE_NIL;
+    vals[idx].idx = 0;
+    if (packed)
+    {
+        vals[idx].type |= ~JTYPE_MASK;
+    }
+
+    // keep an existing index current, once it would be more than half full
+    // replace it with a bigger one
+    jobj_index_t** index = _jobj_own_index(jsn, obj);
+    if (index && *index)
+    {
+        if (obj->len*2 > (*index)->mask+1) jobj_index_free(jsn, obj);
+        else jobj_index_put(*index, keys, vals, idx);
+    }
+    jobj_index_ensure(jsn, obj);
+    return idx;
+}
+
+//------------------------------------------------------------------------------
+JINLINE size_t jobj_add_keyl( jobj_t o, const char* key, size_t klen )
+{
+    // short keys are packed into the value and never hashed
+    jhash_t hash = (klen < JKEY_INLINE) ? 0 : jstr_hash(key, klen, jobj_get_json(o)->strmap.seed);
+    return jobj_add_keyl_hash(o, key, klen, hash);
+}
+
+//------------------------------------------------------------------------------
+#define jobj_add_kval(OBJ,KEY,VAL) jkv_set_val(OBJ, jobj_add_key(OBJ, KEY), VAL)
+
+//------------------------------------------------------------------------------
+JINLINE void jkv_set_val(jobj_t o, size_t idx, jval_t val )
+{
+    jval_t* v = _jobj_get_val(jobj_get_json(o), jobj_get_obj(o), idx);
+    assert(v);
+    v->type = (v->type & ~JTYPE_MASK) | (val.type & JTYPE_MASK);
+    v->idx = val.idx;
+}
+
+//------------------------------------------------------------------------------
+JINLINE void jobj_add_kv(jobj_t obj, const char* key, uint32_t type, size_t idx)
+{
+    assert(idx < MAX_VAL_IDX);
+    assert((type & ~JTYPE_MASK) == 0);
+    jobj_add_kval(obj, key, ((jval_t){type, (jidx_t)idx}));
+}
+
+//------------------------------------------------------------------------------
+void jobj_add_num( jobj_t obj, const char* key, jnum_t num )
+{
+    assert(key);
+    size_t idx = json_add_num(jobj_get_json(obj), num);
+    jobj_add_kv(obj, key, JTYPE_NUM, idx);
+}
+
+//------------------------------------------------------------------------------
+void jobj_add_int( jobj_t obj, const char* key, jint_t num )
+{
+    assert(key);
+
+    if (MIN_JSHORT <= num && num <= MAX_JSHORT)
+    {
+        jobj_add_kv(obj, key, JTYPE_SHORT, jint_to_short(num));
+    }
+    else
+    {
+        size_t idx = json_add_int(jobj_get_json(obj), num);
+        jobj_add_kv(obj, key, JTYPE_INT, idx);
+    }
+}
+
+//------------------------------------------------------------------------------
+void jobj_add_strl( jobj_t obj, const char* key, const char* str, size_t slen )
+{
+    assert(key);
+    assert(str);
+
+    // TODO: validate the string as a valid UTF8 sequence!
+
+    size_t idx = json_add_val_strl(jobj_get_json(obj), str, slen);
+    jobj_add_kv(obj, key, JTYPE_STR, idx);
+}
+
+//------------------------------------------------------------------------------
+void jobj_add_bool( jobj_t obj, const char* key, jbool_t b )
+{
+    assert(key);
+    jobj_add_kv(obj, key, JTYPE_BOOL, b);
+}
+
+//------------------------------------------------------------------------------
+void jobj_add_nil( jobj_t obj, const char* key )
+{
+    assert(key);
+    jobj_add_kv(obj, key, JTYPE_NIL, 0);
+}
+
+//------------------------------------------------------------------------------
+jarray_t jobj_add_array( jobj_t obj, const char* key )
+{
+    assert(key);
+    json_t* jsn = jobj_get_json(obj);
+    size_t idx = json_add_array(jsn);
+    jobj_add_kv(obj, key, JTYPE_ARRAY, idx);
+    return (jarray_t){ jsn, idx };
+}
+
+//------------------------------------------------------------------------------
+jobj_t jobj_add_obj( jobj_t obj, const char* key )
+{
+    assert(key);
+    json_t* jsn = jobj_get_json(obj);
+    size_t idx = json_add_obj(jsn);
+    jobj_add_kv(obj, key, JTYPE_OBJ, idx);
+    return (jobj_t){ jsn, idx };
+}
+
+//------------------------------------------------------------------------------
+void jobj_set_val( jobj_t obj, const char* key, jval_t val )
+{
+    assert(key);
+    const size_t klen = strlen(key);
+    size_t idx = jobj_findl_idx(obj, key, klen);
+    if (idx == SIZE_MAX) idx = jobj_add_keyl(obj, key, klen);
+
+    // the replaced value is left for json_gc
+    val.type &= JTYPE_MASK;
+    jkv_set_val(obj, idx, val);
+}
+
+//------------------------------------------------------------------------------
+void jobj_set_num( jobj_t obj, const char* key, jnum_t num )
+{
+    jobj_set_val(obj, key, json_make_num(jobj_get_json(obj), num));
+}
+
+//------------------------------------------------------------------------------
+void jobj_set_int( jobj_t obj, const char* key, jint_t num )
+{
+    jobj_set_val(obj, key, json_make_int(jobj_get_json(obj), num));
+}
+
+//------------------------------------------------------------------------------
+void jobj_set_strl( jobj_t obj, const char* key, const char* str, size_t slen )
+{
+    jobj_set_val(obj, key, json_make_strl(jobj_get_json(obj), str, slen));
+}
+
+//------------------------------------------------------------------------------
+void jobj_set_bool( jobj_t obj, const char* key, jbool_t b )
+{
+    jobj_set_val(obj, key, (jval_t){JTYPE_BOOL, b ? 1 : 0});
+}
+
+//------------------------------------------------------------------------------
+void jobj_set_nil( jobj_t obj, const char* key )
+{
+    jobj_set_val(obj, key, JNULL_VAL);
+}
+
+//------------------------------------------------------------------------------
+jobj_t jobj_set_obj( jobj_t obj, const char* key )
+{
+    jval_t val = json_make_obj(jobj_get_json(obj));
+    jobj_set_val(obj, key, val);
+    return (jobj_t){ jobj_get_json(obj), val.idx };
+}
+
+//------------------------------------------------------------------------------
+jarray_t jobj_set_array( jobj_t obj, const char* key )
+{
+    jval_t val = json_make_array(jobj_get_json(obj));
+    jobj_set_val(obj, key, val);
+    return (jarray_t){ jobj_get_json(obj), val.idx };
+}
+
+//------------------------------------------------------------------------------
+void jobj_remove_idx( jobj_t o, size_t idx )
+{
+    json_t* jsn = jobj_get_json(o);
+    _jobj_t* obj = jobj_get_obj(o);
+    assert(obj);
+    assert(idx < obj->len);
+
+    // keys after it move down, which the index does not know about
+    jobj_index_free(jsn, obj);
+    if (_jobj_is_shaped(obj)) _jobj_realloc(jsn, obj, obj->cap);
+
+    const size_t n = obj->len - idx - 1;
+    jokey_t* keys = _jobj_keys(jsn, obj);
+    jval_t* vals = _jobj_vals(jsn, obj);
+    memmove(keys + idx, keys + idx + 1, n * sizeof(jokey_t));
+    memmove(vals + idx, vals + idx + 1, n * sizeof(jval_t));
+    obj->len--;
+    jobj_index_ensure(jsn, obj);
+}
+
+//------------------------------------------------------------------------------
+jbool_t jobj_removel( jobj_t obj, const char* key, size_t klen )
+{
+    size_t idx = jobj_findl_idx(obj, key, klen);
+    if (idx == SIZE_MAX) return JFALSE;
+    jobj_remove_idx(obj, idx);
+    return JTRUE;
+}
+
+//------------------------------------------------------------------------------
+jval_t jobj_get_val(jobj_t obj, size_t idx)
+{
+    jval_t* val = _jobj_get_val(jobj_get_json(obj), jobj_get_obj(obj), idx);
+    return val ? *val : JNULL_VAL;
+}
+
+//------------------------------------------------------------------------------
+/// wraps a key the way it is stored in objects into a handle.
+JINLINE jkey_t jkey_make( const jokey_t* k, int kind )
+{
+    jkey_t key;
+    assert(sizeof(key.key) == sizeof(jokey_t));
+    memcpy(&key.key, k, sizeof(jokey_t));
+    key.kind = kind;
+    return key;
+}
+
+//------------------------------------------------------------------------------
+jkey_t jkey_resolve( const json_t* jsn, const char* key, size_t klen )
+{
+    assert(jsn);
+    assert(key || klen == 0);
+
+    jokey_t k;
+    memset(&k, 0, sizeof(jokey_t));
+
+    // short keys are never hashed, they are stored as their own bytes
+    if (klen < JKEY_INLINE)
+    {
+        memcpy(k.kstr, key, klen); // zero padded, same as the stored key
+        return jkey_make(&k, JKEY_PACKED);
+    }
+
+    // check the hashtable for our string, if it's not there it's no where!
+    size_t idx = jmap_find_str(&jsn->strmap, key, klen);
+    if (idx == SIZE_MAX) return jkey_make(&k, JKEY_MISSING);
+    k.kidx = (jidx_t)idx;
+    return jkey_make(&k, JKEY_ID);
+}
+
+//------------------------------------------------------------------------------
+jkey_t jkey_intern( json_t* jsn, const char* key, size_t klen )
+{
+    assert(jsn);
+    assert(key || klen == 0);
+
+    // short keys are packed and never hashed
+    jhash_t hash = (klen < JKEY_INLINE) ? 0 : jstr_hash(key, klen, jsn->strmap.seed);
+    jokey_t k;
+    if (jokey_make(jsn, &k, key, klen, hash))
+        return jkey_make(&k, JKEY_PACKED);
+    return jkey_make(&k, JKEY_ID);
+}
+
+//------------------------------------------------------------------------------
+void jobj_add_many( jobj_t o, const jkey_t* keys, const jval_t* vals, size_t n )
+{
+    assert(keys || n == 0);
+    assert(vals || n == 0);
+    if (n == 0) return;
+
+    json_t* jsn = jobj_get_json(o);
+    _jobj_t* obj = jobj_get_obj(o);
+    assert(obj->len + n <= MAX_CONTAINER_LEN);
+    _jobj_reserve(jsn, obj, n);
+
+    // cheaper to rebuild the index once all are in than to keep it current
+    jobj_index_free(jsn, obj);
+
+    jokey_t* k = _jobj_keys(jsn, obj) + obj->len;
+    jval_t* v = _jobj_vals(jsn, obj) + obj->len;
+    for ( size_t i = 0; i < n; i++ )
+    {
+        assert(keys[i].kind != JKEY_MISSING);
+        memcpy(&k[i], &keys[i].key, sizeof(jokey_t));
+        v[i] = vals[i];
+        v[i].type &= JTYPE_MASK;
+        if (keys[i].kind == JKEY_PACKED) v[i].type |= ~JTYPE_MASK;
+    }
+
+    obj->len += (jsize_t)n;
+    jobj_index_ensure(jsn, obj);
+}
+
+//------------------------------------------------------------------------------
+JINLINE size_t jobj_find_resolved( jobj_t obj, size_t next, jkey_t key )
+{
+    if (key.kind == JKEY_MISSING) return SIZE_MAX;
+    jbool_t packed = key.kind == JKEY_PACKED;
+    jokey_t k;
+    memcpy(&k, &key.key, sizeof(jokey_t));
+
+    // large objects are searched through a hash index. Only the first match
+    // is indexed, repeated keys after it are still found by scanning.
+    // Objects with a shape share its index.
+    _jobj_t* _obj = jobj_get_obj(obj);
+    if (next == 0 && _obj->len >= JOBJ_INDEX_MIN)
+    {
+        return jobj_index_find(jobj_get_json(obj), _obj, &k, packed);
+    }
+
+    // packed keys are zero padded, so comparing them whole also tells a short
+    // key apart from a longer one it is a prefix of. A packed key can hold the
+    // same bits as a string id, so matches are checked against the flag.
+    const jokey_t* keys = _jobj_keys(jobj_get_json(obj), _obj);
+    const jval_t* vals = _jobj_vals(jobj_get_json(obj), _obj);
+    for ( size_t i = jokeys_find(keys, next, _obj->len, &k); i < _obj->len; i = jokeys_find(keys, i+1, _obj->len, &k) )
+    {
+        if (jval_is_packed_key(vals[i]) == packed)
+        {
+            // found it!
+            return i;
+        }
+    }
+    return SIZE_MAX;
+}
+
+//------------------------------------------------------------------------------
+size_t jobj_findl_next_idx( jobj_t obj, size_t next, const char* key, size_t klen )
+{
+    return jobj_find_resolved(obj, next, jkey_resolve(jobj_get_json(obj), key, klen));
+}
+
+//------------------------------------------------------------------------------
+size_t jobj_find_key_idx( jobj_t obj, jkey_t key )
+{
+    return jobj_find_resolved(obj, 0, key);
+}
+
+//------------------------------------------------------------------------------
+JINLINE void _jobj_print(jprint_t* ctx, jobj_t obj, size_t depth)
+{
+    jprint_char(ctx, '{');
+    jprint_newline(ctx);
+
+    json_t* jsn = jobj_get_json(obj);
+    size_t len = jobj_len(obj);
+    for ( size_t i = 0; i < len; i++ )
+    {
+        jval_t val;
+        size_t klen;
+        const char* key = jobj_get(obj, i, &val, &klen);
+
+        jprint_tabs(ctx, depth+1);
+        json_print_strl(ctx, key, klen);
+        jprint_char(ctx, ':');
+        jprint_space(ctx);
+        _jval_print(ctx, jsn, val, depth+1);
+        if (i+1 != len) jprint_char(ctx, ',');
+        jprint_newline(ctx);
+    }
+
+    jprint_tabs(ctx, depth);
+    jprint_char(ctx, '}');
+}
+
+#pragma mark - jarray_t
+
+//------------------------------------------------------------------------------
+JINLINE _jarray_t* _jarray_get_array(jarray_t array)
+{
+    assert(array.json);
+    return _json_get_array(array.json, array.idx);
+}
+
+//------------------------------------------------------------------------------
+size_t jarray_len(jarray_t a)
+{
+    return _jarray_get_array(a)->len;
+}
+
+//------------------------------------------------------------------------------
+#define _jarray_units(CAP) jchildren_units((CAP) * sizeof(jval_t))
+
+//------------------------------------------------------------------------------
+JINLINE jval_t* _jarray_vals( const json_t* jsn, const _jarray_t* a )
+{
+    return (jval_t*)(jsn->children.ptr + a->off);
+}
+
+//------------------------------------------------------------------------------
+/// gives a run of numbers its own values again, before it is modified.
+JINLINE void _jarray_unrun( json_t* jsn, _jarray_t* a )
+{
+    assert(_jarray_is_run(a));
+
+    const jidx_t first = _jarray_run_first(a);
+    const jidx_t type = _jarray_run_type(a);
+    const size_t len = a->len;
+
+    a->cap = (jsize_t)len;
+    a->off = (jidx_t)jchildren_alloc(jsn, _jarray_units(len));
+
+    jval_t* vals = _jarray_vals(jsn, a);
+    for ( size_t i = 0; i < len; i++ )
+    {
+        vals[i] = (jval_t){type, first + (jidx_t)i};
+    }
+}
+
+//------------------------------------------------------------------------------
+/// tests for numbers that sit next to each other in one pool. The parser adds
+/// the numbers of a flat array to the pool in order, so this only holds for
+/// arrays of all doubles or all large ints.
+JINLINE jbool_t jvals_is_run( const jval_t* vals, size_t len )
+{
+    if (len == 0) return JFALSE;
+
+    const jval_t first = vals[0];
+    if (first.type != JTYPE_NUM && first.type != JTYPE_INT) return JFALSE;
+
+    for ( size_t i = 1; i < len; i++ )
+    {
+        if (vals[i].type != first.type || vals[i].idx != first.idx + i) return JFALSE;
+    }
+    return JTRUE;
+}
+
+//------------------------------------------------------------------------------
+/// gives an empty array exactly len values, or makes it a run if they are one.
+/// Used by the parser once all of the values are known.
+JINLINE void _jarray_assign( json_t* jsn, _jarray_t* a, const jval_t* vals, size_t len )
+{
+    assert(a);
+    assert(a->len == 0 && a->cap == 0);
+
+    a->len = (jsize_t)len;
+    if (jvals_is_run(vals, len))
+    {
+        a->off = _jarray_run_off(vals[0].idx, vals[0].type);
+        return;
+    }
+    if (len == 0) return;
+
+    a->cap = (jsize_t)len;
+    a->off = (jidx_t)jchildren_alloc(jsn, _jarray_units(len));
+    memcpy(_jarray_vals(jsn, a), vals, len * sizeof(jval_t));
+}
+
+//------------------------------------------------------------------------------
+JINLINE void _jarray_reserve( json_t* jsn, _jarray_t* a, size_t cap )
+{
+    assert(a);
+
+    if (_jarray_is_run(a)) _jarray_unrun(jsn, a);
+
+    if ( a->len+cap <= a->cap )
+        return;
+
+    // the first block is small, most arrays never grow past it
+    const size_t len = a->len+cap;
+    const size_t new_cap = (a->cap == 0 && len <= BUF_SIZE) ? BUF_SIZE : grow(len, a->cap);
+    assert(new_cap <= MAX_CONTAINER_LEN);
+
+    const size_t off = jchildren_regrow(jsn, a->off, _jarray_units(a->cap), _jarray_units(new_cap));
+    if (off != a->off) memcpy(jsn->children.ptr + off, jsn->children.ptr + a->off, a->len * sizeof(jval_t));
+    a->off = (jidx_t)off;
+    a->cap = (jsize_t)new_cap;
+}
+
+//------------------------------------------------------------------------------
+void jarray_reserve( jarray_t a, size_t cap )
+{
+    _jarray_reserve(a.json, _jarray_get_array(a), cap);
+}
+
+//------------------------------------------------------------------------------
+JINLINE jval_t* _jarray_get_val( const json_t* jsn, _jarray_t* a, size_t idx)
+{
+    assert(a);
+    assert(idx < a->len);
+    return &_jarray_vals(jsn, a)[idx];
+}
+
+//------------------------------------------------------------------------------
+JINLINE jval_t* _jarray_add_val( json_t* jsn, _jarray_t* a)
+{
+    assert(a);
+    _jarray_reserve(jsn, a, 1);
+    jval_t* val = _jarray_get_val(jsn, a, a->len++);
+    *val = (jval_t)
+    {
+        .type = 0,
+        .idx = 0
+    };
+    return val;
+}
+
+//------------------------------------------------------------------------------
+jval_t jarray_get(jarray_t a, size_t idx)
+{
+    _jarray_t* array = _jarray_get_array(a);
+    if (_jarray_is_run(array))
+    {
+        assert(idx < array->len);
+        return (jval_t){_jarray_run_type(array), _jarray_run_first(array) + (jidx_t)idx};
+    }
+
+    jval_t* val = _jarray_get_val(a.json, array, idx);
+    assert(val);
+    return *val;
+}
+
+//------------------------------------------------------------------------------
+jbool_t jarray_get_num_span( jarray_t a, const jnum_t** ptr, size_t* len )
+{
+    assert(ptr);
+    assert(len);
+
+    _jarray_t* array = _jarray_get_array(a);
+    *ptr = NULL;
+    *len = array->len;
+    if (array->len == 0) return JTRUE;
+    if (!_jarray_is_run(array) || _jarray_run_type(array) != JTYPE_NUM) return JFALSE;
+
+    // numbers that were never read are converted now
+    const json_t* jsn = a.json;
+    const size_t first = _jarray_run_first(array);
+    if (jsn->nums.lex)
+    {
+        for ( size_t i = 0; i < array->len; i++ ) _json_get_num(jsn, first + i);
+    }
+    *ptr = jsn->nums.ptr + first;
+    return JTRUE;
+}
+
+//------------------------------------------------------------------------------
+jbool_t jarray_get_int_span( jarray_t a, const jint_t** ptr, size_t* len )
+{
+    assert(ptr);
+    assert(len);
+
+    _jarray_t* array = _jarray_get_array(a);
+    *ptr = NULL;
+    *len = array->len;
+    if (array->len == 0) return JTRUE;
+    if (!_jarray_is_run(array) || _jarray_run_type(array) != JTYPE_INT) return JFALSE;
+
+    const json_t* jsn = a.json;
+    const size_t first = _jarray_run_first(array);
+    if (jsn->ints.lex)
+    {
+        for ( size_t i = 0; i < array->len; i++ ) _json_get_int(jsn, first + i);
+    }
+    *ptr = jsn->ints.ptr + first;
+    return JTRUE;
+}
+
+//------------------------------------------------------------------------------
+void jarray_add_num( jarray_t _a, jnum_t num )
+{
+    size_t idx = json_add_num(_a.json, num);
+
+    _jarray_t* a = _jarray_get_array(_a);
+    jval_t* val = _jarray_add_val(_a.json, a);
+    val->type = JTYPE_NUM;
+
+    assert (idx < MAX_VAL_IDX);
+    val->idx = (jidx_t)idx;
+}
+
+//------------------------------------------------------------------------------
+void jarray_add_int( jarray_t _a, jint_t num )
+{
+    size_t idx = json_add_int(_a.json, num);
+
+    _jarray_t* a = _jarray_get_array(_a);
+    jval_t* val = _jarray_add_val(_a.json, a);
+
+    if (MIN_JSHORT <= num && num <= MAX_JSHORT)
+    {
+        val->type = JTYPE_SHORT;
+        val->idx = jint_to_short(num);
+    }
+    else
+    {
+        val->type = JTYPE_INT;
+        assert (idx < MAX_VAL_IDX);
+        val->idx = (jidx_t)idx;
+    }
+}
+
+//------------------------------------------------------------------------------
+void jarray_add_strl( jarray_t _a, const char* str, size_t slen )
+{
+    assert(str);
+    size_t idx = json_add_val_strl(_a.json, str, slen);
+
+    _jarray_t* a = _jarray_get_array(_a);
+    jval_t* val = _jarray_add_val(_a.json, a);
+    val->type = JTYPE_STR;
+
+    assert (idx < MAX_VAL_IDX);
+    val->idx = (jidx_t)idx;
+}
+
+//------------------------------------------------------------------------------
+void jarray_add_bool( jarray_t _a, jbool_t b )
+{
+    _jarray_t* a = _jarray_get_array(_a);
+    jval_t* val = _jarray_add_val(_a.json, a);
+    val->type = JTYPE_BOOL;
+    val->idx = b;
+}
+
+//------------------------------------------------------------------------------
+void jarray_add_nil( jarray_t _a )
+{
+    _jarray_t* a = _jarray_get_array(_a);
+    jval_t* val = _jarray_add_val(_a.json, a);
+    val->type = JTYPE_NIL;
+    val->idx = 0;
+}
+
+//------------------------------------------------------------------------------
+/// appends n values that sit back to back in one pool, starting at first. An
+/// empty array becomes a run over them, and a run that ends where they start
+/// is extended, so neither needs any vals at all.
+JINLINE void _jarray_add_pooled( json_t* jsn, _jarray_t* a, jidx_t type, size_t first, size_t n )
+{
+    assert(a->len + n <= MAX_CONTAINER_LEN);
+    assert(first + n <= MAX_VAL_IDX);
+
+    if (a->len == 0)
+    {
+        jchildren_free(jsn, a->off, _jarray_units(a->cap));
+        a->cap = 0;
+        a->len = (jsize_t)n;
+        a->off = _jarray_run_off(first, type);
+        return;
+    }
+
+    if (_jarray_is_run(a) && _jarray_run_type(a) == type && _jarray_run_first(a) + a->len == first)
+    {
+        a->len += (jsize_t)n;
+        return;
+    }
+
+    _jarray_reserve(jsn, a, n);
+    jval_t* vals = _jarray_vals(jsn, a) + a->len;
+    for ( size_t i = 0; i < n; i++ )
+    {
+        vals[i] = (jval_t){type, (jidx_t)(first + i)};
+    }
+    a->len += (jsize_t)n;
+}
+
+//------------------------------------------------------------------------------
+void jarray_add_nums( jarray_t _a, const jnum_t* nums, size_t n )
+{
+    assert(nums || n == 0);
+    if (n == 0) return;
+
+    // the numbers may be a span of this doc
+    json_t* jsn = _a.json;
+    const size_t from = jpool_find(jsn->nums.ptr, jsn->nums.len, sizeof(jnum_t), nums);
+    json_nums_reserve(jsn, n);
+    if (from != SIZE_MAX) nums = jsn->nums.ptr + from;
+
+    const size_t first = jsn->nums.len;
+    memcpy(jsn->nums.ptr + first, nums, n * sizeof(jnum_t));
+    if (jsn->nums.lex) memset(jsn->nums.lex + first, 0, n * sizeof(jlex_t));
+    jsn->nums.len += n;
+
+    _jarray_add_pooled(jsn, _jarray_get_array(_a), JTYPE_NUM, first, n);
+}
+
+//------------------------------------------------------------------------------
+void jarray_add_ints( jarray_t _a, const jint_t* nums, size_t n )
+{
+    assert(nums || n == 0);
+    if (n == 0) return;
+
+    // only the values too big to be shorts go in the pool
+    size_t big = 0;
+    for ( size_t i = 0; i < n; i++ )
+    {
+        big += (nums[i] < MIN_JSHORT || nums[i] > MAX_JSHORT);
+    }
+
+    // the numbers may be a span of this doc
+    json_t* jsn = _a.json;
+    const size_t from = jpool_find(jsn->ints.ptr, jsn->ints.len, sizeof(jint_t), nums);
+    json_ints_reserve(jsn, big);
+    if (from != SIZE_MAX) nums = jsn->ints.ptr + from;
+    _jarray_t* a = _jarray_get_array(_a);
+
+    if (big == n)
+    {
+        const size_t first = jsn->ints.len;
+        memcpy(jsn->ints.ptr + first, nums, n * sizeof(jint_t));
+        if (jsn->ints.lex) memset(jsn->ints.lex + first, 0, n * sizeof(jlex_t));
+        jsn->ints.len += n;
+
+        _jarray_add_pooled(jsn, a, JTYPE_INT, first, n);
+        return;
+    }
+
+    _jarray_reserve(jsn, a, n);
+    jval_t* vals = _jarray_vals(jsn, a) + a->len;
+    for ( size_t i = 0; i < n; i++ )
+    {
+        const jint_t num = nums[i];
+        if (MIN_JSHORT <= num && num <= MAX_JSHORT)
+        {
+            vals[i] = (jval_t){JTYPE_SHORT, (jidx_t)jint_to_short(num)};
+            continue;
+        }
+
+        const size_t idx = jsn->ints.len++;
+        jsn->ints.ptr[idx] = num;
+        if (jsn->ints.lex) jsn->ints.lex[idx] = (jlex_t){0, 0};
+
+        assert (idx < MAX_VAL_IDX);
+        vals[i] = (jval_t){JTYPE_INT, (jidx_t)idx};
+    }
+    a->len += (jsize_t)n;
+}
+
+//------------------------------------------------------------------------------
+void jarray_add_strs( jarray_t _a, const char* const* strs, const size_t* lens, size_t n )
+{
+    assert(strs || n == 0);
+    if (n == 0) return;
+
+    json_t* jsn = _a.json;
+    _jarray_t* a = _jarray_get_array(_a);
+    _jarray_reserve(jsn, a, n);
+
+    // interning only touches the string map, so the vals stay put
+    jval_t* vals = _jarray_vals(jsn, a) + a->len;
+    size_t idx = 0;
+    size_t prev_len = 0;
+    for ( size_t i = 0; i < n; i++ )
+    {
+        const char* str = strs[i];
+        assert(str);
+        const size_t slen = lens ? lens[i] : strlen(str);
+
+        // a repeat of the string before it reuses its id without hashing
+        if (i == 0 || slen != prev_len || memcmp(str, strs[i-1], slen) != 0)
+        {
+            idx = json_add_val_strl(jsn, str, slen);
+            assert (idx < MAX_VAL_IDX);
+        }
+        prev_len = slen;
+        vals[i] = (jval_t){JTYPE_STR, (jidx_t)idx};
+    }
+    a->len += (jsize_t)n;
+}
+
+//------------------------------------------------------------------------------
+jarray_t jarray_add_array( jarray_t _a )
+{
+    size_t idx = json_add_array(_a.json);
+
+    _jarray_t* a = _jarray_get_array(_a);
+    jval_t* val = _jarray_add_val(_a.json, a);
+    val->type = JTYPE_ARRAY;
+
+    assert (idx < MAX_VAL_IDX);
+    val->idx = (jidx_t)idx;
+
+    return (jarray_t){ _a.json, idx };
+}
+
+//------------------------------------------------------------------------------
+jobj_t jarray_add_obj( jarray_t _a )
+{
+    size_t idx = json_add_obj(_a.json);
+
+    _jarray_t* a = _jarray_get_array(_a);
+    jval_t* val = _jarray_add_val(_a.json, a);
+    val->type = JTYPE_OBJ;
+
+    assert (idx < MAX_VAL_IDX);
+    val->idx = (jidx_t)idx;
+
+    return (jobj_t){ _a.json, idx };
+}
+
+//------------------------------------------------------------------------------
+void jarray_set( jarray_t _a, size_t idx, jval_t val )
+{
+    _jarray_t* a = _jarray_get_array(_a);
+    assert(idx < a->len);
+
+    // a run of numbers gets its own values first, the replaced value is left
+    // for json_gc
+    _jarray_reserve(_a.json, a, 0);
+    val.type &= JTYPE_MASK;
+    *_jarray_get_val(_a.json, a, idx) = val;
+}
+
+//------------------------------------------------------------------------------
+void jarray_insert( jarray_t _a, size_t idx, jval_t val )
+{
+    _jarray_t* a = _jarray_get_array(_a);
+    assert(idx <= a->len);
+
+    _jarray_reserve(_a.json, a, 1);
+    jval_t* vals = _jarray_vals(_a.json, a);
+    memmove(vals + idx + 1, vals + idx, (a->len - idx) * sizeof(jval_t));
+    val.type &= JTYPE_MASK;
+    vals[idx] = val;
+    a->len++;
+}
+
+//------------------------------------------------------------------------------
+void jarray_remove( jarray_t _a, size_t idx )
+{
+    _jarray_t* a = _jarray_get_array(_a);
+    assert(idx < a->len);
+
+    _jarray_reserve(_a.json, a, 0);
+    jval_t* vals = _jarray_vals(_a.json, a);
+    memmove(vals + idx, vals + idx + 1, (a->len - idx - 1) * sizeof(jval_t));
+    a->len--;
+}
+
+//------------------------------------------------------------------------------
+JINLINE void _jarray_print( jprint_t* ctx, jarray_t array, size_t depth )
+{
+    jprint_char(ctx, '[');
+    jprint_newline(ctx);
+    const json_t* jsn = jarray_get_json(array);
+    size_t len = jarray_len(array);
+    for ( size_t i = 0; i < len; i++ )
+    {
+        jprint_tabs(ctx, depth+1);
+        _jval_print(ctx, jsn, jarray_get(array, i), depth+1);
+        if (i+1 != len) jprint_char(ctx, ',');
+        jprint_newline(ctx);
+    }
+    jprint_tabs(ctx, depth);
+    jprint_char(ctx, ']');
+}
+
+#pragma mark - jbuf_t
+
+//------------------------------------------------------------------------------
+JINLINE void jbuf_init(jbuf_t* buf)
+{
+    assert(buf);
+    buf->cap = 0;
+    buf->len = 0;
+    buf->ptr = NULL;
+}
+
+//------------------------------------------------------------------------------
+JINLINE void jbuf_destroy(jbuf_t* buf)
+{
+    assert(buf);
+    jfree(buf->ptr);
+    jbuf_init(buf);
+}
+
+//------------------------------------------------------------------------------
+JINLINE void jbuf_clear( jbuf_t* buf )
+{
+    assert(buf);
+    if (buf->ptr && buf->cap > 0) buf->ptr[0] = '\0';
+    buf->len = 0;
+}
+
+//------------------------------------------------------------------------------
+JINLINE void jbuf_reserve( jbuf_t* buf, size_t cap )
+{
+    assert(buf);
+    if (buf->len+cap <= buf->cap)
+        return;
+
+    size_t new_cap = grow(buf->len+cap, buf->cap);
+    char* ptr = (char*)jrealloc(buf->ptr, new_cap * sizeof(char));
+    if (ptr)
+    {
+        buf->cap = new_cap;
+        buf->ptr = ptr;
+    }
+    assert (buf->ptr);
+}
+
+
+//------------------------------------------------------------------------------
+JINLINE size_t jbuf_write( jbuf_t* buf, const void* ptr, size_t n )
+{
+    jbuf_reserve(buf, n);
+    memcpy(buf->ptr+buf->len, ptr, n);
+    buf->len += n;
+    return n;
+}
+
+//------------------------------------------------------------------------------
+JINLINE void jbuf_add( jbuf_t* buf, char ch )
+{
+    assert(buf);
+    jbuf_reserve(buf, 1);
+    buf->ptr[buf->len++] = ch;
+}
+
+//------------------------------------------------------------------------------
+JINLINE void jbuf_end_str( jbuf_t* buf )
+{
+    assert(buf);
+    jbuf_reserve(buf, 1);
+    buf->ptr[buf->len] = '\0';
+}
+
+//------------------------------------------------------------------------------
+JINLINE int jbuf_add_unicode(jbuf_t* str, int32_t codepoint )
+{
+//    if (codepoint == 0)
+//    {
+//        return EXIT_FAILURE;
+//    }
+//    else
+    if(codepoint < 0x80)
+    {
+        jbuf_add(str, (char)codepoint);
+    }
+    else if(codepoint < 0x800)
+    {
+        jbuf_add(str, 0xC0 + ((codepoint & 0x7C0) >> 6));
+        jbuf_add(str, 0x80 + ((codepoint & 0x03F)));
+    }
+    else if(codepoint < 0x10000)
+    {
+        jbuf_add(str, 0xE0 + ((codepoint & 0xF000) >> 12));
+        jbuf_add(str, 0x80 + ((codepoint & 0x0FC0) >> 6));
+        jbuf_add(str, 0x80 + ((codepoint & 0x003F)));
+    }
+    else if(codepoint <= 0x10FFFF)
+    {
+        jbuf_add(str, 0xF0 + ((codepoint & 0x1C0000) >> 18));
+        jbuf_add(str, 0x80 + ((codepoint & 0x03F000) >> 12));
+        jbuf_add(str, 0x80 + ((codepoint & 0x000FC0) >> 6));
+        jbuf_add(str, 0x80 + ((codepoint & 0x00003F)));
+    }
+    else
+    {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+#pragma mark - json_t
+
+//------------------------------------------------------------------------------
+json_t* json_init( json_t* jsn )
+{
+    if (!jsn) return NULL;
+
+    jmap_init(&jsn->strmap);
+
+    // nums
+    jsn->nums.cap = 0;
+    jsn->nums.len = 0;
+    jsn->nums.ptr = NULL;
+    jsn->nums.lex = NULL;
+
+    // ints
+    jsn->ints.cap = 0;
+    jsn->ints.len = 0;
+    jsn->ints.ptr = NULL;
+    jsn->ints.lex = NULL;
+
+    // number lexemes
+    jsn->lexs.cap = 0;
+    jsn->lexs.len = 0;
+    jsn->lexs.ptr = NULL;
+
+    // arrays
+    jsn->arrays.cap = 0;
+    jsn->arrays.len = 0;
+    jsn->arrays.ptr = NULL;
+
+    // objs
+    jsn->objs.cap = 0;
+    jsn->objs.len = 0;
+    jsn->objs.ptr = NULL;
 
-        case JTYPE_OBJ:
-        {
-            jobj_t o1 = json_get_obj((json_t*)j1, v1);
-            jobj_t o2 = json_get_obj((json_t*)j2, v2);
+    // keys and values of objects and arrays
+    jsn->children.cap = 0;
+    jsn->children.len = 0;
+    jsn->children.ptr = NULL;
+    jsn->children.garbage = 0;
 
-            size_t len1 = jobj_len(o1);
-            size_t len2 = jobj_len(o2);
+    // shapes
+    jsn->shapes.cap = 0;
+    jsn->shapes.len = 0;
+    jsn->shapes.ptr = NULL;
+    jsn->shapes.slots = NULL;
+    jsn->shapes.mask = 0;
 
-            if (len1 < len2) return -1;
-            if (len1 > len2) return 1;
+    // string interning
+    jsn->intern.count = 0;
+    jsn->intern.hits = 0;
+    jsn->intern.off = 0;
 
-            for ( size_t i = 0; i < len1; i++ )
-            {
-                jval_t v31 = jobj_get_val(o1, i);
-                jval_t v32 = jobj_get_val(o2, i);
-                int c = _json_compare_val(j1, v31, j2, v32);
-                if (c != 0) return c;
-            }
-            return 0;
-        }
+    jsn->root = (jval_t){JTYPE_NIL, 0};
+    jsn->flags = 0;
+    jsn->reclaimed = 0;
 
-        default:
-            return 0;
-    }
+    return jsn;
 }
 
 //------------------------------------------------------------------------------
-int json_compare( const json_t* j1, const json_t* j2 )
+json_t* json_init_flags( json_t* jsn, int flags )
 {
-    if (j1 == j2) return 0;
-    return _json_compare_val(j1, json_root(j1), j2, json_root(j2));
+    if (!json_init(jsn)) return NULL;
+    jsn->flags = flags;
+    jsn->strmap.incremental = (flags & JFLAG_INCREMENTAL_REHASH) != 0;
+    return jsn;
 }
 
 //------------------------------------------------------------------------------
-int json_compare_val( const json_t* jsn, jval_t v1, jval_t v2 )
+json_t* json_init_dict( json_t* jsn, const jdict_t* dict, int flags )
 {
-    return _json_compare_val(jsn, v1, jsn, v2);
+    if (!json_init_flags(jsn, flags)) return NULL;
+    if (dict)
+    {
+        assert(dict->frozen);
+        jmap_set_dict(&jsn->strmap, &dict->map);
+    }
+    return jsn;
 }
 
-#pragma mark - jobj_t
-
 //------------------------------------------------------------------------------
-JINLINE _jobj_t* jobj_get_obj(jobj_t obj)
+json_t* json_init_cmap( json_t* jsn, jcmap_t* map, int flags )
 {
-    const json_t* jsn = jobj_get_json(obj);
-    assert(jsn);
-    assert(obj.idx < jsn->objs.len);
-    return _json_get_obj(jsn, obj.idx);
+    if (!json_init_flags(jsn, flags)) return NULL;
+    if (map) jmap_set_shared(&jsn->strmap, map, map->seed);
+    return jsn;
 }
 
 //------------------------------------------------------------------------------
-size_t jobj_len( jobj_t obj )
+void json_clear( json_t* jsn )
 {
-    _jobj_t* _obj = jobj_get_obj(obj);
-    assert(_obj);
-    return _obj->len;
+    int flags = jsn->flags;
+    const jmap_t* dict = jsn->strmap.dict;
+    jcmap_t* shared = jsn->strmap.shared;
+    json_destroy(jsn);
+    json_init_flags(jsn, flags);
+    jmap_set_dict(&jsn->strmap, dict);
+    if (shared) jmap_set_shared(&jsn->strmap, shared, shared->seed);
 }
 
 //------------------------------------------------------------------------------
-jbool_t jobj_contains_key( jobj_t obj, const char* key )
+JINLINE size_t _json_write_file(void* file, const void* ptr, size_t n)
 {
-    size_t outlen;
-    const char* str = jobj_find_strl(obj, key, &outlen);
-    return (str) ? JTRUE : JFALSE;
+#if J_USE_POSIX
+    const char* cptr = (const char*)ptr;
+    for ( size_t i = 0; i < n; i++ )
+    {
+        int ch = cptr[i];
+        if (putc_unlocked(ch, (FILE*)file) == EOF)
+        {
+            return i;
+        }
+    }
+    return n;
+#else
+    return n * fwrite(ptr, n, 1, (FILE*)file);
+#endif
 }
 
 //------------------------------------------------------------------------------
-const char* jobj_get(jobj_t obj, size_t idx, jval_t* val, size_t* klen)
+JINLINE size_t _json_write_buf(void* buf, const void* ptr, size_t n)
 {
-    assert(val);
-    assert(klen);
-
-    _jobj_t* _obj = jobj_get_obj(obj);
-    const json_t* jsn = jobj_get_json(obj);
-
-    jkv_t* kvs = (_obj->cap > BUF_SIZE) ? _obj->kvs.ptr : _obj->kvs.buf;
+    return jbuf_write((jbuf_t*)buf, ptr, n);
+}
 
-    *val = kvs[idx].val;
-    if (kvs[idx].val.type & ~JTYPE_MASK)
-    {
-        *klen = strlen(kvs[idx].key.kstr);
-        return kvs[idx].key.kstr;
-    }
+//------------------------------------------------------------------------------
+void jval_print(const json_t* jsn, jval_t val, int flags, print_func p, void* udata)
+{
+    assert(jsn);
+    jprint_t ctx;
+    jprint_init_flags(&ctx, flags, p, udata);
 
-    jstr_t* jstr = jmap_get_str(&jsn->strmap, kvs[idx].key.kidx);
-    assert(jstr);
-    *klen = jstr->len;
-    return jstr_get_cstr(jstr);
+    _jval_print(&ctx, jsn, val, 0);
 }
 
 //------------------------------------------------------------------------------
-JINLINE void jobj_truncate( jobj_t o )
+void jarray_print(jarray_t array, int flags, print_func p, void* udata)
 {
-    _jobj_t* obj = jobj_get_obj(o);
-    assert(obj);
-
-    if (obj->len == obj->cap)
-        return;
+    jprint_t ctx;
+    jprint_init_flags(&ctx, flags, p, udata);
 
-    if (obj->cap <= BUF_SIZE)
-        return;
+    _jarray_print(&ctx, array, 0);
+}
 
-    if (obj->len <= BUF_SIZE && obj->cap > BUF_SIZE)
-    {
-        jkv_t* kvs = obj->kvs.ptr;
-        memcpy(obj->kvs.buf, kvs, sizeof(jkv_t)*obj->len);
-        jfree(kvs);
-        obj->cap = obj->len;
-        return;
-    }
+//------------------------------------------------------------------------------
+void jobj_print(jobj_t obj, int flags, print_func p, void* udata)
+{
+    jprint_t ctx;
+    jprint_init_flags(&ctx, flags, p, udata);
 
-    size_t cap = obj->len;
-    jkv_t* ptr = (jkv_t*)jrealloc(obj->kvs.ptr, cap * sizeof(jkv_t));
-    if (ptr)
-    {
-        obj->kvs.ptr = ptr;
-        obj->cap = (jsize_t)cap;
-    }
+    _jobj_print(&ctx, obj, 0);
 }
 
 //------------------------------------------------------------------------------
-JINLINE void _jobj_reserve( _jobj_t* obj, size_t cap )
+size_t json_print(const json_t* jsn, int flags, print_func p, void* udata)
 {
-    assert(obj);
-    if ( obj->len+cap <= obj->cap)
-        return;
-
-    size_t prev_cap = obj->cap;
-    jsize_t new_cap = (jsize_t)grow(obj->len+cap, obj->cap);
+    assert(jsn);
+    jprint_t ctx;
+    jprint_init_flags(&ctx, flags, p, udata);
 
-    if (prev_cap <= BUF_SIZE)
+    if (setjmp(ctx.jerr_jmp) == 0)
     {
-        jkv_t* kvs = (jkv_t*)jmalloc( new_cap * sizeof(jkv_t) );
-        if (kvs)
+        // special case if we don't have any root
+        jval_t root = json_root(jsn);
+        if (!jval_is_nil(root))
+        {
+            _jval_print(&ctx, jsn, root, 0);
+        }
+        else
         {
-            memcpy(kvs, obj->kvs.buf, sizeof(jkv_t) * obj->len);
-            obj->kvs.ptr = kvs;
-            obj->cap = new_cap;
+            jprint_char(&ctx, '{');
+            jprint_newline(&ctx);
+            jprint_char(&ctx, '}');
         }
+        return ctx.nbytes;
     }
     else
     {
-        assert(obj->kvs.ptr);
-        jkv_t* ptr = (jkv_t*)jrealloc(obj->kvs.ptr, sizeof(jkv_t)*new_cap);
-        if (ptr)
-        {
-            obj->kvs.ptr = ptr;
-            obj->cap = new_cap;
-        }
+        return 0;
     }
 }
 
 //------------------------------------------------------------------------------
-void jobj_reserve( jobj_t obj, size_t cap )
+char* json_to_strl(const json_t* jsn, int flags, size_t* plen)
 {
-    _jobj_reserve(jobj_get_obj(obj), cap);
+    assert(jsn);
+
+    jbuf_t buf;
+    jbuf_init(&buf);
+
+    if (json_print(jsn, flags, _json_write_buf, &buf) == 0)
+    {
+        jbuf_destroy(&buf);
+        return NULL;
+    }
+    size_t len = buf.len;
+    jbuf_end_str(&buf);
+    if (plen) *plen = len;
+    return buf.ptr;
 }
 
 //------------------------------------------------------------------------------
-JINLINE jkv_t* _jobj_get_kv(_jobj_t* obj, size_t idx)
+size_t json_print_path(const json_t* jsn, int flags, const char* path)
 {
-    assert(obj);
-    assert(idx < obj->len);
-    return (obj->cap > BUF_SIZE) ? &obj->kvs.ptr[idx] : &obj->kvs.buf[idx];
+    assert(jsn);
+    assert(path);
+    FILE* file = fopen(path, "w");
+    if (!file)
+    {
+        // TODO: error
+        return 0;
+    }
+    size_t rt = json_print_file(jsn, flags, file);
+    fclose(file);
+    return rt;
 }
 
 //------------------------------------------------------------------------------
-JINLINE jval_t* _jobj_get_val(_jobj_t* obj, size_t idx)
+size_t json_print_file(const json_t* jsn, int flags, FILE* f)
 {
-    return (idx < obj->len) ? &_jobj_get_kv(obj, idx)->val : NULL;
-}
+    assert(jsn);
+    assert(f);
 
-//------------------------------------------------------------------------------
-#define jobj_add_key(OBJ, KEY) jobj_add_keyl(OBJ, KEY, strlen(KEY))
+    size_t rt;
+#if J_USE_POSIX
+    flockfile(f);
+    rt = json_print(jsn, flags, _json_write_file, f);
+    funlockfile(f);
+#else
+    rt = json_print(jsn, flags, _json_write_file, f);
+#endif
+
+    fflush(f);
+    return rt;
+}
 
 //------------------------------------------------------------------------------
-JINLINE size_t jobj_add_keyl( jobj_t o, const char* key, size_t klen )
+void json_destroy(json_t* jsn)
 {
-    json_t* jsn = jobj_get_json(o);
-    _jobj_t* obj = jobj_get_obj(o);
+    assert(jsn);
 
-    assert(obj);
-    assert(key);
+    // cleanup string map
+    jmap_destroy(&jsn->strmap);
 
-    size_t idx = obj->len++;
+    // cleanup numbers
+    jfree(jsn->nums.ptr); jsn->nums.ptr = NULL;
+    jfree(jsn->nums.lex); jsn->nums.lex = NULL;
 
-    _jobj_reserve(obj, 1);
-    jkv_t* kv = _jobj_get_kv(obj, idx);
-    kv->val.type = JTYPE_NIL;
-    kv->val.idx = 0;
+    // cleanup integers
+    jfree(jsn->ints.ptr); jsn->ints.ptr = NULL;
+    jfree(jsn->ints.lex); jsn->ints.lex = NULL;
 
-    static const size_t kstrlen = sizeof(kv->key.kstr);
+    // cleanup number lexemes
+    jfree(jsn->lexs.ptr); jsn->lexs.ptr = NULL;
+    jsn->lexs.len = jsn->lexs.cap = 0;
 
-    if (klen < kstrlen)
-    {
-        assert ( sizeof(kv->key.kidx) == kstrlen );
-        kv->key.kidx = 0; // zero-out
-        memcpy(kv->key.kstr, key, klen);
-        kv->val.type |= ~JTYPE_MASK;
-    }
-    else
+    // cleanup objects, big ones own their index
+    for ( size_t i = 0; i < jsn->objs.len; i++ )
     {
-        size_t kidx = json_add_strl(jsn, key, klen);
-        assert (kidx < MAX_KEY_IDX);
-        kv->key.kidx = (uint32_t)kidx;
+        jobj_index_free(jsn, _json_get_obj(jsn, i));
     }
-    return idx;
-}
-
-//------------------------------------------------------------------------------
-#define jobj_add_kval(OBJ,KEY,VAL) jkv_set_val(OBJ, jobj_add_key(OBJ, KEY), VAL)
+    jfree(jsn->objs.ptr); jsn->objs.ptr = NULL;
+    jsn->objs.len = jsn->objs.cap = 0;
 
-//------------------------------------------------------------------------------
-JINLINE void jkv_set_val(jobj_t o, size_t idx, jval_t val )
-{
-    _jobj_t* obj = jobj_get_obj(o);
-    jkv_t* kv = _jobj_get_kv(obj, idx);
-    assert(kv);
-    kv->val.type = (kv->val.type & ~JTYPE_MASK) | (val.type & JTYPE_MASK);
-    kv->val.idx = val.idx;
-}
+    // cleanup shapes
+    jshapes_clear(jsn);
+    jfree(jsn->shapes.ptr); jsn->shapes.ptr = NULL;
+    jfree(jsn->shapes.slots); jsn->shapes.slots = NULL;
+    jsn->shapes.cap = jsn->shapes.mask = 0;
 
-//------------------------------------------------------------------------------
-JINLINE void jobj_add_kv(jobj_t obj, const char* key, uint32_t type, size_t idx)
-{
-    assert(idx < MAX_VAL_IDX /* 2^28 */);
-    assert((type & ~JTYPE_MASK) == 0);
-    jobj_add_kval(obj, key, ((jval_t){type, (uint32_t)idx}));
-}
+    // cleanup arrays
+    jfree(jsn->arrays.ptr); jsn->arrays.ptr = NULL;
+    jsn->arrays.len = jsn->arrays.cap = 0;
 
-//------------------------------------------------------------------------------
-void jobj_add_num( jobj_t obj, const char* key, jnum_t num )
-{
-    assert(key);
-    size_t idx = json_add_num(jobj_get_json(obj), num);
-    jobj_add_kv(obj, key, JTYPE_NUM, idx);
+    // cleanup children
+    jfree(jsn->children.ptr); jsn->children.ptr = NULL;
+    jsn->children.len = jsn->children.cap = jsn->children.garbage = 0;
 }
 
 //------------------------------------------------------------------------------
-void jobj_add_int( jobj_t obj, const char* key, jint_t num )
+void json_reset(json_t* jsn)
 {
-    assert(key);
+    assert(jsn);
 
-    if (MIN_JSHORT <= num && num <= MAX_JSHORT)
-    {
-        jobj_add_kv(obj, key, JTYPE_SHORT, jint_to_short(num));
-    }
-    else
+    // the children pool is kept, only the indexes of big objects are freed
+    for ( size_t i = 0; i < jsn->objs.len; i++ )
     {
-        size_t idx = json_add_int(jobj_get_json(obj), num);
-        jobj_add_kv(obj, key, JTYPE_INT, idx);
+        jobj_index_free(jsn, _json_get_obj(jsn, i));
     }
-}
+    jsn->objs.len = 0;
+    jshapes_clear(jsn);
 
-//------------------------------------------------------------------------------
-void jobj_add_strl( jobj_t obj, const char* key, const char* str, size_t slen )
-{
-    assert(key);
-    assert(str);
+    jsn->arrays.len = 0;
+    jsn->children.len = 0;
+    jsn->children.garbage = 0;
+
+    jsn->nums.len = 0;
+    jsn->ints.len = 0;
+    jsn->lexs.len = 0;
 
-    // TODO: validate the string as a valid UTF8 sequence!
+    jmap_reset(&jsn->strmap);
 
-    size_t idx = json_add_strl(jobj_get_json(obj), str, slen);
-    jobj_add_kv(obj, key, JTYPE_STR, idx);
+    jsn->intern.count = 0;
+    jsn->intern.hits = 0;
+    jsn->intern.off = 0;
+
+    jsn->root = (jval_t){JTYPE_NIL, 0};
+    jsn->reclaimed = 0;
 }
 
 //------------------------------------------------------------------------------
-void jobj_add_bool( jobj_t obj, const char* key, jbool_t b )
+void json_free(json_t* jsn)
 {
-    assert(key);
-    jobj_add_kv(obj, key, JTYPE_BOOL, b);
+    json_destroy(jsn);
+    jfree(jsn);
 }
 
+#pragma mark - json_gc
+
+#define JGC_DEAD ((jidx_t)-1)
+
 //------------------------------------------------------------------------------
-void jobj_add_nil( jobj_t obj, const char* key )
+/// maps the old index of every entry of each pool to its new one, or to
+/// JGC_DEAD. While marking, anything else just means reachable.
+struct jgc_t
 {
-    assert(key);
-    jobj_add_kv(obj, key, JTYPE_NIL, 0);
-}
+    jidx_t* nums;
+    jidx_t* ints;
+    jidx_t* objs;
+    jidx_t* arrays;
+    jidx_t* strs; // the doc's own strings, the dictionary is never collected
+    size_t base;
+    jbuf_t stack; // containers marked but not visited yet
+};
+typedef struct jgc_t jgc_t;
 
 //------------------------------------------------------------------------------
-jarray_t jobj_add_array( jobj_t obj, const char* key )
+JINLINE jidx_t* jgc_new_map( size_t len )
 {
-    assert(key);
-    json_t* jsn = jobj_get_json(obj);
-    size_t idx = json_add_array(jsn);
-    jobj_add_kv(obj, key, JTYPE_ARRAY, idx);
-    return (jarray_t){ jsn, idx };
+    jidx_t* map = (jidx_t*)jmalloc((len + 1) * sizeof(jidx_t));
+    memset(map, 0xFF, (len + 1) * sizeof(jidx_t));
+    return map;
 }
 
 //------------------------------------------------------------------------------
-jobj_t jobj_add_obj( jobj_t obj, const char* key )
+/// numbers the marked entries in their current order, returns how many there
+/// are. Keeping the order keeps number runs contiguous.
+JINLINE size_t jgc_number( jidx_t* map, size_t len )
 {
-    assert(key);
-    json_t* jsn = jobj_get_json(obj);
-    size_t idx = json_add_obj(jsn);
-    jobj_add_kv(obj, key, JTYPE_OBJ, idx);
-    return (jobj_t){ jsn, idx };
+    size_t n = 0;
+    for ( size_t i = 0; i < len; i++ )
+    {
+        if (map[i] != JGC_DEAD) map[i] = (jidx_t)n++;
+    }
+    return n;
 }
 
 //------------------------------------------------------------------------------
-jval_t jobj_get_val(jobj_t obj, size_t idx)
+JINLINE void jgc_mark_str( jgc_t* gc, size_t idx )
 {
-    jval_t* val = _jobj_get_val(jobj_get_obj(obj), idx);
-    return val ? *val : JNULL_VAL;
+    if (idx >= gc->base) gc->strs[idx - gc->base] = 0;
 }
 
 //------------------------------------------------------------------------------
-JINLINE size_t jobj_find_shortstr( jobj_t obj, const char* key, size_t klen )
+JINLINE void jgc_mark( jgc_t* gc, jval_t val )
 {
-    assert (klen < 4);
-
-    _jobj_t* _obj = jobj_get_obj(obj);
-    jkv_t* kvs = (_obj->cap > BUF_SIZE) ? _obj->kvs.ptr : _obj->kvs.buf;
-    for ( size_t i = 0; i < _obj->len; i++ )
+    switch (jval_type(val))
     {
-        jkv_t* kv = &kvs[i];
-        if ( (kv->val.type & ~JTYPE_MASK) == 0 )
-            continue;
+        case JTYPE_STR: if (!jstr_is_inline(val.idx)) jgc_mark_str(gc, val.idx); break;
+        case JTYPE_NUM: gc->nums[val.idx] = 0; break;
+        case JTYPE_INT: gc->ints[val.idx] = 0; break;
 
-        if (memcmp(kv->key.kstr, key, klen) == 0)
+        case JTYPE_OBJ:
+        case JTYPE_ARRAY:
         {
-            // found it!
-            return i;
+            jidx_t* map = (jval_type(val) == JTYPE_OBJ) ? gc->objs : gc->arrays;
+            if (map[val.idx] != JGC_DEAD) break;
+            map[val.idx] = 0;
+            jbuf_write(&gc->stack, &val, sizeof(jval_t));
+            break;
         }
+
+        default:
+            break;
     }
-    return SIZE_MAX;
 }
 
 //------------------------------------------------------------------------------
-size_t jobj_findl_next_idx( jobj_t obj, size_t next, const char* key, size_t klen )
+/// marks everything reachable from the root.
+JINLINE void jgc_mark_all( json_t* jsn, jgc_t* gc )
 {
-    // check for short strings, these do not go into the hash table and must be
-    // searched manually
-    if (klen < 4) return jobj_find_shortstr(obj, key, klen);
-
-    // not a short string! Proceed with search.
-    json_t* jsn = jobj_get_json(obj);
-    _jobj_t* _obj = jobj_get_obj(obj);
-
-    // check the hashtable for our string, if it's not there it's no where!
-    size_t idx = jmap_find_str(&jsn->strmap, key, klen);
-    if (idx == SIZE_MAX)
-    {
-        return idx;
-    }
-
-    // we now know the correct index for our key, search the object to find a
-    // matching index.
-    jkv_t* kvs = (_obj->cap > BUF_SIZE) ? _obj->kvs.ptr : _obj->kvs.buf;
-    for ( size_t i = next; i < _obj->len; i++ )
+    jgc_mark(gc, jsn->root);
+    while (gc->stack.len)
     {
-        jkv_t* kv = &kvs[i];
+        gc->stack.len -= sizeof(jval_t);
+        jval_t val;
+        memcpy(&val, gc->stack.ptr + gc->stack.len, sizeof(jval_t));
 
-        // can't be a short string (we already checked), if this one is skip it.
-        if ( (kv->val.type & ~JTYPE_MASK) > 0 )
+        if (jval_type(val) == JTYPE_OBJ)
+        {
+            _jobj_t* obj = _json_get_obj(jsn, val.idx);
+            const jokey_t* keys = _jobj_keys(jsn, obj);
+            const jval_t* vals = _jobj_vals(jsn, obj);
+            for ( size_t i = 0; i < obj->len; i++ )
+            {
+                if (!jval_is_packed_key(vals[i])) jgc_mark_str(gc, keys[i].kidx);
+                jgc_mark(gc, vals[i]);
+            }
             continue;
+        }
 
-        // found a match!!!
-        if (kv->key.kidx == idx)
+        _jarray_t* a = _json_get_array(jsn, val.idx);
+        if (_jarray_is_run(a))
         {
-            return i;
+            jidx_t* map = (_jarray_run_type(a) == JTYPE_NUM) ? gc->nums : gc->ints;
+            memset(map + _jarray_run_first(a), 0, a->len * sizeof(jidx_t));
+            continue;
+        }
+        for ( size_t i = 0; i < a->len; i++ )
+        {
+            jgc_mark(gc, *_jarray_get_val(jsn, a, i));
         }
     }
-
-    return SIZE_MAX;
 }
 
 //------------------------------------------------------------------------------
-JINLINE void _jobj_print(jprint_t* ctx, jobj_t obj, size_t depth)
+JINLINE size_t jgc_move_str( const jgc_t* gc, size_t idx )
 {
-    jprint_char(ctx, '{');
-    jprint_newline(ctx);
-
-    json_t* jsn = jobj_get_json(obj);
-    size_t len = jobj_len(obj);
-    for ( size_t i = 0; i < len; i++ )
-    {
-        jval_t val;
-        size_t klen;
-        const char* key = jobj_get(obj, i, &val, &klen);
-
-        jprint_tabs(ctx, depth+1);
-        json_print_strl(ctx, key, klen);
-        jprint_char(ctx, ':');
-        jprint_space(ctx);
-        _jval_print(ctx, jsn, val, depth+1);
-        if (i+1 != len) jprint_char(ctx, ',');
-        jprint_newline(ctx);
-    }
-
-    jprint_tabs(ctx, depth);
-    jprint_char(ctx, '}');
+    return (idx < gc->base) ? idx : gc->base + gc->strs[idx - gc->base];
 }
 
-#pragma mark - jarray_t
-
 //------------------------------------------------------------------------------
-JINLINE _jarray_t* _jarray_get_array(jarray_t array)
+/// the value with its new index, any flags in the type are kept.
+JINLINE jval_t jgc_move( const jgc_t* gc, jval_t val )
 {
-    assert(array.json);
-    return _json_get_array(array.json, array.idx);
+    switch (jval_type(val))
+    {
+        case JTYPE_STR: if (!jstr_is_inline(val.idx)) val.idx = (jidx_t)jgc_move_str(gc, val.idx); break;
+        case JTYPE_NUM: val.idx = gc->nums[val.idx]; break;
+        case JTYPE_INT: val.idx = gc->ints[val.idx]; break;
+        case JTYPE_OBJ: val.idx = gc->objs[val.idx]; break;
+        case JTYPE_ARRAY: val.idx = gc->arrays[val.idx]; break;
+        default: break;
+    }
+    return val;
 }
 
 //------------------------------------------------------------------------------
-size_t jarray_len(jarray_t a)
+/// shrinks a pool to its length, or frees it when empty.
+JINLINE void* jgc_shrink( void* ptr, size_t len, size_t size )
 {
-    return _jarray_get_array(a)->len;
+    if (!ptr) return NULL;
+    if (len == 0)
+    {
+        jfree(ptr);
+        return NULL;
+    }
+    return jrealloc(ptr, len * size);
 }
 
 //------------------------------------------------------------------------------
-JINLINE void jarray_truncate( jarray_t a )
+JINLINE void jgc_compact_nums( json_t* jsn, const jgc_t* gc, char* lexs, size_t* off )
 {
-   _jarray_t* array = _jarray_get_array(a);
-    assert(array);
-
-    if (array->len == array->cap)
-        return;
-
-    if (array->cap <= BUF_SIZE)
-        return;
-
-    if (array->len <= BUF_SIZE && array->cap > BUF_SIZE)
+    for ( size_t i = 0; i < jsn->nums.len; i++ )
     {
-        jval_t* vals = array->vals.ptr;
-        memcpy(array->vals.buf, vals, sizeof(jval_t)*array->len);
-        jfree(vals);
-        array->cap = array->len;
-        return;
-    }
+        const jidx_t to = gc->nums[i];
+        if (to == JGC_DEAD) continue;
+        jsn->nums.ptr[to] = jsn->nums.ptr[i];
+        if (!jsn->nums.lex) continue;
 
-    jval_t* ptr = (jval_t*)jrealloc(array->vals.ptr, array->len * sizeof(jval_t));
-    if (ptr)
-    {
-        array->vals.ptr = ptr;
-        array->cap = array->len;
+        jlex_t lex = jsn->nums.lex[i];
+        if (jlex_len(&lex))
+        {
+            memcpy(lexs + *off, jsn->lexs.ptr + lex.off, jlex_len(&lex));
+            lex.off = (jidx_t)*off;
+            *off += jlex_len(&lex);
+        }
+        jsn->nums.lex[to] = lex;
     }
 }
 
 //------------------------------------------------------------------------------
-JINLINE void _jarray_reserve( _jarray_t* a, size_t cap )
+JINLINE void jgc_compact_ints( json_t* jsn, const jgc_t* gc, char* lexs, size_t* off )
 {
-    assert(a);
-
-    if ( a->len+cap <= a->cap )
-        return;
-
-    size_t prev_cap = a->cap;
-    jsize_t new_cap = (jsize_t)grow(a->len+cap, a->cap);
-    if (prev_cap <= BUF_SIZE)
-    {
-        jval_t* vals = (jval_t*)jmalloc( new_cap * sizeof(jval_t) );
-        if (vals)
-        {
-            memcpy(vals, a->vals.buf, a->len * sizeof(jval_t));
-            a->vals.ptr = vals;
-            a->cap = new_cap;
-        }
-    }
-    else
+    for ( size_t i = 0; i < jsn->ints.len; i++ )
     {
-        assert(a->vals.ptr);
-        jval_t* ptr = (jval_t*)jrealloc( a->vals.ptr, new_cap * sizeof(jval_t) );
-        if (ptr)
+        const jidx_t to = gc->ints[i];
+        if (to == JGC_DEAD) continue;
+        jsn->ints.ptr[to] = jsn->ints.ptr[i];
+        if (!jsn->ints.lex) continue;
+
+        jlex_t lex = jsn->ints.lex[i];
+        if (jlex_len(&lex))
         {
-            a->vals.ptr = ptr;
-            a->cap = new_cap;
+            memcpy(lexs + *off, jsn->lexs.ptr + lex.off, jlex_len(&lex));
+            lex.off = (jidx_t)*off;
+            *off += jlex_len(&lex);
         }
+        jsn->ints.lex[to] = lex;
     }
 }
 
 //------------------------------------------------------------------------------
-void jarray_reserve( jarray_t a, size_t cap )
+/// moves the numbers down over the unreachable ones, along with the text of
+/// those that still have it.
+JINLINE void jgc_compact_numbers( json_t* jsn, const jgc_t* gc, size_t nnums, size_t nints )
 {
-    _jarray_reserve(_jarray_get_array(a), cap);
-}
+    size_t total = 0;
+    for ( size_t i = 0; jsn->nums.lex && i < jsn->nums.len; i++ )
+    {
+        if (gc->nums[i] != JGC_DEAD) total += jlex_len(&jsn->nums.lex[i]);
+    }
+    for ( size_t i = 0; jsn->ints.lex && i < jsn->ints.len; i++ )
+    {
+        if (gc->ints[i] != JGC_DEAD) total += jlex_len(&jsn->ints.lex[i]);
+    }
 
-//------------------------------------------------------------------------------
-JINLINE jval_t* _jarray_get_val( _jarray_t* a, size_t idx)
-{
-    assert(a);
-    assert(idx < a->len);
-    return (a->cap > BUF_SIZE) ? &a->vals.ptr[idx] : &a->vals.buf[idx];
-}
+    char* lexs = total ? (char*)jmalloc(total) : NULL;
+    size_t off = 0;
+    jgc_compact_nums(jsn, gc, lexs, &off);
+    jgc_compact_ints(jsn, gc, lexs, &off);
+    assert(off == total);
 
-//------------------------------------------------------------------------------
-JINLINE jval_t* _jarray_add_val( _jarray_t* a)
-{
-    assert(a);
-    _jarray_reserve(a, 1);
-    jval_t* val = _jarray_get_val(a, a->len++);
-    *val = (jval_t)
-    {
-        .type = 0,
-        .idx = 0
-    };
-    return val;
-}
+    jfree(jsn->lexs.ptr);
+    jsn->lexs.ptr = lexs;
+    jsn->lexs.len = jsn->lexs.cap = total;
 
-//------------------------------------------------------------------------------
-jval_t jarray_get(jarray_t a, size_t idx)
-{
-    jval_t* val = _jarray_get_val(_jarray_get_array(a), idx);
-    assert(val);
-    return *val;
+    jsn->nums.ptr = (jnum_t*)jgc_shrink(jsn->nums.ptr, nnums, sizeof(jnum_t));
+    jsn->nums.lex = (jlex_t*)jgc_shrink(jsn->nums.lex, nnums, sizeof(jlex_t));
+    jsn->nums.len = jsn->nums.cap = nnums;
+
+    jsn->ints.ptr = (jint_t*)jgc_shrink(jsn->ints.ptr, nints, sizeof(jint_t));
+    jsn->ints.lex = (jlex_t*)jgc_shrink(jsn->ints.lex, nints, sizeof(jlex_t));
+    jsn->ints.len = jsn->ints.cap = nints;
 }
 
 //------------------------------------------------------------------------------
-void jarray_add_num( jarray_t _a, jnum_t num )
+/// drops the unreachable objects and moves the others down, renumbering the
+/// strings and values they refer to. Their children move later.
+JINLINE void jgc_compact_objs( json_t* jsn, const jgc_t* gc, size_t len )
 {
-    size_t idx = json_add_num(_a.json, num);
+    for ( size_t i = 0; i < jsn->objs.len; i++ )
+    {
+        // the index hashes the string ids
+        _jobj_t* obj = _json_get_obj(jsn, i);
+        jobj_index_free(jsn, obj);
 
-    _jarray_t* a = _jarray_get_array(_a);
-    jval_t* val = _jarray_add_val(a);
-    val->type = JTYPE_NUM;
+        const jidx_t to = gc->objs[i];
+        if (to == JGC_DEAD) continue;
 
-    assert (idx < MAX_VAL_IDX);
-    val->idx = (uint32_t)idx;
+        // shared keys are renumbered once, with their shape
+        const jbool_t shaped = _jobj_is_shaped(obj);
+        jokey_t* keys = _jobj_keys(jsn, obj);
+        jval_t* vals = _jobj_vals(jsn, obj);
+        for ( size_t k = 0; k < obj->len; k++ )
+        {
+            if (!shaped && !jval_is_packed_key(vals[k])) keys[k].kidx = (jidx_t)jgc_move_str(gc, keys[k].kidx);
+            vals[k] = jgc_move(gc, vals[k]);
+        }
+        jsn->objs.ptr[to] = *obj;
+    }
+    jsn->objs.ptr = (_jobj_t*)jgc_shrink(jsn->objs.ptr, len, sizeof(_jobj_t));
+    jsn->objs.len = jsn->objs.cap = len;
 }
 
 //------------------------------------------------------------------------------
-void jarray_add_int( jarray_t _a, jint_t num )
+/// frees the shapes no object uses anymore and renumbers the keys of the
+/// others, must follow jgc_compact_objs.
+JINLINE void jgc_compact_shapes( json_t* jsn, const jgc_t* gc )
 {
-    size_t idx = json_add_int(_a.json, num);
+    if (jsn->shapes.len == 0) return;
 
-    _jarray_t* a = _jarray_get_array(_a);
-    jval_t* val = _jarray_add_val(a);
+    jidx_t* map = jgc_new_map(jsn->shapes.len);
+    for ( size_t i = 0; i < jsn->objs.len; i++ )
+    {
+        const _jobj_t* obj = _json_get_obj(jsn, i);
+        if (_jobj_is_shaped(obj)) map[obj->shape-1] = 0;
+    }
+    const size_t len = jgc_number(map, jsn->shapes.len);
 
-    if (MIN_JSHORT <= num && num <= MAX_JSHORT)
+    for ( size_t i = 0; i < jsn->shapes.len; i++ )
     {
-        val->type = JTYPE_SHORT;
-        val->idx = jint_to_short(num);
+        jshape_t shape = jsn->shapes.ptr[i];
+        jfree(shape.index);
+        shape.index = NULL;
+        if (map[i] == JGC_DEAD)
+        {
+            jfree(shape.keys);
+            continue;
+        }
+
+        const uint8_t* packed = (const uint8_t*)(shape.keys + shape.len);
+        uint64_t h = shape.len;
+        for ( size_t k = 0; k < shape.len; k++ )
+        {
+            if (!packed[k]) shape.keys[k].kidx = (jidx_t)jgc_move_str(gc, shape.keys[k].kidx);
+            h = jshape_mix(h, &shape.keys[k], packed[k]);
+        }
+        shape.hash = (uint32_t)(h >> 32);
+        jsn->shapes.ptr[map[i]] = shape;
     }
-    else
+
+    for ( size_t i = 0; i < jsn->objs.len; i++ )
     {
-        val->type = JTYPE_INT;
-        assert (idx < MAX_VAL_IDX);
-        val->idx = (uint32_t)idx;
+        _jobj_t* obj = _json_get_obj(jsn, i);
+        if (_jobj_is_shaped(obj)) obj->shape = map[obj->shape-1] + 1;
     }
+
+    jfree(map);
+    jsn->shapes.ptr = (jshape_t*)jgc_shrink(jsn->shapes.ptr, len, sizeof(jshape_t));
+    jsn->shapes.len = jsn->shapes.cap = len;
+    jshapes_rehash(jsn);
 }
 
 //------------------------------------------------------------------------------
-void jarray_add_strl( jarray_t _a, const char* str, size_t slen )
+JINLINE void jgc_compact_arrays( json_t* jsn, const jgc_t* gc, size_t len )
 {
-    assert(str);
-    size_t idx = json_add_strl(_a.json, str, slen);
-
-    _jarray_t* a = _jarray_get_array(_a);
-    jval_t* val = _jarray_add_val(a);
-    val->type = JTYPE_STR;
+    for ( size_t i = 0; i < jsn->arrays.len; i++ )
+    {
+        _jarray_t* a = _json_get_array(jsn, i);
+        const jidx_t to = gc->arrays[i];
+        if (to == JGC_DEAD) continue;
 
-    assert (idx < MAX_VAL_IDX);
-    val->idx = (uint32_t)idx;
+        if (_jarray_is_run(a))
+        {
+            // still contiguous, every number of the run is reachable
+            const jidx_t* map = (_jarray_run_type(a) == JTYPE_NUM) ? gc->nums : gc->ints;
+            a->off = _jarray_run_off(map[_jarray_run_first(a)], _jarray_run_type(a));
+        }
+        else
+        {
+            for ( size_t k = 0; k < a->len; k++ )
+            {
+                jval_t* val = _jarray_get_val(jsn, a, k);
+                *val = jgc_move(gc, *val);
+            }
+        }
+        jsn->arrays.ptr[to] = *a;
+    }
+    jsn->arrays.ptr = (_jarray_t*)jgc_shrink(jsn->arrays.ptr, len, sizeof(_jarray_t));
+    jsn->arrays.len = jsn->arrays.cap = len;
 }
 
 //------------------------------------------------------------------------------
-void jarray_add_bool( jarray_t _a, jbool_t b )
+/// copies the children of the remaining containers into a new pool that fits
+/// them exactly, objects first and then arrays. Every container is shrunk to
+/// its length and the space left behind by those that moved is dropped. Must
+/// follow the compaction of the objects, shapes and arrays.
+JINLINE void jgc_compact_children( json_t* jsn )
 {
-    _jarray_t* a = _jarray_get_array(_a);
-    jval_t* val = _jarray_add_val(a);
-    val->type = JTYPE_BOOL;
-    val->idx = b;
-}
+    size_t len = 0;
+    for ( size_t i = 0; i < jsn->objs.len; i++ )
+    {
+        const _jobj_t* obj = _json_get_obj(jsn, i);
+        len += _jobj_units_for(obj->len, _jobj_is_shaped(obj));
+    }
+    for ( size_t i = 0; i < jsn->arrays.len; i++ )
+    {
+        const _jarray_t* a = _json_get_array(jsn, i);
+        if (!_jarray_is_run(a)) len += _jarray_units(a->len);
+    }
 
-//------------------------------------------------------------------------------
-void jarray_add_nil( jarray_t _a )
-{
-    _jarray_t* a = _jarray_get_array(_a);
-    jval_t* val = _jarray_add_val(a);
-    val->type = JTYPE_NIL;
-    val->idx = 0;
+    // the same layout over the new pool
+    json_t to = *jsn;
+    to.children.ptr = len ? (uint64_t*)jmalloc(len * sizeof(uint64_t)) : NULL;
+
+    size_t off = 0;
+    for ( size_t i = 0; i < jsn->objs.len; i++ )
+    {
+        _jobj_t* obj = _json_get_obj(jsn, i);
+        _jobj_t moved = *obj;
+        moved.cap = moved.len;
+        moved.off = (jidx_t)off;
+        off += _jobj_units(&moved);
+        if (moved.len == 0)
+        {
+            moved.off = 0;
+            *obj = moved;
+            continue;
+        }
+
+        jobj_index_t** index = _jobj_own_index(&to, &moved);
+        if (index) *index = NULL;
+        if (!_jobj_is_shaped(obj)) memcpy(_jobj_keys(&to, &moved), _jobj_keys(jsn, obj), obj->len * sizeof(jokey_t));
+        memcpy(_jobj_vals(&to, &moved), _jobj_vals(jsn, obj), obj->len * sizeof(jval_t));
+        *obj = moved;
+    }
+    for ( size_t i = 0; i < jsn->arrays.len; i++ )
+    {
+        _jarray_t* a = _json_get_array(jsn, i);
+        if (_jarray_is_run(a)) continue;
+
+        _jarray_t moved = { a->len, a->len, (jidx_t)(a->len ? off : 0) };
+        off += _jarray_units(a->len);
+        if (a->len) memcpy(_jarray_vals(&to, &moved), _jarray_vals(jsn, a), a->len * sizeof(jval_t));
+        *a = moved;
+    }
+    assert(off == len);
+
+    jfree(jsn->children.ptr);
+    jsn->children.ptr = to.children.ptr;
+    jsn->children.len = jsn->children.cap = len;
+    jsn->children.garbage = 0;
 }
 
 //------------------------------------------------------------------------------
-jarray_t jarray_add_array( jarray_t _a )
+/// rebuilds the indexes dropped while compacting, they hash the string ids.
+JINLINE void jgc_index_all( json_t* jsn )
 {
-    size_t idx = json_add_array(_a.json);
-
-    _jarray_t* a = _jarray_get_array(_a);
-    jval_t* val = _jarray_add_val(a);
-    val->type = JTYPE_ARRAY;
-
-    assert (idx < MAX_VAL_IDX);
-    val->idx = (uint32_t)idx;
+    for ( size_t i = 0; i < jsn->objs.len; i++ )
+    {
+        _jobj_t* obj = _json_get_obj(jsn, i);
+        if (!_jobj_is_shaped(obj))
+        {
+            jobj_index_ensure(jsn, obj);
+            continue;
+        }
 
-    return (jarray_t){ _a.json, idx };
+        jshape_t* shape = &jsn->shapes.ptr[obj->shape-1];
+        if (!shape->index && obj->len >= JOBJ_INDEX_MIN) shape->index = jobj_index_build(shape->keys, _jobj_vals(jsn, obj), obj->len);
+    }
 }
 
 //------------------------------------------------------------------------------
-jobj_t jarray_add_obj( jarray_t _a )
+/// moves the reachable strings down, copies their bytes into a single new
+/// chunk, and rebuilds the hash table from the strings that were in it.
+/// Strings appended without being interned stay out of it.
+JINLINE void jgc_compact_strs( jmap_t* map, const jgc_t* gc, size_t len )
 {
-    size_t idx = json_add_obj(_a.json);
+    uint8_t* hashed = (uint8_t*)jmalloc(map->slen + 1);
+    memset(hashed, 0, map->slen + 1);
+    for ( size_t i = 0; i < map->bcap; i++ )
+    {
+        if (map->ctrl[i] != JMAP_EMPTY) hashed[map->slots[i]] = 1;
+    }
+    for ( size_t i = 0; i < map->old_cap; i++ )
+    {
+        if (map->old_ctrl[i] != JMAP_EMPTY) hashed[map->old_slots[i]] = 1;
+    }
 
-    _jarray_t* a = _jarray_get_array(_a);
-    jval_t* val = _jarray_add_val(a);
-    val->type = JTYPE_OBJ;
+    size_t bytes = 0;
+    size_t nhashed = 0;
+    for ( size_t i = 0; i < map->slen; i++ )
+    {
+        if (gc->strs[i] == JGC_DEAD) continue;
+        if (map->strs[i].len > BUF_SIZE) bytes += map->strs[i].len + 1;
+        nhashed += hashed[i];
+    }
 
-    assert (idx < MAX_VAL_IDX);
-    val->idx = (uint32_t)idx;
+    jchunk_t* chunks = NULL;
+    char* chars = bytes ? jchunk_alloc(&chunks, bytes) : NULL;
+    for ( size_t i = 0; i < map->slen; i++ )
+    {
+        const jidx_t to = gc->strs[i];
+        if (to == JGC_DEAD) continue;
 
-    return (jobj_t){ _a.json, idx };
-}
+        jstr_t str = map->strs[i];
+        if (str.len > BUF_SIZE)
+        {
+            memcpy(chars, str.str.chars, str.len + 1);
+            str.str.chars = chars;
+            chars += str.len + 1;
+        }
+        map->strs[to] = str;
+        hashed[to] = hashed[i];
+    }
+    jchunk_free_all(&map->chunks);
+    map->chunks = chunks;
 
-//------------------------------------------------------------------------------
-JINLINE void _jarray_print( jprint_t* ctx, jarray_t array, size_t depth )
-{
-    jprint_char(ctx, '[');
-    jprint_newline(ctx);
-    const json_t* jsn = jarray_get_json(array);
-    size_t len = jarray_len(array);
-    for ( size_t i = 0; i < len; i++ )
+    map->strs = (jstr_t*)jgc_shrink(map->strs, len, sizeof(jstr_t));
+    map->slen = map->scap = len;
+
+    jfree(map->slots); map->slots = NULL;
+    map->ctrl = NULL;
+    jfree(map->old_slots); map->old_slots = NULL;
+    map->old_ctrl = NULL;
+    map->old_cap = map->moved = 0;
+    map->blen = map->bcap = 0;
+
+    if (nhashed)
     {
-        jprint_tabs(ctx, depth+1);
-        _jval_print(ctx, jsn, jarray_get(array, i), depth+1);
-        if (i+1 != len) jprint_char(ctx, ',');
-        jprint_newline(ctx);
+        jmap_rehash(map, nhashed);
+        for ( size_t i = 0; i < len; i++ )
+        {
+            // the tags went with the old table, hash the strings again
+            if (!hashed[i]) continue;
+            const jstr_t* str = &map->strs[i];
+            const jhash_t hash = jstr_hash(jstr_get_cstr(str), str->len, map->seed);
+            assert(jhash_hi(hash) == str->hash);
+            _jmap_add_key(map, hash, i);
+        }
     }
-    jprint_tabs(ctx, depth);
-    jprint_char(ctx, ']');
+    jfree(hashed);
 }
 
-#pragma mark - jbuf_t
-
 //------------------------------------------------------------------------------
-JINLINE void jbuf_init(jbuf_t* buf)
+size_t json_gc( json_t* jsn )
 {
-    assert(buf);
-    buf->cap = 0;
-    buf->len = 0;
-    buf->ptr = NULL;
-}
+    assert(jsn);
+    const size_t before = json_get_mem(jsn).total.reserved;
+
+    jgc_t gc;
+    gc.nums = jgc_new_map(jsn->nums.len);
+    gc.ints = jgc_new_map(jsn->ints.len);
+    gc.objs = jgc_new_map(jsn->objs.len);
+    gc.arrays = jgc_new_map(jsn->arrays.len);
+    gc.strs = jgc_new_map(jsn->strmap.slen);
+    gc.base = jmap_base(&jsn->strmap);
+    jbuf_init(&gc.stack);
+
+    jgc_mark_all(jsn, &gc);
+    jbuf_destroy(&gc.stack);
+
+    const size_t nnums = jgc_number(gc.nums, jsn->nums.len);
+    const size_t nints = jgc_number(gc.ints, jsn->ints.len);
+    const size_t nobjs = jgc_number(gc.objs, jsn->objs.len);
+    const size_t narrays = jgc_number(gc.arrays, jsn->arrays.len);
+    const size_t nstrs = jgc_number(gc.strs, jsn->strmap.slen);
+
+    jgc_compact_objs(jsn, &gc, nobjs);
+    jgc_compact_shapes(jsn, &gc);
+    jgc_compact_arrays(jsn, &gc, narrays);
+    jgc_compact_children(jsn);
+    jgc_index_all(jsn);
+    jgc_compact_numbers(jsn, &gc, nnums, nints);
+    jgc_compact_strs(&jsn->strmap, &gc, nstrs);
+    jsn->root = jgc_move(&gc, jsn->root);
+
+    jfree(gc.nums);
+    jfree(gc.ints);
+    jfree(gc.objs);
+    jfree(gc.arrays);
+    jfree(gc.strs);
+
+    const size_t after = json_get_mem(jsn).total.reserved;
+    const size_t reclaimed = (before > after) ? before - after : 0;
+    jsn->reclaimed += reclaimed;
+    return reclaimed;
+}
+
+#pragma mark - json_pool_t
+
+//------------------------------------------------------------------------------
+/// a doc owned by a pool. Every doc the pool creates stays on its all list
+/// until the pool is freed, wherever it is cached.
+struct jpooled_t
+{
+    json_t jsn; // must be first
+    struct jpooled_t* next;
+    struct jpooled_t* all;
+};
+typedef struct jpooled_t jpooled_t;
 
 //------------------------------------------------------------------------------
-JINLINE void jbuf_destroy(jbuf_t* buf)
+struct json_pool_t
 {
-    assert(buf);
-    jfree(buf->ptr);
-    jbuf_init(buf);
-}
+    uint64_t id;
+    int flags;
+    const jdict_t* dict;
+
+    int lock; // guards free and all
+    jpooled_t* free;
+    jpooled_t* all;
+
+    struct json_pool_t* live; // next pool on the live list
+};
 
 //------------------------------------------------------------------------------
-JINLINE void jbuf_clear( jbuf_t* buf )
+/// docs recently released on this thread. The cache belongs to one pool at a
+/// time, identified by id since the pool it last served may have been freed.
+/// Switching to another pool hands the docs back to their pool if it is
+/// still alive.
+struct jpool_cache_t
 {
-    assert(buf);
-    if (buf->ptr && buf->cap > 0) buf->ptr[0] = '\0';
-    buf->len = 0;
-}
+    uint64_t id;
+    size_t len;
+    json_t* docs[JPOOL_CACHE_SIZE];
+};
+
+static JTHREAD_LOCAL struct jpool_cache_t jpool_cache;
+static uint64_t jpool_next_id = 1;
+
+// every pool not yet freed, so a cache can tell if its pool is still around
+static json_pool_t* jpool_live = NULL;
+static int jpool_live_lock = 0;
 
 //------------------------------------------------------------------------------
-JINLINE void jbuf_reserve( jbuf_t* buf, size_t cap )
+/// empties the cache of this thread. The docs go back to the shared list of
+/// their pool, or are dropped if it was freed, it destroyed them already.
+JINLINE void jpool_cache_flush( struct jpool_cache_t* cache )
 {
-    assert(buf);
-    if (buf->len+cap <= buf->cap)
-        return;
+    if (cache->len == 0) return;
 
-    size_t new_cap = grow(buf->len+cap, buf->cap);
-    char* ptr = (char*)jrealloc(buf->ptr, new_cap * sizeof(char));
-    if (ptr)
+    // the live lock keeps the pool from being freed while the docs move
+    jspin_lock(&jpool_live_lock);
+    json_pool_t* pool = jpool_live;
+    while (pool && pool->id != cache->id) pool = pool->live;
+    if (pool)
     {
-        buf->cap = new_cap;
-        buf->ptr = ptr;
+        jspin_lock(&pool->lock);
+        for ( size_t i = 0; i < cache->len; i++ )
+        {
+            jpooled_t* doc = (jpooled_t*)cache->docs[i];
+            doc->next = pool->free;
+            pool->free = doc;
+        }
+        jspin_unlock(&pool->lock);
     }
-    assert (buf->ptr);
+    jspin_unlock(&jpool_live_lock);
+    cache->len = 0;
 }
 
-
 //------------------------------------------------------------------------------
-JINLINE size_t jbuf_write( jbuf_t* buf, const void* ptr, size_t n )
+json_pool_t* json_pool_new( const jdict_t* dict, int flags )
 {
-    jbuf_reserve(buf, n);
-    memcpy(buf->ptr+buf->len, ptr, n);
-    buf->len += n;
-    return n;
+    json_pool_t* pool = (json_pool_t*)jcalloc(1, sizeof(json_pool_t));
+    if (!pool) return NULL;
+
+#if J_USE_ATOMICS
+    pool->id = __atomic_fetch_add(&jpool_next_id, 1, __ATOMIC_RELAXED);
+#else
+    pool->id = jpool_next_id++;
+#endif
+    pool->flags = flags;
+    pool->dict = dict;
+
+    jspin_lock(&jpool_live_lock);
+    pool->live = jpool_live;
+    jpool_live = pool;
+    jspin_unlock(&jpool_live_lock);
+    return pool;
 }
 
 //------------------------------------------------------------------------------
-JINLINE void jbuf_add( jbuf_t* buf, char ch )
+void json_pool_free( json_pool_t* pool )
 {
-    assert(buf);
-    jbuf_reserve(buf, 1);
-    buf->ptr[buf->len++] = ch;
+    if (!pool) return;
+
+    // once off the live list no cache hands docs back to it
+    jspin_lock(&jpool_live_lock);
+    json_pool_t** link = &jpool_live;
+    while (*link != pool) link = &(*link)->live;
+    *link = pool->live;
+    jspin_unlock(&jpool_live_lock);
+
+    for ( jpooled_t* doc = pool->all; doc; )
+    {
+        jpooled_t* all = doc->all;
+        json_destroy(&doc->jsn);
+        jfree(doc);
+        doc = all;
+    }
+
+    // this thread's cache can not outlive the pool by accident
+    if (jpool_cache.id == pool->id) jpool_cache.len = 0;
+    jfree(pool);
 }
 
 //------------------------------------------------------------------------------
-JINLINE void jbuf_end_str( jbuf_t* buf )
+json_t* json_pool_acquire( json_pool_t* pool )
 {
-    assert(buf);
-    jbuf_reserve(buf, 1);
-    buf->ptr[buf->len] = '\0';
+    assert(pool);
+
+    struct jpool_cache_t* cache = &jpool_cache;
+    if (cache->id == pool->id && cache->len > 0)
+        return cache->docs[--cache->len];
+
+    jspin_lock(&pool->lock);
+    jpooled_t* doc = pool->free;
+    if (doc) pool->free = doc->next;
+    jspin_unlock(&pool->lock);
+
+    if (doc) return &doc->jsn;
+
+    // nothing to reuse, make a new one
+    doc = (jpooled_t*)jmalloc(sizeof(jpooled_t));
+    if (!doc) return NULL;
+    json_init_dict(&doc->jsn, pool->dict, pool->flags);
+    doc->next = NULL;
+
+    jspin_lock(&pool->lock);
+    doc->all = pool->all;
+    pool->all = doc;
+    jspin_unlock(&pool->lock);
+
+    return &doc->jsn;
 }
 
 //------------------------------------------------------------------------------
-JINLINE int jbuf_add_unicode(jbuf_t* str, int32_t codepoint )
+void json_pool_release( json_pool_t* pool, json_t* jsn )
 {
-//    if (codepoint == 0)
-//    {
-//        return EXIT_FAILURE;
-//    }
-//    else
-    if(codepoint < 0x80)
-    {
-        jbuf_add(str, (char)codepoint);
-    }
-    else if(codepoint < 0x800)
+    assert(pool);
+    if (!jsn) return;
+
+    // keep the capacity of ordinary docs, don't hang on to huge ones
+    if (json_get_mem(jsn).total.reserved > JPOOL_MAX_KEEP)
     {
-        jbuf_add(str, 0xC0 + ((codepoint & 0x7C0) >> 6));
-        jbuf_add(str, 0x80 + ((codepoint & 0x03F)));
+        json_clear(jsn);
     }
-    else if(codepoint < 0x10000)
+    else
     {
-        jbuf_add(str, 0xE0 + ((codepoint & 0xF000) >> 12));
-        jbuf_add(str, 0x80 + ((codepoint & 0x0FC0) >> 6));
-        jbuf_add(str, 0x80 + ((codepoint & 0x003F)));
+        json_reset(jsn);
     }
-    else if(codepoint <= 0x10FFFF)
+
+    // a cache left with the docs of another pool, or of one freed on another
+    // thread, is flushed so it serves this pool from now on
+    struct jpool_cache_t* cache = &jpool_cache;
+    if (cache->id != pool->id)
     {
-        jbuf_add(str, 0xF0 + ((codepoint & 0x1C0000) >> 18));
-        jbuf_add(str, 0x80 + ((codepoint & 0x03F000) >> 12));
-        jbuf_add(str, 0x80 + ((codepoint & 0x000FC0) >> 6));
-        jbuf_add(str, 0x80 + ((codepoint & 0x00003F)));
+        jpool_cache_flush(cache);
+        cache->id = pool->id;
     }
-    else
+
+    if (cache->len < JPOOL_CACHE_SIZE)
     {
-        return EXIT_FAILURE;
+        cache->docs[cache->len++] = jsn;
+        return;
     }
 
-    return EXIT_SUCCESS;
+    jpooled_t* doc = (jpooled_t*)jsn;
+    jspin_lock(&pool->lock);
+    doc->next = pool->free;
+    pool->free = doc;
+    jspin_unlock(&pool->lock);
 }
 
-#pragma mark - json_t
-
 //------------------------------------------------------------------------------
-json_t* json_init( json_t* jsn )
+jobj_t json_root_obj( json_t* jsn )
 {
-    if (!jsn) return NULL;
-
-    jmap_init(&jsn->strmap);
-
-    // nums
-    jsn->nums.cap = 0;
-    jsn->nums.len = 0;
-    jsn->nums.ptr = NULL;
-
-    // ints
-    jsn->ints.cap = 0;
-    jsn->ints.len = 0;
-    jsn->ints.ptr = NULL;
-
-    // arrays
-    jsn->arrays.cap = 0;
-    jsn->arrays.len = 0;
-    jsn->arrays.ptr = NULL;
+    assert(jsn);
 
-    // objs
-    jsn->objs.cap = 0;
-    jsn->objs.len = 0;
-    jsn->objs.ptr = NULL;
+    // no root yet, let's set it now
+    switch(jval_type(jsn->root))
+    {
+        case JTYPE_NIL:
+            json_add_obj(jsn);
 
-    jsn->root = (jval_t){JTYPE_NIL, 0};
+        case JTYPE_OBJ:
+            assert(jsn->objs.len > 0);
+            return (jobj_t){jsn, jsn->root.idx};
 
-    return jsn;
+        default:
+            assert(JFALSE);
+            return (jobj_t){NULL, 0};
+    }
 }
 
 //------------------------------------------------------------------------------
-void json_clear( json_t* jsn )
+jarray_t json_root_array( json_t* jsn )
 {
-    json_destroy(jsn);
-    json_init(jsn);
-}
+    assert(jsn);
 
-//------------------------------------------------------------------------------
-JINLINE size_t _json_write_file(void* file, const void* ptr, size_t n)
-{
-#if J_USE_POSIX
-    const char* cptr = (const char*)ptr;
-    for ( size_t i = 0; i < n; i++ )
+    // no root yet, let's set it now
+    switch(jval_type(jsn->root))
     {
-        int ch = cptr[i];
-        if (putc_unlocked(ch, (FILE*)file) == EOF)
-        {
-            return i;
-        }
+        case JTYPE_NIL:
+            json_add_array(jsn);
+
+        case JTYPE_ARRAY:
+            assert(jsn->arrays.len > 0);
+            return (jarray_t){jsn, jsn->root.idx};
+
+        default:
+            assert(JFALSE);
+            return (jarray_t){NULL, 0};
     }
-    return n;
-#else
-    return n * fwrite(ptr, n, 1, (FILE*)file);
-#endif
 }
 
+#pragma mark - jtable_t
+
 //------------------------------------------------------------------------------
-JINLINE size_t _json_write_buf(void* buf, const void* ptr, size_t n)
+struct jcolumn_t
 {
-    return jbuf_write((jbuf_t*)buf, ptr, n);
-}
+    jcol_type_t type;
+    unsigned seen; // bit per value type found while inferring the schema
+    void* data; // one value per row, zero for rows without one
+    uint8_t* valid; // bit per row, set if the row has a value
+};
+typedef struct jcolumn_t jcolumn_t;
 
 //------------------------------------------------------------------------------
-void jval_print(const json_t* jsn, jval_t val, int flags, print_func p, void* udata)
+struct jtable_t
 {
-    assert(jsn);
-    jprint_t ctx;
-    jprint_init_flags(&ctx, flags, p, udata);
-
-    _jval_print(&ctx, jsn, val, 0);
-}
+    json_t* jsn;
+    size_t rows;
+    jmap_t paths; // column names, a column's index is the index of its name
+    jcolumn_t* cols;
+    size_t cap;
+};
 
 //------------------------------------------------------------------------------
-void jarray_print(jarray_t array, int flags, print_func p, void* udata)
+/// appends a key to a column path. As in a JSON pointer '~' is written as "~0"
+/// and '/' as "~1", so a key holding a '/' never reads as a nested path.
+JINLINE void jtable_path_add( jbuf_t* path, const char* key, size_t klen )
 {
-    jprint_t ctx;
-    jprint_init_flags(&ctx, flags, p, udata);
+    if (path->len) jbuf_add(path, '/');
+    if (!memchr(key, '/', klen) && !memchr(key, '~', klen))
+    {
+        jbuf_write(path, key, klen);
+        return;
+    }
 
-    _jarray_print(&ctx, array, 0);
+    for ( size_t i = 0; i < klen; i++ )
+    {
+        switch (key[i])
+        {
+            case '~': jbuf_write(path, "~0", 2); break;
+            case '/': jbuf_write(path, "~1", 2); break;
+            default: jbuf_add(path, key[i]); break;
+        }
+    }
 }
 
 //------------------------------------------------------------------------------
-void jobj_print(jobj_t obj, int flags, print_func p, void* udata)
+/// records every leaf of the object under its path, or fills in the row when
+/// the columns are already known.
+JINLINE void jtable_walk( jtable_t* t, jbuf_t* path, jobj_t obj, size_t row, jbool_t fill )
 {
-    jprint_t ctx;
-    jprint_init_flags(&ctx, flags, p, udata);
+    const json_t* jsn = t->jsn;
+    for ( size_t i = 0; i < jobj_len(obj); i++ )
+    {
+        jval_t val;
+        size_t klen;
+        const char* key = jobj_get(obj, i, &val, &klen);
+
+        const size_t plen = path->len;
+        jtable_path_add(path, key, klen);
+
+        if (jval_is_obj(val))
+        {
+            jtable_walk(t, path, json_get_obj(t->jsn, val), row, fill);
+        }
+        else if (!fill)
+        {
+            size_t col = jmap_add_str(&t->paths, path->ptr, path->len);
+            if (col >= t->cap)
+            {
+                size_t cap = grow(col+1, t->cap);
+                t->cols = (jcolumn_t*)jrealloc(t->cols, cap * sizeof(jcolumn_t));
+                memset(t->cols + t->cap, 0, (cap - t->cap) * sizeof(jcolumn_t));
+                t->cap = cap;
+            }
+            int type = jval_type(val);
+            t->cols[col].seen |= 1u << (type == JTYPE_SHORT ? JTYPE_INT : type);
+        }
+        else if (!jval_is_nil(val))
+        {
+            jcolumn_t* c = &t->cols[jmap_find_str(&t->paths, path->ptr, path->len)];
+            switch (c->type)
+            {
+                case JCOL_NUM: ((jnum_t*)c->data)[row] = json_get_num(jsn, val); break;
+                case JCOL_INT: ((jint_t*)c->data)[row] = json_get_int(jsn, val); break;
+                case JCOL_STR: ((jidx_t*)c->data)[row] = val.idx; break;
+                case JCOL_BOOL: ((uint8_t*)c->data)[row] = (uint8_t)val.idx; break;
+                case JCOL_VAL: ((jval_t*)c->data)[row] = val; break;
+                default: assert(JFALSE); break;
+            }
+            c->valid[row >> 3] |= (uint8_t)(1u << (row & 7));
+        }
+        path->len = plen;
+    }
+}
 
-    _jobj_print(&ctx, obj, 0);
+//------------------------------------------------------------------------------
+/// the narrowest column type holding every value seen, nulls do not count.
+JINLINE jcol_type_t jcolumn_infer( unsigned seen )
+{
+    seen &= ~(1u << JTYPE_NIL);
+    if (!seen) return JCOL_NIL;
+    if (seen == 1u << JTYPE_INT) return JCOL_INT;
+    if (!(seen & ~((1u << JTYPE_INT) | (1u << JTYPE_NUM)))) return JCOL_NUM;
+    if (seen == 1u << JTYPE_STR) return JCOL_STR;
+    if (seen == 1u << JTYPE_BOOL) return JCOL_BOOL;
+    return JCOL_VAL;
 }
 
 //------------------------------------------------------------------------------
-size_t json_print(const json_t* jsn, int flags, print_func p, void* udata)
+jtable_t* json_to_columns( jarray_t records )
 {
-    assert(jsn);
-    jprint_t ctx;
-    jprint_init_flags(&ctx, flags, p, udata);
+    jtable_t* t = (jtable_t*)jmalloc(sizeof(jtable_t));
+    t->jsn = records.json;
+    t->rows = jarray_len(records);
+    t->cols = NULL;
+    t->cap = 0;
+    jmap_init(&t->paths);
 
-    if (setjmp(ctx.jerr_jmp) == 0)
+    jbuf_t path;
+    jbuf_init(&path);
+
+    // first find every path and the types of its values
+    for ( size_t row = 0; row < t->rows; row++ )
     {
-        // special case if we don't have any root
-        jval_t root = json_root(jsn);
-        if (!jval_is_nil(root))
-        {
-            _jval_print(&ctx, jsn, root, 0);
-        }
-        else
+        jval_t val = jarray_get(records, row);
+        if (jval_is_obj(val)) jtable_walk(t, &path, json_get_obj(t->jsn, val), row, JFALSE);
+    }
+
+    static const size_t sizes[] = { 0, sizeof(jnum_t), sizeof(jint_t), sizeof(jidx_t), sizeof(uint8_t), sizeof(jval_t) };
+    const size_t bytes = (t->rows + 7) / 8;
+    for ( size_t i = 0; i < jtable_cols(t); i++ )
+    {
+        jcolumn_t* c = &t->cols[i];
+        c->type = jcolumn_infer(c->seen);
+        c->valid = (uint8_t*)jmalloc(bytes + 1);
+        memset(c->valid, 0, bytes + 1);
+        if (c->type != JCOL_NIL)
         {
-            jprint_char(&ctx, '{');
-            jprint_newline(&ctx);
-            jprint_char(&ctx, '}');
+            const size_t size = sizes[c->type] * t->rows + 1;
+            c->data = jmalloc(size);
+            memset(c->data, 0, size);
         }
-        return ctx.nbytes;
     }
-    else
+
+    // then fill them in
+    for ( size_t row = 0; row < t->rows; row++ )
     {
-        return 0;
+        jval_t val = jarray_get(records, row);
+        if (jval_is_obj(val)) jtable_walk(t, &path, json_get_obj(t->jsn, val), row, JTRUE);
     }
+
+    jbuf_destroy(&path);
+    return t;
 }
 
 //------------------------------------------------------------------------------
-char* json_to_strl(const json_t* jsn, int flags, size_t* plen)
+void jtable_free( jtable_t* t )
 {
-    assert(jsn);
-
-    jbuf_t buf;
-    jbuf_init(&buf);
-
-    if (json_print(jsn, flags, _json_write_buf, &buf) == 0)
+    if (!t) return;
+    for ( size_t i = 0; i < jtable_cols(t); i++ )
     {
-        jbuf_destroy(&buf);
-        return NULL;
+        jfree(t->cols[i].data);
+        jfree(t->cols[i].valid);
     }
-    size_t len = buf.len;
-    jbuf_end_str(&buf);
-    if (plen) *plen = len;
-    return buf.ptr;
+    jfree(t->cols);
+    jmap_destroy(&t->paths);
+    jfree(t);
 }
 
 //------------------------------------------------------------------------------
-size_t json_print_path(const json_t* jsn, int flags, const char* path)
+size_t jtable_rows( const jtable_t* t )
 {
-    assert(jsn);
-    assert(path);
-    FILE* file = fopen(path, "w");
-    if (!file)
-    {
-        // TODO: error
-        return 0;
-    }
-    size_t rt = json_print_file(jsn, flags, file);
-    fclose(file);
-    return rt;
+    assert(t);
+    return t->rows;
 }
 
 //------------------------------------------------------------------------------
-size_t json_print_file(const json_t* jsn, int flags, FILE* f)
+size_t jtable_cols( const jtable_t* t )
 {
-    assert(jsn);
-    assert(f);
-
-    size_t rt;
-#if J_USE_POSIX
-    flockfile(f);
-    rt = json_print(jsn, flags, _json_write_file, f);
-    funlockfile(f);
-#else
-    rt = json_print(jsn, flags, _json_write_file, f);
-#endif
-
-    fflush(f);
-    return rt;
+    assert(t);
+    return t->paths.slen;
 }
 
 //------------------------------------------------------------------------------
-void json_destroy(json_t* jsn)
+const char* jtable_col_name( const jtable_t* t, size_t col, size_t* len )
 {
-    assert(jsn);
-
-    // cleanup string map
-    jmap_destroy(&jsn->strmap);
-
-    // cleanup numbers
-    jfree(jsn->nums.ptr); jsn->nums.ptr = NULL;
-
-    // cleanup integers
-    jfree(jsn->ints.ptr); jsn->ints.ptr = NULL;
+    assert(t);
+    assert(col < jtable_cols(t));
+    const jstr_t* name = jmap_get_str(&t->paths, col);
+    if (len) *len = name->len;
+    return jstr_get_cstr(name);
+}
 
-    // cleanup objects
-    for ( size_t i = 0; i < jsn->objs.len; i++ )
-    {
-        _jobj_t* obj = _json_get_obj(jsn, i);
-        if (obj->cap > BUF_SIZE)
-        {
-            jfree(obj->kvs.ptr); obj->kvs.ptr = NULL;
-        }
-    }
-    jfree(jsn->objs.ptr); jsn->objs.ptr = NULL;
-    jsn->objs.len = jsn->objs.cap = 0;
+//------------------------------------------------------------------------------
+size_t jtable_findl_col( const jtable_t* t, const char* path, size_t len )
+{
+    assert(t);
+    assert(path);
+    return jmap_find_str(&t->paths, path, len);
+}
 
-    // cleanup arrays
-    for ( size_t n = 0; n < jsn->arrays.len; n++ )
-    {
-        _jarray_t* array = _json_get_array(jsn, n);
-        if (array->cap > BUF_SIZE)
-        {
-            jfree(array->vals.ptr); array->vals.ptr = NULL;
-        }
-    }
-    jfree(jsn->arrays.ptr); jsn->arrays.ptr = NULL;
-    jsn->arrays.len = jsn->arrays.cap = 0;
+//------------------------------------------------------------------------------
+jcol_type_t jtable_col_type( const jtable_t* t, size_t col )
+{
+    assert(t);
+    return (col < jtable_cols(t)) ? t->cols[col].type : JCOL_NIL;
 }
 
 //------------------------------------------------------------------------------
-void json_free(json_t* jsn)
+JINLINE const void* jtable_col_data( const jtable_t* t, size_t col, jcol_type_t type )
 {
-    json_destroy(jsn);
-    jfree(jsn);
+    return (jtable_col_type(t, col) == type) ? t->cols[col].data : NULL;
 }
 
 //------------------------------------------------------------------------------
-jobj_t json_root_obj( json_t* jsn )
+const jnum_t* jtable_col_nums( const jtable_t* t, size_t col )
 {
-    assert(jsn);
+    return (const jnum_t*)jtable_col_data(t, col, JCOL_NUM);
+}
 
-    // no root yet, let's set it now
-    switch(jval_type(jsn->root))
-    {
-        case JTYPE_NIL:
-            json_add_obj(jsn);
+//------------------------------------------------------------------------------
+const jint_t* jtable_col_ints( const jtable_t* t, size_t col )
+{
+    return (const jint_t*)jtable_col_data(t, col, JCOL_INT);
+}
 
-        case JTYPE_OBJ:
-            assert(jsn->objs.len > 0);
-            return (jobj_t){jsn, jsn->root.idx};
+//------------------------------------------------------------------------------
+const jidx_t* jtable_col_strs( const jtable_t* t, size_t col )
+{
+    return (const jidx_t*)jtable_col_data(t, col, JCOL_STR);
+}
 
-        default:
-            assert(JFALSE);
-            return (jobj_t){NULL, 0};
-    }
+//------------------------------------------------------------------------------
+const uint8_t* jtable_col_bools( const jtable_t* t, size_t col )
+{
+    return (const uint8_t*)jtable_col_data(t, col, JCOL_BOOL);
 }
 
 //------------------------------------------------------------------------------
-jarray_t json_root_array( json_t* jsn )
+const jval_t* jtable_col_vals( const jtable_t* t, size_t col )
 {
-    assert(jsn);
+    return (const jval_t*)jtable_col_data(t, col, JCOL_VAL);
+}
 
-    // no root yet, let's set it now
-    switch(jval_type(jsn->root))
-    {
-        case JTYPE_NIL:
-            json_add_array(jsn);
+//------------------------------------------------------------------------------
+const uint8_t* jtable_col_valid( const jtable_t* t, size_t col )
+{
+    assert(t);
+    assert(col < jtable_cols(t));
+    return t->cols[col].valid;
+}
 
-        case JTYPE_ARRAY:
-            assert(jsn->arrays.len > 0);
-            return (jarray_t){jsn, jsn->root.idx};
+//------------------------------------------------------------------------------
+const char* jtable_get_strl( const jtable_t* t, size_t col, size_t row, size_t* len )
+{
+    const jidx_t* ids = jtable_col_strs(t, col);
+    if (!ids || row >= t->rows || !jtable_is_valid(t->cols[col].valid, row)) return NULL;
 
-        default:
-            assert(JFALSE);
-            return (jarray_t){NULL, 0};
-    }
+    size_t slen;
+    const char* str = json_get_strl(t->jsn, (jval_t){JTYPE_STR, ids[row]}, &slen);
+    if (len) *len = slen;
+    return str;
 }
 
 #pragma mark - jcontext_t
@@ -2537,6 +5680,11 @@ JINLINE void jcontext_init(jcontext_t* ctx)
     ctx->is_stream = JFALSE;
     *ctx->buf = '\0';
     jbuf_init(&ctx->strbuf);
+    jbuf_init(&ctx->vals);
+    jbuf_init(&ctx->keys);
+    ctx->shape = 0;
+    memset(ctx->seen, 0, sizeof(ctx->seen));
+    ctx->predict = 0;
 }
 
 //------------------------------------------------------------------------------
@@ -2573,6 +5721,8 @@ JINLINE void jcontext_destroy(jcontext_t* ctx)
 {
     assert(ctx);
     jbuf_destroy(&ctx->strbuf);
+    jbuf_destroy(&ctx->vals);
+    jbuf_destroy(&ctx->keys);
 }
 
 #pragma mark - parse
@@ -2634,6 +5784,17 @@ JINLINE int jcontext_next( jcontext_t* ctx )
     return jcontext_peek(ctx);
 }
 
+//------------------------------------------------------------------------------
+/// consumes n characters that are already in the buffer.
+JINLINE void jcontext_skip( jcontext_t* ctx, size_t n )
+{
+    assert(n > 0 && (size_t)(ctx->end - ctx->beg) >= n);
+    ctx->err->col += n - 1;
+    ctx->err->off += n - 1;
+    ctx->beg += n - 1;
+    jcontext_next(ctx);
+}
+
 //------------------------------------------------------------------------------
 JINLINE uint32_t jcontext_read_utf8( jcontext_t* ctx )
 {
@@ -2972,6 +6133,131 @@ JINLINE int parse_num( jcontext_t* ctx, jnum_t* _num, jint_t* _int )
     return JTYPE_NUM;
 }
 
+//------------------------------------------------------------------------------
+/// converts the raw text of a number with parse_num. Returns the number type or
+/// JTYPE_NIL if the conversion failed.
+JINLINE int jlex_convert( const char* str, size_t len, jnum_t* num, jint_t* i )
+{
+    assert(str);
+    jerr_t err;
+    memset(&err, 0, sizeof(err));
+
+    jcontext_t ctx;
+    jcontext_init_buf(&ctx, str, len);
+    ctx.err = &err;
+
+    // the type is only set once parse_num returns, so nothing live across the
+    // setjmp is modified before a longjmp
+    if (setjmp(ctx.jerr_jmp) != 0)
+    {
+        jcontext_destroy(&ctx);
+        return JTYPE_NIL;
+    }
+
+    const int type = parse_num(&ctx, num, i);
+    jcontext_destroy(&ctx);
+    return type;
+}
+
+//------------------------------------------------------------------------------
+JINLINE int parse_lex_digits( json_t* jsn, jcontext_t* ctx, uint64_t* n )
+{
+    int cnt = 0;
+    for ( int ch = jcontext_peek(ctx); '0' <= ch && ch <= '9'; ch = jcontext_next(ctx) )
+    {
+        if (cnt++ < 18) *n = *n*10 + (ch - '0');
+        json_lexs_add(jsn, (char)ch);
+    }
+    return cnt;
+}
+
+//------------------------------------------------------------------------------
+/// Lazy version of parse_num. Validates the number and stores its raw text in
+/// the doc, the conversion is deferred until the value is first accessed.
+/// Small whole numbers are still packed directly into the value, and numbers
+/// which could fail to convert are converted right away so errors are still
+/// reported while parsing.
+JINLINE jval_t parse_lazy_num( json_t* jsn, jcontext_t* ctx )
+{
+    size_t off = jsn->lexs.len;
+    uint64_t dec = 0;
+    uint64_t unused = 0;
+
+    jbool_t neg = jcontext_peek(ctx) == '-';
+    if (neg)
+    {
+        json_lexs_add(jsn, '-');
+        jcontext_next(ctx);
+    }
+
+    int first = jcontext_peek(ctx);
+    int nint = parse_lex_digits(jsn, ctx, &dec);
+    json_assert(nint > 0, "invalid number");
+    json_assert(nint <= 1 || first != '0', "number cannot have leading zeros");
+
+    jbool_t fract = JFALSE;
+    if (jcontext_peek(ctx) == '.')
+    {
+        fract = JTRUE;
+        json_lexs_add(jsn, '.');
+        jcontext_next(ctx);
+        json_assert(parse_lex_digits(jsn, ctx, &unused) > 0, "number truncated after '.'");
+    }
+
+    jbool_t exp = JFALSE;
+    int ch = jcontext_peek(ctx);
+    if (ch == 'e' || ch == 'E')
+    {
+        exp = JTRUE;
+        json_lexs_add(jsn, (char)ch);
+        ch = jcontext_next(ctx);
+        if (ch == '-' || ch == '+')
+        {
+            json_lexs_add(jsn, (char)ch);
+            jcontext_next(ctx);
+        }
+        json_assert(parse_lex_digits(jsn, ctx, &unused) > 0, "number truncated at 'e'");
+    }
+
+    // whole numbers that fit in a short are not worth deferring, and print
+    // back identically. "-0" is the exception, keep its text.
+    if (!fract && !exp && nint <= 8 && !(neg && dec == 0))
+    {
+        jsn->lexs.len = off;
+        jint_t n = neg ? -(jint_t)dec : (jint_t)dec;
+        return (jval_t){JTYPE_SHORT, (jidx_t)jint_to_short(n)};
+    }
+
+    size_t len = jsn->lexs.len - off;
+    json_assert(off + len < MAX_KEY_IDX && len < JLEX_LAZY, "too many numbers");
+
+    jint_t intval = 0;
+    jnum_t numval = 0;
+    int type = fract ? JTYPE_NUM : JTYPE_INT;
+    uint32_t lazy = JLEX_LAZY;
+    if (exp || nint > 18)
+    {
+        // convert now, these can overflow
+        type = jlex_convert(jsn->lexs.ptr + off, len, &numval, &intval);
+        json_assert(type != JTYPE_NIL, "numeric overflow");
+        lazy = 0;
+    }
+
+    size_t idx;
+    if (type == JTYPE_NUM)
+    {
+        idx = json_add_num(jsn, numval);
+        json_check_idx(idx);
+        jsn->nums.lex[idx] = (jlex_t){(jidx_t)off, (uint32_t)len | lazy};
+        return (jval_t){JTYPE_NUM, (jidx_t)idx};
+    }
+
+    idx = json_add_int(jsn, intval);
+    json_check_idx(idx);
+    jsn->ints.lex[idx] = (jlex_t){(jidx_t)off, (uint32_t)len | lazy};
+    return (jval_t){JTYPE_INT, (jidx_t)idx};
+}
+
 //------------------------------------------------------------------------------
 JINLINE unsigned int parse_unicode_hex(jcontext_t* ctx)
 {
@@ -3017,13 +6303,19 @@ JINLINE void parse_unicode2( jbuf_t* str, jcontext_t* ctx )
 }
 
 //------------------------------------------------------------------------------
-JINLINE void parse_str(jbuf_t* str, jcontext_t* ctx)
+/// parses a string into the buffer and returns its hash. The hash is computed
+/// a block at a time while the string is being copied.
+JINLINE jhash_t parse_str(jbuf_t* str, jcontext_t* ctx, uint32_t seed)
 {
     int prev = jcontext_peek(ctx);
     json_assert(prev == '"', "Expected a String, found: '%c'", prev);
 
     jbuf_clear(str);
 
+    jhasher_t hs;
+    jhash_init(&hs, seed);
+    size_t hashed = 0;
+
     for (int ch = jcontext_next(ctx); ch >= 0; ch = jcontext_next(ctx) )
     {
         switch (prev)
@@ -3094,7 +6386,11 @@ JINLINE void parse_str(jbuf_t* str, jcontext_t* ctx)
                     case '"':
                         jcontext_next(ctx);
                         jbuf_end_str(str);
-                        return;
+                        for ( ; str->len - hashed >= JHASH_BLOCK; hashed += JHASH_BLOCK )
+                        {
+                            jhash_block(&hs, str->ptr + hashed);
+                        }
+                        return jhash_final(&hs, str->ptr + hashed, str->len);
 
                     default:
                     {
@@ -3115,9 +6411,18 @@ JINLINE void parse_str(jbuf_t* str, jcontext_t* ctx)
             }
         }
         prev = ch;
+
+        // at most 4 bytes are added per character, so a single block at a
+        // time keeps up with the copy
+        if (str->len - hashed >= JHASH_BLOCK)
+        {
+            jhash_block(&hs, str->ptr + hashed);
+            hashed += JHASH_BLOCK;
+        }
     }
 
     json_assert(JFALSE, "string terminated unexpectedly");
+    return 0;
 }
 
 //------------------------------------------------------------------------------
@@ -3127,10 +6432,14 @@ JINLINE void parse_array(jarray_t array, jcontext_t* ctx)
     json_assert(prev == '[', "Expected an array, found: '%c'", prev);
     json_t* jsn = array.json;
 
-    size_t count = jarray_len(array);
+    jbuf_t* stack = &ctx->vals;
+    const size_t start = stack->len / sizeof(jval_t);
+    jidx_t prev_obj = 0;
+
+    size_t count = 0;
     while ( JTRUE )
     {
-        size_t len = jarray_len(array);
+        size_t len = stack->len / sizeof(jval_t) - start;
 
         parse_whitespace(ctx);
         switch(jcontext_peek(ctx))
@@ -3146,21 +6455,73 @@ JINLINE void parse_array(jarray_t array, jcontext_t* ctx)
             {
                 json_passert( len == 0 || (len-count) == 1, "trailing ',' not allowed");
                 jcontext_next(ctx);
-                jarray_truncate(array);
+                _jarray_assign(jsn, _jarray_get_array(array), (const jval_t*)stack->ptr + start, len);
+                stack->len = start * sizeof(jval_t);
                 return;
             }
 
             default:
             {
                 json_passert(len == count, "missing ',' separator");
+                json_assert(len < MAX_CONTAINER_LEN, "too many values in one array");
+
+                // objects in an array tend to repeat the keys of the one before
+                ctx->predict = prev_obj;
                 jval_t val = parse_val(jsn, ctx);
-                *_jarray_add_val(_jarray_get_array(array)) = val;
+                if (jval_type(val) == JTYPE_OBJ) prev_obj = val.idx + 1;
+                jbuf_write(stack, &val, sizeof(jval_t));
                 break;
             }
         }
     }
 }
 
+//------------------------------------------------------------------------------
+/// reads the next key without copying or hashing it when it is the key at the
+/// same position of the template object, written without escapes and ending
+/// in the buffer. On a match, child is the template's value if that is an
+/// object, the value of the key likely repeats its keys too.
+JINLINE jbool_t parse_predicted_key( json_t* jsn, jcontext_t* ctx, jidx_t tmpl, size_t pos, jokey_t* k, jbool_t* packed, const char** key, jidx_t* child )
+{
+    if (!tmpl) return JFALSE;
+    _jobj_t* t = _json_get_obj(jsn, tmpl-1);
+    if (pos >= t->len) return JFALSE;
+
+    const jokey_t* tkey = &_jobj_keys(jsn, t)[pos];
+    const jval_t tval = _jobj_vals(jsn, t)[pos];
+    const char* str;
+    size_t slen;
+    if (jval_is_packed_key(tval))
+    {
+        // a packed key fills all JKEY_INLINE bytes when it has no terminator
+        const char* end = (const char*)memchr(tkey->kstr, 0, JKEY_INLINE);
+        str = tkey->kstr;
+        slen = end ? (size_t)(end - str) : JKEY_INLINE;
+    }
+    else
+    {
+        const jstr_t* jstr = jmap_get_str(&jsn->strmap, tkey->kidx);
+        str = jstr_get_cstr(jstr);
+        slen = jstr->len;
+    }
+
+    // a quote, backslash or control character would be read differently
+    const char* p = ctx->beg;
+    if ((size_t)(ctx->end - p) < slen + 2 || p[0] != '"' || p[slen+1] != '"') return JFALSE;
+    for ( size_t i = 0; i < slen; i++ )
+    {
+        const unsigned char ch = (unsigned char)p[i+1];
+        if (ch != (unsigned char)str[i] || ch == '"' || ch == '\\' || ch < 0x20) return JFALSE;
+    }
+
+    *k = *tkey;
+    *packed = jval_is_packed_key(tval);
+    *key = str;
+    *child = (jval_type(tval) == JTYPE_OBJ) ? tval.idx + 1 : 0;
+    jcontext_skip(ctx, slen + 2);
+    return JTRUE;
+}
+
 //------------------------------------------------------------------------------
 JINLINE void parse_obj(jobj_t obj, jcontext_t* ctx)
 {
@@ -3168,10 +6529,19 @@ JINLINE void parse_obj(jobj_t obj, jcontext_t* ctx)
     json_assert(prev == '{', "Expected an object, found: '%c'", prev);
     json_t* jsn = jobj_get_json(obj);
 
-    size_t count = jobj_len(obj);
+    // keys are matched against this object's before they are parsed
+    const jidx_t tmpl = ctx->predict;
+    ctx->predict = 0;
+
+    jbuf_t* vals = &ctx->vals;
+    jbuf_t* keys = &ctx->keys;
+    const size_t vstart = vals->len / sizeof(jval_t);
+    const size_t kstart = keys->len / sizeof(jokey_t);
+
+    size_t count = 0;
     while ( JTRUE )
     {
-        size_t len = jobj_len(obj);
+        size_t len = keys->len / sizeof(jokey_t) - kstart;
 
         parse_whitespace(ctx);
         switch (jcontext_peek(ctx))
@@ -3187,18 +6557,29 @@ JINLINE void parse_obj(jobj_t obj, jcontext_t* ctx)
             {
                 json_passert( len == 0 || (len-count) == 1, "trailing ',' not allowed");
                 jcontext_next(ctx);
-                jobj_truncate(obj);
+                _jobj_assign(jsn, &ctx->shape, ctx->seen, jobj_get_obj(obj), (const jokey_t*)keys->ptr + kstart, (const jval_t*)vals->ptr + vstart, len);
+                vals->len = vstart * sizeof(jval_t);
+                keys->len = kstart * sizeof(jokey_t);
                 return;
             }
 
             default:
             {
                 json_passert(len == count, "missing ',' separator");
+                json_assert(len < MAX_CONTAINER_LEN, "too many keys in one object");
 
                 // parse key
-                parse_str(&ctx->strbuf, ctx);
-                const char* key = ctx->strbuf.ptr;
-                size_t kvidx = jobj_add_keyl(obj, key, ctx->strbuf.len);
+                jokey_t k;
+                jbool_t packed;
+                const char* key;
+                jidx_t child = 0;
+                if (!parse_predicted_key(jsn, ctx, tmpl, len, &k, &packed, &key, &child))
+                {
+                    jhash_t hash = parse_str(&ctx->strbuf, ctx, jsn->strmap.seed);
+                    key = ctx->strbuf.ptr;
+                    packed = jokey_make(jsn, &k, key, ctx->strbuf.len, hash);
+                }
+                jbuf_write(keys, &k, sizeof(jokey_t));
 
                 parse_whitespace(ctx);
 
@@ -3210,7 +6591,10 @@ JINLINE void parse_obj(jobj_t obj, jcontext_t* ctx)
                 parse_whitespace(ctx);
 
                 // parse the value
-                jkv_set_val(obj, kvidx, parse_val(jsn, ctx));
+                ctx->predict = child;
+                jval_t val = parse_val(jsn, ctx);
+                if (packed) val.type |= ~JTYPE_MASK;
+                jbuf_write(vals, &val, sizeof(jval_t));
                 break;
             }
         }
@@ -3226,22 +6610,26 @@ JINLINE jval_t parse_val( json_t* jsn, jcontext_t* ctx )
         case '{': // obj
         {
             size_t idx = json_add_obj(jsn);
+            json_check_idx(idx);
             parse_obj((jobj_t){jsn, idx}, ctx);
-            return (jval_t){JTYPE_OBJ, (uint32_t)idx};
+            return (jval_t){JTYPE_OBJ, (jidx_t)idx};
         }
 
         case '[': // array
         {
             size_t idx = json_add_array(jsn);
+            json_check_idx(idx);
             parse_array((jarray_t){jsn, idx}, ctx);
-            return (jval_t){JTYPE_ARRAY, (uint32_t)idx};
+            return (jval_t){JTYPE_ARRAY, (jidx_t)idx};
         }
 
         case '"': // string
         {
             jbuf_t* buf = &ctx->strbuf;
-            parse_str(buf, ctx);
-            return (jval_t){JTYPE_STR, (uint32_t)json_add_strl(jsn, buf->ptr, buf->len)};
+            jhash_t hash = parse_str(buf, ctx, jsn->strmap.seed);
+            size_t idx = json_add_val_strl_hash(jsn, buf->ptr, buf->len, hash);
+            json_assert(buf->len <= JSTR_INLINE_MAX || idx < JSTR_INLINE, "too many strings, the limit is %zu (see JSON_WIDE_INDEX)", (size_t)JSTR_INLINE);
+            return (jval_t){JTYPE_STR, (jidx_t)idx};
         }
 
         case 't': // true
@@ -3275,19 +6663,32 @@ JINLINE jval_t parse_val( json_t* jsn, jcontext_t* ctx )
         case '8':
         case '9':
         {
+            if (jsn->flags & JFLAG_LAZY_NUMS)
+            {
+                return parse_lazy_num(jsn, ctx);
+            }
+
             jint_t intval;
             jnum_t numval;
             int type = parse_num(ctx, &numval, &intval);
             switch(type)
             {
                 case JTYPE_SHORT:
-                    return (jval_t){JTYPE_SHORT, (uint32_t)jint_to_short(intval)};
+                    return (jval_t){JTYPE_SHORT, (jidx_t)jint_to_short(intval)};
 
                 case JTYPE_INT:
-                    return (jval_t){JTYPE_INT, (uint32_t)json_add_int(jsn, intval)};
+                {
+                    size_t idx = json_add_int(jsn, intval);
+                    json_check_idx(idx);
+                    return (jval_t){JTYPE_INT, (jidx_t)idx};
+                }
 
                 case JTYPE_NUM:
-                    return (jval_t){JTYPE_NUM, (uint32_t)json_add_num(jsn, numval)};
+                {
+                    size_t idx = json_add_num(jsn, numval);
+                    json_check_idx(idx);
+                    return (jval_t){JTYPE_NUM, (jidx_t)idx};
+                }
 
                 default:
                     assert(JFALSE); // should never get here
@@ -3361,6 +6762,11 @@ int json_parse( json_t* jsn, jcontext_t* ctx )
         return EXIT_FAILURE;
     }
 
+    // nothing from a previous doc of the stream can be predicted
+    ctx->predict = 0;
+    ctx->shape = 0;
+    memset(ctx->seen, 0, sizeof(ctx->seen));
+
     if (setjmp(ctx->jerr_jmp) == 0)
     {
         switch(jcontext_peek(ctx))
@@ -3461,7 +6867,8 @@ JINLINE int _json_load_buf(json_t* jsn, const char* src, const void* buf, size_t
     // pre-allocate data based on estimate size
     size_t est = grow( (size_t)ceilf(blen*0.01f), 0);
 
-    jmap_rehash(&jsn->strmap, est);
+    // only keys go into the table when values are not interned
+    if (!(jsn->flags & JFLAG_INTERN_KEYS)) jmap_rehash(&jsn->strmap, est);
     json_nums_reserve(jsn, est);
     json_ints_reserve(jsn, est);
     json_arrays_reserve(jsn, est);
@@ -3520,12 +6927,9 @@ JINLINE jmem_t json_mem_arrays( json_t* jsn )
 
     for ( size_t i = 0; i < jsn->arrays.len; i++ )
     {
-        _jarray_t* a = _json_get_array(jsn, i);
-        if (a->cap > BUF_SIZE)
-        {
-            mem.used += a->len * sizeof(jval_t);
-            mem.reserved += a->cap * sizeof(jval_t);
-        }
+        const _jarray_t* a = _json_get_array(jsn, i);
+        mem.used += a->cap ? a->len * sizeof(jval_t) : 0;
+        mem.reserved += _jarray_units(a->cap) * sizeof(uint64_t);
     }
     mem.used += sizeof(_jarray_t) * jsn->arrays.len;
     mem.reserved += sizeof(_jarray_t) * jsn->arrays.cap;
@@ -3538,6 +6942,15 @@ JINLINE jmem_t json_mem_nums( json_t* jsn )
     jmem_t mem = {0,0};
     mem.used += sizeof(jnum_t) * jsn->nums.len;
     mem.reserved += sizeof(jnum_t) * jsn->nums.cap;
+    if (jsn->nums.lex)
+    {
+        mem.used += sizeof(jlex_t) * jsn->nums.len;
+        mem.reserved += sizeof(jlex_t) * jsn->nums.cap;
+    }
+
+    // raw number text is accounted with the numbers
+    mem.used += jsn->lexs.len;
+    mem.reserved += jsn->lexs.cap;
     return mem;
 }
 
@@ -3548,6 +6961,11 @@ JINLINE jmem_t json_mem_ints( json_t* jsn )
     jmem_t mem = {0,0};
     mem.used += sizeof(jint_t) * jsn->ints.len;
     mem.reserved += sizeof(jint_t) * jsn->ints.cap;
+    if (jsn->ints.lex)
+    {
+        mem.used += sizeof(jlex_t) * jsn->ints.len;
+        mem.reserved += sizeof(jlex_t) * jsn->ints.cap;
+    }
     return mem;
 }
 
@@ -3557,15 +6975,34 @@ JINLINE jmem_t json_mem_objs( json_t* jsn )
     jmem_t mem = {0,0};
     for ( size_t i = 0; i < jsn->objs.len; i++ )
     {
-        _jobj_t* a = _json_get_obj(jsn, i);
-        if (a->cap > BUF_SIZE)
+        const _jobj_t* a = _json_get_obj(jsn, i);
+        const size_t kv = _jobj_is_shaped(a) ? sizeof(jval_t) : sizeof(jokey_t) + sizeof(jval_t);
+        mem.used += a->len * kv;
+        mem.reserved += _jobj_units(a) * sizeof(uint64_t);
+
+        jobj_index_t** index = _jobj_own_index(jsn, a);
+        if (index && *index)
         {
-            mem.used += a->len * sizeof(jkv_t);
-            mem.reserved += a->cap * sizeof(jkv_t);
+            const size_t bytes = sizeof(jobj_index_t) + ((*index)->mask+1) * sizeof(jidx_t);
+            mem.used += bytes;
+            mem.reserved += bytes;
         }
     }
     mem.used += sizeof(_jobj_t) * jsn->objs.len;
     mem.reserved += sizeof(_jobj_t) * jsn->objs.cap;
+
+    // shared keys are counted once, with their shape
+    for ( size_t i = 0; i < jsn->shapes.len; i++ )
+    {
+        const jshape_t* shape = &jsn->shapes.ptr[i];
+        size_t used = shape->len * (sizeof(jokey_t) + 1);
+        if (shape->index) used += sizeof(jobj_index_t) + (shape->index->mask+1) * sizeof(jidx_t);
+        mem.used += used;
+        mem.reserved += used;
+    }
+    mem.used += sizeof(jshape_t) * jsn->shapes.len;
+    mem.reserved += sizeof(jshape_t) * jsn->shapes.cap;
+    if (jsn->shapes.slots) mem.reserved += (jsn->shapes.mask+1) * sizeof(jidx_t);
     return mem;
 }
 
@@ -3584,6 +7021,11 @@ jmem_stats_t json_get_mem(json_t* jsn)
     stats.total.used = stats.nums.used + stats.ints.used + stats.arrays.used + stats.objs.used + stats.strs.used;
     stats.total.reserved = stats.nums.reserved + stats.ints.reserved + stats.arrays.reserved + stats.objs.reserved + stats.strs.reserved;
 
+    // the children of each container are counted with it, what no container
+    // holds is left behind by those that moved or is room to grow
+    stats.total.reserved += (jsn->children.cap - jsn->children.len + jsn->children.garbage) * sizeof(uint64_t);
+    stats.reclaimed = jsn->reclaimed;
+
     return stats;
 }
 
@@ -3601,13 +7043,10 @@ void _jarray_shallow_copy( jarray_t dst, const jarray_t src )
     _jarray_t* _dst = _jarray_get_array(dst);
     _jarray_t* _src = _jarray_get_array(src);
 
-    if (_src->len > BUF_SIZE)
-    {
-        memcpy(_dst->vals.ptr, _src->vals.ptr, sizeof(jval_t)*_src->len);
-    }
-    else
+    jval_t* vals = _jarray_vals(dst.json, _dst);
+    for ( size_t i = 0; i < _src->len; i++ )
     {
-        memcpy(_dst->vals.buf, _src->vals.buf, sizeof(jval_t)*_src->len);
+        vals[i] = jarray_get(src, i);
     }
     _dst->len = _src->len;
 }
@@ -3633,7 +7072,8 @@ void _jarray_deep_copy( jarray_t dst, const jarray_t src )
             case JTYPE_STR:
             {
                 size_t slen = 0;
-                jarray_add_strl(dst, jarray_get_strl(src, i, &slen), slen);
+                const char* str = jarray_get_strl(src, i, &slen);
+                jarray_add_strl(dst, str, slen);
                 break;
             }
 
@@ -3688,18 +7128,18 @@ JINLINE void _jobj_shallow_copy( jobj_t dst, const jobj_t src )
     // make sure we have enough space...
     jobj_reserve(dst, jobj_len(src));
 
+    const json_t* jsn = jobj_get_json(dst);
     _jobj_t* _dst = jobj_get_obj(dst);
     _jobj_t* _src = jobj_get_obj(src);
+    jobj_index_free(jsn, _dst);
 
-    if (_src->len > BUF_SIZE)
-    {
-        memcpy(_dst->kvs.ptr, _src->kvs.ptr, sizeof(jkv_t)*_src->len);
-    }
-    else
+    if (_src->len)
     {
-        memcpy(_dst->kvs.buf, _src->kvs.buf, sizeof(jkv_t)*_src->len);
+        memcpy(_jobj_keys(jsn, _dst), _jobj_keys(jsn, _src), sizeof(jokey_t)*_src->len);
+        memcpy(_jobj_vals(jsn, _dst), _jobj_vals(jsn, _src), sizeof(jval_t)*_src->len);
     }
     _dst->len = _src->len;
+    jobj_index_ensure(jsn, _dst);
 }
 
 //------------------------------------------------------------------------------
@@ -3727,7 +7167,9 @@ JINLINE void _jobj_deep_copy( jobj_t dst, const jobj_t src )
             case JTYPE_STR:
             {
                 size_t slen = 0;
-                jobj_add_strl(dst, key, json_get_strl(src_jsn, val, &slen), slen);
+                char buf[JSTR_INLINE_MAX+1];
+                const char* str = json_get_strl_buf(src_jsn, val, &slen, buf);
+                jobj_add_strl(dst, key, str, slen);
                 break;
             }
 
@@ -263,6 +263,57 @@ static const int JPRINT_ESC_UNI = 0x2;
 */
 static const int JPRINT_NEWLINE_WIN = 0x4;
 
+/*!
+    @constant JFLAG_LAZY_NUMS
+    Document flag for lazily converting numbers. The raw number text is kept
+    when parsing and only converted on the first json_get_num / json_get_int,
+    the converted value is cached. Untouched numbers are printed back exactly
+    as they appeared in the source. Conversion writes to the document, so a
+    const doc loaded with this flag must not be read from multiple threads 
+    without synchronization.
+    
+    @see json_init_flags
+*/
+static const int JFLAG_LAZY_NUMS = 0x1;
+
+/*!
+    @constant JFLAG_INTERN_KEYS
+    Document flag for only interning object keys. String values are appended
+    to the string pool as is, without being hashed or looked up, so duplicate
+    values are no longer shared. Useful for data made up mostly of unique
+    strings (ids, timestamps, free text) where the lookup is pure overhead.
+    The default is to intern all strings.
+    
+    @see json_init_flags
+*/
+static const int JFLAG_INTERN_KEYS = 0x2;
+
+/*!
+    @constant JFLAG_INTERN_ADAPTIVE
+    Document flag for interning string values only while it pays off. String 
+    values are interned while at least a quarter of them are found in the
+    table, measured over windows of 4096 values. Once it drops below, values
+    are appended without a lookup for the remainder of the document (or until
+    it is cleared).
+    Keys are always interned. Ignored if JFLAG_INTERN_KEYS is also set.
+    
+    @see json_init_flags
+*/
+static const int JFLAG_INTERN_ADAPTIVE = 0x4;
+
+/*!
+    @constant JFLAG_INCREMENTAL_REHASH
+    Document flag for growing the string table incrementally. Rather than 
+    moving every string into the larger table at once, which stalls for a 
+    long time once a table holds millions of strings, the old table is kept 
+    and a few of its slots are moved with each string added. Lookups search 
+    both tables until the old one is drained. Smooths out the latency of 
+    documents built up live at a small cost in throughput.
+    
+    @see json_init_flags
+*/
+static const int JFLAG_INCREMENTAL_REHASH = 0x8;
+
 /*!
     User function for writing json output. 
     
@@ -278,6 +329,46 @@ typedef size_t (*print_func)( void* ctx, const void* ptr, size_t n);
     all json value functions and declarations.
 */
 
+/*!
+    @define JSON_WIDE_INDEX
+    Set to 1 when building the library, and everything including this header,
+    to use 64-bit values. By default a value packs its type and index into 32
+    bits, which limits a doc to 2^28 (268,435,456) values of each type, and
+    to 2^27 distinct strings since strings of up to 3 bytes are stored in the
+    value itself. Wide values have 60-bit indices, store strings of up to 7
+    bytes in the value and container lengths are no longer limited to 32 bits,
+    at the cost of twice the memory per value and per key.
+*/
+#ifndef JSON_WIDE_INDEX
+    #define JSON_WIDE_INDEX 0
+#endif
+
+/*!
+    @define JSON_WIDE_KEYS
+    Set to 1 when building the library, and everything including this header,
+    to give every object key a 16 byte slot. Keys of up to 15 bytes, which
+    covers most real ones such as "type", "geometry" or "coordinates", are then
+    stored in the slot and found by comparing their bytes, they are never
+    hashed nor looked up in the string table. By default only keys shorter than
+    a jidx_t are stored that way. Each key takes 12 more bytes (8 with
+    JSON_WIDE_INDEX), including the unused inline slots of small objects, so
+    docs of many small objects can take close to twice the memory. The keys
+    of large parsed records are shared by their shape.
+*/
+#ifndef JSON_WIDE_KEYS
+    #define JSON_WIDE_KEYS 0
+#endif
+
+/*!
+    Index of a value in its pool, also used for string ids and container 
+    lengths. 64 bits wide with JSON_WIDE_INDEX, 32 bits otherwise.
+*/
+#if JSON_WIDE_INDEX
+    typedef uint64_t jidx_t;
+#else
+    typedef uint32_t jidx_t;
+#endif
+
 /*!
     @struct jval_t
     A struct representing a json value. Clients should not modify or access the
@@ -285,8 +376,8 @@ typedef size_t (*print_func)( void* ctx, const void* ptr, size_t n);
 */
 struct jval_t
 {
-    uint32_t type : 4;
-    uint32_t idx : 28;
+    jidx_t type : 4;
+    jidx_t idx : sizeof(jidx_t)*8 - 4;
 };
 typedef struct jval_t jval_t;
 
@@ -503,6 +594,125 @@ void jobj_add_nil( jobj_t obj, const char* key );
 */
 jobj_t jobj_add_obj( jobj_t obj, const char* key );
 
+/*!
+    Replaces the value of the first matching key in place, or appends the key
+    if the object does not have it yet. The replaced value stays in the doc 
+    until json_gc collects it.
+    
+    @param obj the object.
+    @param key the key.
+    @param val the new value, must belong to the same json doc and must not
+               contain the object itself.
+*/
+void jobj_set_val( jobj_t obj, const char* key, jval_t val );
+
+/*!
+    Sets the value of a key to a number.
+    
+    @see jobj_set_val
+    
+    @param obj the object.
+    @param key the key.
+    @param num the number.
+*/
+void jobj_set_num( jobj_t obj, const char* key, jnum_t num );
+
+/*!
+    Sets the value of a key to an integer.
+    
+    @see jobj_set_val
+    
+    @param obj the object.
+    @param key the key.
+    @param num the integer.
+*/
+void jobj_set_int( jobj_t obj, const char* key, jint_t num );
+
+/*!
+    Sets the value of a key to a string.
+    
+    @see jobj_set_val
+    
+    @param obj the object.
+    @param key the key.
+    @param str the string.
+    @param slen the length of the string.
+*/
+void jobj_set_strl( jobj_t obj, const char* key, const char* str, size_t slen );
+
+/*!
+    @function jobj_set_str
+    Sets the value of a key to a null terminated string.
+*/
+#define jobj_set_str(OBJ, KEY, STR) jobj_set_strl(OBJ, KEY, STR, strlen(STR))
+
+/*!
+    Sets the value of a key to a boolean.
+    
+    @see jobj_set_val
+    
+    @param obj the object.
+    @param key the key.
+    @param b the boolean.
+*/
+void jobj_set_bool( jobj_t obj, const char* key, jbool_t b );
+
+/*!
+    Sets the value of a key to nil.
+    
+    @see jobj_set_val
+    
+    @param obj the object.
+    @param key the key.
+*/
+void jobj_set_nil( jobj_t obj, const char* key );
+
+/*!
+    Sets the value of a key to a new empty object.
+    
+    @see jobj_set_val
+    
+    @param obj the object.
+    @param key the key.
+    @return the new object.
+*/
+jobj_t jobj_set_obj( jobj_t obj, const char* key );
+
+/*!
+    Sets the value of a key to a new empty array.
+    
+    @see jobj_set_val
+    
+    @param obj the object.
+    @param key the key.
+    @return the new array.
+*/
+struct jarray_t jobj_set_array( jobj_t obj, const char* key );
+
+/*!
+    Removes a key and its value, the keys after it keep their order.
+    
+    @param obj the object.
+    @param idx the index of the key, must be less than jobj_len.
+*/
+void jobj_remove_idx( jobj_t obj, size_t idx );
+
+/*!
+    Removes the first matching key and its value.
+    
+    @param obj the object.
+    @param key the key.
+    @param klen the length of the key.
+    @return JTRUE if the key was found and removed.
+*/
+jbool_t jobj_removel( jobj_t obj, const char* key, size_t klen );
+
+/*!
+    @function jobj_remove
+    Removes the first key matching a null terminated key.
+*/
+#define jobj_remove(OBJ, KEY) jobj_removel(OBJ, KEY, strlen(KEY))
+
 /**
     Performs a copy of a json object into another one. If the both objects are
     from the same json doc a shallow copy is performed, otherwise a deep copy is
@@ -547,6 +757,93 @@ size_t jobj_findl_next_idx( jobj_t obj, size_t idx, const char* key, size_t klen
 */
 #define jobj_findl_idx(OBJ, KEY, KLEN) jobj_findl_next_idx(OBJ, 0, KEY, KLEN)
 
+/*!
+    @struct jkey_t
+    A key resolved against a json doc ahead of time, so that it can be looked
+    up in many objects without hashing it again. Clients should not modify or
+    access the members directly.
+    
+    @see jkey_resolve
+*/
+struct jkey_t
+{
+    union
+    {
+        jidx_t kidx;
+#if JSON_WIDE_KEYS
+        char kstr[16];
+#else
+        char kstr[sizeof(jidx_t)];
+#endif
+    } key;
+    int kind;
+};
+typedef struct jkey_t jkey_t;
+
+/*!
+    Resolves a key against a doc. This hashes the key and looks it up in the
+    doc's string table once, every later lookup with the handle only compares
+    integers.
+    
+    The handle is only valid for the doc it was resolved against, and only
+    until the doc is cleared or reloaded. A key that is not in the doc yet will
+    not match keys added after it was resolved.
+    
+    @param jsn the json doc.
+    @param key the key.
+    @param klen the length of the key.
+    @return the resolved key.
+*/
+jkey_t jkey_resolve( const struct json_t* jsn, const char* key, size_t klen );
+
+/*!
+    Resolves a key against a doc, adding it to the doc if it is not there yet. 
+    The handle can be used to add the key to many objects.
+    
+    @see jobj_add_many
+    
+    @param jsn the json doc.
+    @param key the key.
+    @param klen the length of the key.
+    @return the resolved key.
+*/
+jkey_t jkey_intern( struct json_t* jsn, const char* key, size_t klen );
+
+/*!
+    Finds the first value matching a resolved key.
+    
+    @see jkey_resolve
+    
+    @param obj the object to search.
+    @param key the resolved key.
+    @return the index of the matching key-value or SIZE_MAX if not found.
+*/
+size_t jobj_find_key_idx( jobj_t obj, jkey_t key );
+
+/*!
+    @function jobj_find_key
+    Finds the first value matching a resolved key.
+    
+    @param OBJ the object to search.
+    @param KEY the resolved key.
+    @return the matching value or JNULL_VAL if not found.
+*/
+#define jobj_find_key(OBJ, KEY) jobj_get_val(OBJ, jobj_find_key_idx(OBJ, KEY))
+
+/*!
+    Appends many key-values to the object at once. The keys are resolved 
+    ahead of time so that none of them is hashed again, and the values are 
+    made with the json_make_* functions of the same doc.
+    
+    @see jkey_intern
+    
+    @param obj the object.
+    @param keys the interned keys.
+    @param vals the values.
+    @param n the number of key-values.
+*/
+void jobj_add_many( jobj_t obj, const jkey_t* keys, const jval_t* vals, size_t n );
+
 /*!
     Gets the length of the object.
     
@@ -567,6 +864,23 @@ size_t jobj_len( jobj_t obj );
 */
 const char* jobj_get(jobj_t obj, size_t idx, jval_t* val, size_t* klen);
 
+/*!
+    Gets the string id of the key at the given index. Keys found in the doc's
+    shared dictionary or concurrent table have the same id in every doc using
+    it, so keys can be compared across docs as integers. Other keys have ids
+    private to the doc.
+    
+    @see json_init_dict
+    @see json_init_cmap
+    
+    @param obj the object.
+    @param idx the index of the key.
+    @return the key's id, or SIZE_MAX for a short key that is not in the 
+            dictionary or table (short keys are stored inline, not as 
+            strings).
+*/
+size_t jobj_get_key_id(jobj_t obj, size_t idx);
+
 /*!
     Gets the value from the object at the given index.
     
@@ -814,6 +1128,71 @@ jarray_t jarray_add_array(jarray_t a);
 */
 jobj_t jarray_add_obj(jarray_t a);
 
+/*!
+    Appends many numbers to the end of the array at once. The numbers are 
+    copied into the doc in one block, and an empty array just points at them 
+    instead of holding a value for each. The numbers may come from a span of
+    the same doc, see jarray_get_num_span.
+    
+    @param a the array.
+    @param nums the numbers to append.
+    @param n the number of numbers.
+*/
+void jarray_add_nums( jarray_t a, const jnum_t* nums, size_t n );
+
+/*!
+    Appends many integers to the end of the array at once.
+    
+    @see jarray_add_nums
+    
+    @param a the array.
+    @param nums the integers to append.
+    @param n the number of integers.
+*/
+void jarray_add_ints( jarray_t a, const jint_t* nums, size_t n );
+
+/*!
+    Appends many strings to the end of the array at once. A string equal to 
+    the one before it shares its copy without being hashed again.
+    
+    @param a the array.
+    @param strs the strings to append.
+    @param lens the lengths of the strings, or NULL if they are null terminated.
+    @param n the number of strings.
+*/
+void jarray_add_strs( jarray_t a, const char* const* strs, const size_t* lens, size_t n );
+
+/*!
+    Replaces the value at an index in place. The replaced value stays in the 
+    doc until json_gc collects it.
+    
+    @see json_make_num
+    
+    @param a the array.
+    @param idx the index, must be less than jarray_len.
+    @param val the new value, must belong to the same json doc and must not
+               contain the array itself.
+*/
+void jarray_set( jarray_t a, size_t idx, jval_t val );
+
+/*!
+    Inserts a value before an index, the values from the index on move up.
+    
+    @param a the array.
+    @param idx the index, jarray_len appends the value.
+    @param val the value, must belong to the same json doc and must not
+               contain the array itself.
+*/
+void jarray_insert( jarray_t a, size_t idx, jval_t val );
+
+/*!
+    Removes the value at an index, the values after it move down.
+    
+    @param a the array.
+    @param idx the index, must be less than jarray_len.
+*/
+void jarray_remove( jarray_t a, size_t idx );
+
 /*!
     Get the length of the array.
     
@@ -922,6 +1301,36 @@ void jarray_print(jarray_t array, int flags, print_func p, void* udata);
 */
 #define jarray_get_array(A, IDX) json_get_array(jarray_get_json(A), jarray_get(A, IDX))
 
+/*!
+    Gets all the numbers of an array as one contiguous block of doubles,
+    without copying them. The parser stores arrays that hold only non-integer
+    numbers, like geojson coordinates, this way. Arrays that also hold
+    integers, or anything else, have no span.
+    
+    The span is valid until the array is modified or another number is added
+    to the doc.
+    
+    @param a the array.
+    @param ptr set to the first number, or NULL.
+    @param len set to the number of values in the array.
+    @return JTRUE if the array is empty or has a span, JFALSE otherwise.
+*/
+jbool_t jarray_get_num_span( jarray_t a, const jnum_t** ptr, size_t* len );
+
+/*!
+    Gets all the integers of an array as one contiguous block, without copying
+    them. Only arrays that the parser found to hold nothing but integers too
+    large to be packed into a value (beyond +/-2^27) have a span.
+    
+    @see jarray_get_num_span
+    
+    @param a the array.
+    @param ptr set to the first integer, or NULL.
+    @param len set to the number of values in the array.
+    @return JTRUE if the array is empty or has a span, JFALSE otherwise.
+*/
+jbool_t jarray_get_int_span( jarray_t a, const jint_t** ptr, size_t* len );
+
 //------------------------------------------------------------------------------
 /*!
     @group jmap
@@ -932,17 +1341,33 @@ void jarray_print(jarray_t array, int flags, print_func p, void* udata);
     or modified directly. Could change in future revisions.
     
     @details 
-    Strings are stored in a simple array.
-    
-    Strings are indexed in a hashtable. The hashtable contains the string's 
-    index not the string itself.
-    
-    @field blen numer of bucket slots
-    @field bcap bucket capacity
-    @field buckets array of buckets
+    Strings are stored in a simple array. Strings too long to be stored inline
+    have their bytes allocated from large append-only chunks.
+    
+    Strings are indexed in a flat open addressing hashtable. The hashtable 
+    contains the string's index not the string itself. Each slot has a control
+    byte holding 7 bits of the string's hash (or marking the slot as empty), 
+    lookups compare a whole group of control bytes at once and only visit the
+    strings whose tag matches.
+    
+    @field seed the hash seed
+    @field blen number of used slots
+    @field bcap number of slots, always a power of 2
+    @field slots array of string indices
+    @field ctrl array of control bytes, one per slot
     @field slen number of strings in the strs array
     @field scap capacity of the strings array
     @field strs array of string values
+    @field chunks arena chunks holding the bytes of the longer strings
+    @field dict optional shared read-only table searched first, its strings
+           take the indices below its length
+    @field shared optional concurrent table holding every string instead of
+           the map's own arrays, see json_init_cmap
+    @field old_slots previous slots while growing incrementally, NULL otherwise
+    @field old_ctrl previous control bytes while growing incrementally
+    @field old_cap number of previous slots
+    @field moved number of previous slots moved so far
+    @field incremental non-zero to grow the table incrementally
 */
 struct jmap_t
 {
@@ -950,14 +1375,38 @@ struct jmap_t
 
     size_t blen;
     size_t bcap;
-    struct jmapbucket_t* buckets;
+    jidx_t* slots;
+    uint8_t* ctrl;
 
     size_t slen;
     size_t scap;
     struct jstr_t* strs;
+
+    struct jchunk_t* chunks;
+
+    const struct jmap_t* dict;
+    struct jcmap_t* shared;
+
+    jidx_t* old_slots;
+    uint8_t* old_ctrl;
+    size_t old_cap;
+    size_t moved;
+    int incremental;
 };
 typedef struct jmap_t jmap_t;
 
+/*!
+    Hashes the given bytes with the seeded hash function used by the string 
+    table. Exposed for testing and benchmarking, the result is only stable 
+    within a single build.
+    
+    @param buf the bytes to hash, may only be NULL if len is 0.
+    @param len the number of bytes.
+    @param seed the hash seed.
+    @return the 32-bit hash value.
+*/
+uint32_t json_hash( const void* buf, size_t len, uint32_t seed );
+
 //------------------------------------------------------------------------------
 /*!
     @group jerr
@@ -1015,6 +1464,12 @@ typedef struct jerr_t jerr_t;
     the allocation of each value as we can allocate them in chunks instead of 
     individually.
     
+    Objects and arrays are split in two. The headers (length, capacity and
+    the offset of their children) are kept densely packed in their own arrays
+    while the keys and values of every container live in a single pool of
+    children, in the order the parser finishes them. Walking a document then touches small
+    headers and contiguous children instead of large mostly empty records.
+    
     Strings are internalized in an efficient hash table. Duplicate strings and
     keys are eliminated further reducing memory usage. This is important because
     most large documents tend to have the same keys repeated many times over. 
@@ -1032,6 +1487,7 @@ struct json_t
         size_t len;
         size_t cap;
         jnum_t* ptr;
+        struct jlex_t* lex;
     } nums;
 
     struct
@@ -1039,8 +1495,16 @@ struct json_t
         size_t len;
         size_t cap;
         jint_t* ptr;
+        struct jlex_t* lex;
     } ints;
 
+    struct
+    {
+        size_t len;
+        size_t cap;
+        char* ptr;
+    } lexs;
+
     struct
     {
         size_t len;
@@ -1055,10 +1519,226 @@ struct json_t
         struct _jarray_t* ptr;
     } arrays;
 
+    struct
+    {
+        size_t len;
+        size_t cap;
+        uint64_t* ptr;
+        size_t garbage; // left behind by containers that moved, until json_gc
+    } children;
+
+    struct
+    {
+        size_t len;
+        size_t cap;
+        struct jshape_t* ptr;
+        jidx_t* slots; // lookup table of shape index + 1, 0 is empty
+        size_t mask;
+    } shapes;
+
     jmap_t strmap;
+
+    struct
+    {
+        uint32_t count;
+        uint32_t hits;
+        int off;
+    } intern;
+
+    int flags;
+
+    size_t reclaimed; // bytes released by json_gc
 };
 typedef struct json_t json_t;
 
+/*!
+    @functiongroup jdict
+*/
+
+/*!
+    A frozen string dictionary shared read-only between many json docs. Docs
+    initialized with a dictionary look strings up in it before their own
+    string table, so keys found in it are neither hashed into nor stored by
+    every doc. Strings from the dictionary get the same id in every doc using
+    it, see jdict_findl and jobj_get_key_id.
+    
+    @code
+    jdict_t* dict = jdict_new();
+    jdict_add(dict, "timestamp");
+    jdict_add(dict, "message");
+    jdict_freeze(dict);
+
+    for (...) // each record
+    {
+        json_t jsn;
+        json_init_dict(&jsn, dict, 0);
+        json_load_buf(&jsn, line, len, &err);
+        //...
+        json_destroy(&jsn);
+    }
+    jdict_free(dict);
+    @endcode
+*/
+typedef struct jdict_t jdict_t;
+
+/*!
+    Allocates a new empty dictionary. Add strings to it and freeze it before
+    using it with any json doc.
+    
+    @see jdict_free
+    @return a new dictionary or NULL if allocation fails.
+*/
+jdict_t* jdict_new(void);
+
+/*!
+    Frees the dictionary. Every doc using it must be destroyed first.
+    
+    @param dict the dictionary to free, may be NULL.
+*/
+void jdict_free( jdict_t* dict );
+
+/*!
+    Adds a string to the dictionary, the dictionary must not be frozen yet.
+    Adding a string twice returns the same id.
+    
+    @param dict the dictionary.
+    @param str the string to add.
+    @param slen the length of the string.
+    @return the id of the string, stable across every doc using the dictionary.
+*/
+size_t jdict_addl( jdict_t* dict, const char* str, size_t slen );
+
+/*!
+    @see jdict_addl
+*/
+#define jdict_add(DICT, STR) jdict_addl(DICT, STR, strlen(STR))
+
+/*!
+    Adds every key of a sample doc to the dictionary. Typically used with the
+    first record(s) of a stream of similarly shaped docs.
+    
+    @param dict the dictionary, must not be frozen yet.
+    @param sample the doc to collect keys from.
+*/
+void jdict_add_keys( jdict_t* dict, const struct json_t* sample );
+
+/*!
+    Freezes the dictionary, no more strings can be added. A frozen dictionary
+    is never written to again and can be used by docs on multiple threads.
+    
+    @param dict the dictionary.
+*/
+void jdict_freeze( jdict_t* dict );
+
+/*!
+    @param dict the dictionary.
+    @return the number of strings in the dictionary.
+*/
+size_t jdict_len( const jdict_t* dict );
+
+/*!
+    Searches the dictionary for the given string.
+    
+    @param dict the dictionary.
+    @param str the string to search for.
+    @param slen the length of the string.
+    @return the id of the string or SIZE_MAX if not found.
+*/
+size_t jdict_findl( const jdict_t* dict, const char* str, size_t slen );
+
+/*!
+    @see jdict_findl
+*/
+#define jdict_find(DICT, STR) jdict_findl(DICT, STR, strlen(STR))
+
+/*!
+    @functiongroup jcmap
+*/
+
+/*!
+    A string intern table that can be shared by many threads. Lookups do not
+    lock, adding a new string locks one of 64 stripes picked by the string's
+    hash. Ids are handed out in insertion order and stay valid for the life of
+    the table. Docs initialized with json_init_cmap keep all their strings in
+    the table, so a string has the same id in every one of them. Without gcc or
+    clang atomics the table still works, but only from one thread at a time.
+    
+    @code
+    jcmap_t* map = jcmap_new();
+    // on any number of threads
+    size_t id = jcmap_add(map, "key");
+    assert(id == jcmap_find(map, "key"));
+    // once every thread is done
+    jcmap_free(map);
+    @endcode
+*/
+typedef struct jcmap_t jcmap_t;
+
+/*!
+    Allocates a new empty concurrent string table.
+    
+    @see jcmap_free
+    @return the new table, or NULL if allocation fails.
+*/
+jcmap_t* jcmap_new(void);
+
+/*!
+    Frees the table. No other thread may be using it and every doc using it
+    must be destroyed first.
+    
+    @param map the table to free, may be NULL.
+*/
+void jcmap_free( jcmap_t* map );
+
+/*!
+    Adds a string to the table if it is not already there. Thread safe.
+    
+    @param map the table.
+    @param str the string to add.
+    @param slen the length of the string.
+    @return the id of the string. Every thread adding the same string gets the
+            same id.
+*/
+size_t jcmap_addl( jcmap_t* map, const char* str, size_t slen );
+
+/*!
+    @see jcmap_addl
+*/
+#define jcmap_add(MAP, STR) jcmap_addl(MAP, STR, strlen(STR))
+
+/*!
+    Searches the table for a string without locking. Thread safe.
+    
+    @param map the table.
+    @param str the string to search for.
+    @param slen the length of the string.
+    @return the id of the string or SIZE_MAX if not found.
+*/
+size_t jcmap_findl( const jcmap_t* map, const char* str, size_t slen );
+
+/*!
+    @see jcmap_findl
+*/
+#define jcmap_find(MAP, STR) jcmap_findl(MAP, STR, strlen(STR))
+
+/*!
+    Gets a string by its id. Thread safe for any id returned by jcmap_addl or
+    jcmap_findl.
+    
+    @param map the table.
+    @param idx the id of the string.
+    @param slen returns the length of the string.
+    @return the NUL terminated string, valid until the table is freed.
+*/
+const char* jcmap_get_strl( const jcmap_t* map, size_t idx, size_t* slen );
+
+/*!
+    @param map the table.
+    @return the number of strings in the table. Strings being added 
+            concurrently may already be counted.
+*/
+size_t jcmap_len( const jcmap_t* map );
+
 /*!
     @functiongroup json
 */
@@ -1087,9 +1767,56 @@ json_t* json_new(void);
 */
 json_t* json_init( json_t* jsn );
 
+/*!
+    Initializes a new json doc with the given document flags. Otherwise 
+    identical to json_init.
+    
+    @see JFLAG_LAZY_NUMS
+    @see JFLAG_INTERN_KEYS
+    @see JFLAG_INTERN_ADAPTIVE
+    @see JFLAG_INCREMENTAL_REHASH
+    
+    @param jsn an uninitialized json doc.
+    @param flags the document flags, a bitwise OR of the JFLAG_* constants.
+    @return the input jsn or NULL if an error occurs.
+*/
+json_t* json_init_flags( json_t* jsn, int flags );
+
+/*!
+    Initializes a new json doc that looks strings up in a shared dictionary 
+    before its own string table. Otherwise identical to json_init_flags. The
+    dictionary must be frozen and must outlive the doc. Clearing the doc keeps
+    the dictionary.
+    
+    @see jdict_t
+    
+    @param jsn an uninitialized json doc.
+    @param dict the frozen dictionary, may be NULL.
+    @param flags the document flags, a bitwise OR of the JFLAG_* constants.
+    @return the input jsn or NULL if an error occurs.
+*/
+json_t* json_init_dict( json_t* jsn, const jdict_t* dict, int flags );
+
+/*!
+    Initializes a new json doc that keeps its strings in a concurrent string
+    table instead of its own. Otherwise identical to json_init_flags. Each doc
+    is still used by a single thread, but docs on different threads can share
+    the table: a string gets the same id in all of them, see jobj_get_key_id.
+    The table must outlive the doc. Clearing the doc keeps the table, json_gc
+    leaves its strings alone.
+    
+    @see jcmap_t
+    
+    @param jsn an uninitialized json doc.
+    @param map the shared table, may be NULL.
+    @param flags the document flags, a bitwise OR of the JFLAG_* constants.
+    @return the input jsn or NULL if an error occurs.
+*/
+json_t* json_init_cmap( json_t* jsn, jcmap_t* map, int flags );
+
 /*!
     Clears out the contents of the json doc, removing all keys and values. The 
-    end result will be an empty json document.
+    end result will be an empty json document. The document flags are kept.
     
     @code
     json_t* jsn;
@@ -1315,6 +2042,236 @@ void json_free(json_t* j);
 */
 void json_destroy(json_t* jsn);
 
+/*!
+    Empties the doc like json_clear, but keeps the memory it has allocated so 
+    the next document loaded into it does not have to allocate again. The 
+    document flags and dictionary are kept, the string table gets a new seed.
+    
+    @param jsn the json doc to reset.
+*/
+void json_reset(json_t* jsn);
+
+/*!
+    @functiongroup json_pool
+*/
+
+/*!
+    A pool of json docs for services creating and destroying many docs. Docs
+    released to the pool are reset, keeping their allocations, and handed out
+    again by json_pool_acquire. Each thread keeps the last few docs it 
+    released in a thread local cache, so acquiring and releasing usually takes
+    no locks. The cache serves one pool at a time, releasing to another pool
+    hands the cached docs back to theirs. The pool can be shared by any
+    number of threads.
+    
+    @code
+    json_pool_t* pool = json_pool_new(NULL, 0);
+    // per request, on any thread
+    json_t* jsn = json_pool_acquire(pool);
+    json_load_buf(jsn, buf, len, &err);
+    //...
+    json_pool_release(pool, jsn);
+    // once every thread is done
+    json_pool_free(pool);
+    @endcode
+*/
+typedef struct json_pool_t json_pool_t;
+
+/*!
+    Creates a new, empty pool.
+    
+    @param dict optional frozen dictionary used by every doc of the pool, must
+           outlive the pool. May be NULL.
+    @param flags the document flags of every doc of the pool.
+    @return the new pool or NULL if allocation fails.
+*/
+json_pool_t* json_pool_new( const jdict_t* dict, int flags );
+
+/*!
+    Frees the pool and every doc it ever handed out. No doc of the pool may 
+    be in use and no other thread may be using the pool.
+    
+    @param pool the pool to free, may be NULL.
+*/
+void json_pool_free( json_pool_t* pool );
+
+/*!
+    Gets an empty doc from the pool, creating one if there are none to reuse.
+    The doc must be given back with json_pool_release, never destroyed.
+    
+    @param pool the pool.
+    @return an empty json doc, NULL if allocation fails.
+*/
+json_t* json_pool_acquire( json_pool_t* pool );
+
+/*!
+    Gives a doc back to the pool. It is reset and may be handed out again
+    right away, on any thread.
+    
+    @param pool the pool the doc was acquired from.
+    @param jsn the doc, may be NULL.
+*/
+void json_pool_release( json_pool_t* pool, json_t* jsn );
+
+/*!
+    @functiongroup jtable
+*/
+
+/*!
+    A columnar copy of an array of records. Every path to a leaf value found in
+    any of the records becomes a column, nested objects are flattened into '/'
+    delimited paths, like "properties/STREET". As in a JSON pointer, a '~' in a
+    key is written as "~0" and a '/' as "~1". Each column holds one value per
+    record in a contiguous array, plus a bitmap of the records that have a
+    value for it. Scanning a field of every record becomes a linear loop.
+    
+    @code
+    jtable_t* t = json_to_columns(json_root_array(jsn));
+    size_t col = jtable_find_col(t, "properties/AREA");
+    const jnum_t* area = jtable_col_nums(t, col);
+    const uint8_t* valid = jtable_col_valid(t, col);
+    for ( size_t i = 0; i < jtable_rows(t); i++ )
+        if (jtable_is_valid(valid, i)) total += area[i];
+    jtable_free(t);
+    @endcode
+*/
+typedef struct jtable_t jtable_t;
+
+/*!
+    Column types, the narrowest type holding every value of a column.
+    
+    @constant JCOL_NIL every value is null or missing, the column has no data.
+    @constant JCOL_NUM doubles, integers are converted when mixed with doubles.
+    @constant JCOL_INT integers.
+    @constant JCOL_STR string values of the doc, the index of a jval_t of
+              type JTYPE_STR. Strings of up to 3 bytes (7 with 
+              JSON_WIDE_INDEX) are stored in the index itself rather than in
+              the string table, so these are not all string table ids. Read
+              them with jtable_get_strl or with json_get_strl on
+              (jval_t){JTYPE_STR, idx}. With
+              JFLAG_INTERN_KEYS or adaptive interning equal strings may have
+              different indexes.
+    @constant JCOL_BOOL one byte per value, 0 or 1.
+    @constant JCOL_VAL the values themselves, for arrays and mixed types.
+*/
+enum jcol_type_t
+{
+    JCOL_NIL  = 0,
+    JCOL_NUM  = 1,
+    JCOL_INT  = 2,
+    JCOL_STR  = 3,
+    JCOL_BOOL = 4,
+    JCOL_VAL  = 5,
+};
+typedef enum jcol_type_t jcol_type_t;
+
+/*!
+    Builds a columnar table of an array of records. Elements that are not 
+    objects have no value in any column. The doc must outlive the table, and 
+    not be modified while it is in use.
+    
+    @param records the array of objects.
+    @return the table, free it with jtable_free.
+*/
+jtable_t* json_to_columns( jarray_t records );
+
+/*!
+    Frees the table.
+    
+    @param table the table, may be NULL.
+*/
+void jtable_free( jtable_t* table );
+
+/*!
+    @param table the table.
+    @return the number of rows, the length of the records array.
+*/
+size_t jtable_rows( const jtable_t* table );
+
+/*!
+    @param table the table.
+    @return the number of columns.
+*/
+size_t jtable_cols( const jtable_t* table );
+
+/*!
+    Gets the path of a column.
+    
+    @param table the table.
+    @param col the column.
+    @param len set to the length of the path, may be NULL.
+    @return the path.
+*/
+const char* jtable_col_name( const jtable_t* table, size_t col, size_t* len );
+
+/*!
+    Finds a column by its path.
+    
+    @param table the table.
+    @param path the '/' delimited path, with '~' and '/' in keys escaped as
+           "~0" and "~1".
+    @param len the length of the path.
+    @return the column, or SIZE_MAX if no record has the path.
+*/
+size_t jtable_findl_col( const jtable_t* table, const char* path, size_t len );
+
+/*!
+    @function jtable_find_col
+    Finds a column by its null terminated path.
+*/
+#define jtable_find_col(TABLE, PATH) jtable_findl_col(TABLE, PATH, strlen(PATH))
+
+/*!
+    @param table the table.
+    @param col the column.
+    @return the type of the column, JCOL_NIL for columns out of range.
+*/
+jcol_type_t jtable_col_type( const jtable_t* table, size_t col );
+
+/*!
+    Gets the values of a column, one per row. Each getter returns NULL unless
+    the column has the matching type. Rows without a value hold 0. The
+    entries of a JCOL_STR column are string value indexes, see JCOL_STR.
+    
+    @param table the table.
+    @param col the column.
+    @return the values of the column, or NULL.
+*/
+const jnum_t* jtable_col_nums( const jtable_t* table, size_t col );
+const jint_t* jtable_col_ints( const jtable_t* table, size_t col );
+const jidx_t* jtable_col_strs( const jtable_t* table, size_t col );
+const uint8_t* jtable_col_bools( const jtable_t* table, size_t col );
+const jval_t* jtable_col_vals( const jtable_t* table, size_t col );
+
+/*!
+    Gets the validity bitmap of a column, bit (row % 8) of byte (row / 8) is 
+    set if the row has a non null value.
+    
+    @see jtable_is_valid
+    
+    @param table the table.
+    @param col the column.
+    @return the bitmap.
+*/
+const uint8_t* jtable_col_valid( const jtable_t* table, size_t col );
+
+/*!
+    @function jtable_is_valid
+    Tests a row of a validity bitmap.
+*/
+#define jtable_is_valid(BITS, ROW) (((BITS)[(ROW) >> 3] >> ((ROW) & 7)) & 1)
+
+/*!
+    Gets a string of a JCOL_STR column.
+    
+    @param table the table.
+    @param col the column.
+    @param row the row.
+    @param len set to the length of the string, may be NULL.
+    @return the string, or NULL if the row has none.
+*/
+const char* jtable_get_strl( const jtable_t* table, size_t col, size_t row, size_t* len );
+
 /*!
     Retrieves the root value of the given json, or a NIL value if it does not 
     have one.
@@ -1480,6 +2437,68 @@ jobj_t json_get_obj( json_t* jsn, jval_t val );
 */
 jarray_t json_get_array( json_t* jsn, jval_t val );
 
+/*!
+    Creates a value in the json doc without adding it to any object or array,
+    to be passed to jarray_set, jarray_insert or jobj_set_val.
+    
+    @code
+    jarray_insert(array, 0, json_make_num(jsn, 1.5));
+    jarray_set(array, 1, json_make_str(jsn, "text"));
+    @endcode
+    
+    @param jsn the json doc.
+    @param num the number.
+    @return the new value.
+*/
+jval_t json_make_num( json_t* jsn, jnum_t num );
+
+/*!
+    @see json_make_num
+    
+    @param jsn the json doc.
+    @param num the integer.
+    @return the new value.
+*/
+jval_t json_make_int( json_t* jsn, jint_t num );
+
+/*!
+    @see json_make_num
+    
+    @param jsn the json doc.
+    @param str the string.
+    @param slen the length of the string.
+    @return the new value.
+*/
+jval_t json_make_strl( json_t* jsn, const char* str, size_t slen );
+
+/*!
+    @function json_make_str
+    Creates a null terminated string value.
+*/
+#define json_make_str(JSN, STR) json_make_strl(JSN, STR, strlen(STR))
+
+/*!
+    @function json_make_bool
+    Creates a boolean value, booleans are not stored in the doc.
+*/
+#define json_make_bool(B) ((jval_t){.type=JTYPE_BOOL, .idx=(B) ? 1u : 0u})
+
+/*!
+    Creates an empty object, see json_get_obj to add to it.
+    
+    @param jsn the json doc.
+    @return the new value.
+*/
+jval_t json_make_obj( json_t* jsn );
+
+/*!
+    Creates an empty array, see json_get_array to add to it.
+    
+    @param jsn the json doc.
+    @return the new value.
+*/
+jval_t json_make_array( json_t* jsn );
+
 /*!
     @group jobj
 */
@@ -1513,7 +2532,11 @@ typedef struct jmem_t jmem_t;
     @field objs the memory used to store all objects in the doc.
     @field arrays the memory used to store all arrays in the doc.
     @field strs the memory used to store all strings in the doc.
-    @field total the total memory used in the doc.
+    @field total the total memory used in the doc. This includes the space
+           left behind in the pool of container children by objects and
+           arrays that grew, until json_gc.
+    @field reclaimed the bytes released by json_gc since the doc was created,
+           cleared or reset.
 */
 struct jmem_stats_t
 {
@@ -1523,6 +2546,7 @@ struct jmem_stats_t
     jmem_t arrays;
     jmem_t strs;
     jmem_t total;
+    size_t reclaimed;
 };
 typedef struct jmem_stats_t jmem_stats_t;
 
@@ -1535,6 +2559,22 @@ typedef struct jmem_stats_t jmem_stats_t;
 */
 jmem_stats_t json_get_mem( json_t* jsn );
 
+/*!
+    Collects the values that are no longer reachable from the root, such as 
+    those left behind by replaced or removed values, and compacts every pool 
+    and the string table. Values keep their order. Strings of a shared 
+    dictionary are never collected.
+    
+    Every index changes: jobj_t, jarray_t and jval_t handles, string ids, 
+    jkey_t handles and jtable_t tables taken before the collection are no 
+    longer valid. Get them again from the root.
+    
+    @param jsn the json doc.
+    @return the number of bytes released, also added up in 
+            jmem_stats_t.reclaimed.
+*/
+size_t json_gc( json_t* jsn );
+
 
 #ifdef __cplusplus
 } // namespace
@@ -37,9 +37,24 @@
 #include <list>
 #include <cassert>
 #include <optional>
+#include <limits>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <cmath>
+#if __cplusplus >= 202002L && __has_include(<span>)
+    #include <span>
+    #define IMS_JSON_HAS_SPAN 1
+#endif
 
 namespace ims
 {
+    class key;
+
     //--------------------------------------------------------------------------
     /**
         Json object. This is a thin wrapper around a json_t structure.
@@ -52,6 +67,7 @@ namespace ims
         friend class array;
         friend class val;
         friend class const_val;
+        friend class key;
     public:
 
         using key_val = std::pair<std::string, class const_val>;
@@ -322,6 +338,62 @@ namespace ims
             return *this;
         }
 
+        /**
+            Replaces the value of the first matching key, or adds the key if
+            this object does not have it yet.
+            
+            @see jobj_set_val
+            @param key the key.
+            @param str the string value.
+            @return a reference to the object.
+        */
+        obj& set ( const char* key, const std::string& str )
+        {
+            jobj_set_strl(m_obj, key, str.c_str(), str.length());
+            return *this;
+        }
+
+        obj& set ( const char* key, const char* str )
+        {
+            jobj_set_str(m_obj, key, str);
+            return *this;
+        }
+
+        obj& set ( const char* key, int n ) { return set(key, (jint_t)n); }
+        obj& set ( const char* key, size_t n ) { return set(key, (jint_t)n); }
+
+        obj& set ( const char* key, jint_t n )
+        {
+            jobj_set_int(m_obj, key, n);
+            return *this;
+        }
+
+        obj& set ( const char* key, jnum_t n )
+        {
+            jobj_set_num(m_obj, key, n);
+            return *this;
+        }
+
+        obj& set ( const char* key, bool b )
+        {
+            jobj_set_bool(m_obj, key, b);
+            return *this;
+        }
+
+        obj& set ( const char* key, std::nullptr_t )
+        {
+            jobj_set_nil(m_obj, key);
+            return *this;
+        }
+
+        /**
+            Removes the first matching key and its value.
+            
+            @param key the key.
+            @return true if the key was found.
+        */
+        bool remove( const std::string& key ) { return jobj_removel(m_obj, key.c_str(), key.length()); }
+
         /**
             Tests whether or not the value is null or unspecified for the given 
             key.
@@ -356,6 +428,15 @@ namespace ims
             return iterator(*this, idx);
         }
 
+        /**
+            Finds the first value matching a key resolved ahead of time.
+            
+            @param k the resolved key.
+            @return an iterator pointing to the value, or an iterator equal to 
+                    the end iterator if not found.
+        */
+        iterator find( const class key& k ) const;
+
         /**
             Recursively search this object to find a match. 
             
@@ -447,6 +528,14 @@ namespace ims
         */
         class const_val operator[] ( const std::string& key ) const;
 
+        /**
+            Retrieves a value for a resolved key, or a nil const_val otherwise.
+            
+            @param k the resolved key.
+            @return the value of the key, or a nil value if not found.
+        */
+        class const_val operator[] ( const class key& k ) const;
+
         /**
             Gets a setter for this object with the given key. This is used for
             making key-value assignments.
@@ -618,6 +707,37 @@ namespace ims
 
         bool empty() const { return jarray_len(m_array) == 0; }
 
+#if IMS_JSON_HAS_SPAN
+        /**
+            The numbers of this array as one contiguous block, without copying.
+            Only arrays of non-integer numbers have one.
+            
+            @see jarray_get_num_span
+            @return the numbers, or nothing if the array has no span.
+        */
+        std::optional<std::span<const jnum_t>> num_span() const
+        {
+            const jnum_t* ptr;
+            size_t len;
+            if (!jarray_get_num_span(m_array, &ptr, &len)) return std::nullopt;
+            return std::span<const jnum_t>(ptr, len);
+        }
+
+        /**
+            The integers of this array as one contiguous block, without copying.
+            
+            @see jarray_get_int_span
+            @return the integers, or nothing if the array has no span.
+        */
+        std::optional<std::span<const jint_t>> int_span() const
+        {
+            const jint_t* ptr;
+            size_t len;
+            if (!jarray_get_int_span(m_array, &ptr, &len)) return std::nullopt;
+            return std::span<const jint_t>(ptr, len);
+        }
+#endif
+
         array& push_back( jint_t n )
         {
             jarray_add_int(m_array, n);
@@ -654,6 +774,48 @@ namespace ims
 
         array& push_back( const val& val );
 
+        /**
+            Replaces the value at an index.
+            
+            @see jarray_set
+            @param idx the index, must be less than size().
+            @param t the new value.
+            @return a reference to the array.
+        */
+        template < typename T >
+        array& set( size_t idx, const T& t )
+        {
+            jarray_set(m_array, idx, make(t));
+            return *this;
+        }
+
+        /**
+            Inserts a value before an index.
+            
+            @see jarray_insert
+            @param idx the index, size() appends the value.
+            @param t the value.
+            @return a reference to the array.
+        */
+        template < typename T >
+        array& insert( size_t idx, const T& t )
+        {
+            jarray_insert(m_array, idx, make(t));
+            return *this;
+        }
+
+        /**
+            Removes the value at an index.
+            
+            @param idx the index, must be less than size().
+            @return a reference to the array.
+        */
+        array& remove( size_t idx )
+        {
+            jarray_remove(m_array, idx);
+            return *this;
+        }
+
         /**
             Copies the contents of this array into another.
             
@@ -674,6 +836,15 @@ namespace ims
             : m_array(a)
         {}
 
+        jval_t make( jint_t n ) { return json_make_int(m_array.json, n); }
+        jval_t make( int n ) { return make((jint_t)n); }
+        jval_t make( size_t n ) { return make((jint_t)n); }
+        jval_t make( jnum_t n ) { return json_make_num(m_array.json, n); }
+        jval_t make( bool b ) { return json_make_bool(b); }
+        jval_t make( std::nullptr_t ) { return JNULL_VAL; }
+        jval_t make( const char* s ) { return json_make_str(m_array.json, s); }
+        jval_t make( const std::string& s ) { return json_make_strl(m_array.json, s.c_str(), s.length()); }
+
         operator const jarray_t () const { return m_array; }
         operator jarray_t () { return m_array; }
 
@@ -754,26 +925,47 @@ namespace ims
     {
         friend class val;
         friend class const_val;
+        friend class key;
     public:
-        static json from_str( const char* str )
+        static json from_str( const char* str, int flags = 0 )
         {
-            return from_buf(str, str ? strlen(str) : 0);
+            return from_buf(str, str ? strlen(str) : 0, flags);
         }
 
-        static json from_str( const std::string& str )
+        static json from_str( const std::string& str, int flags = 0 )
         {
-            return from_buf(str.data(), str.size());
+            return from_buf(str.data(), str.size(), flags);
         }
 
         template < typename CHAR_TYPE >
-        static json from_buf( const std::vector<CHAR_TYPE>& buf )
+        static json from_buf( const std::vector<CHAR_TYPE>& buf, int flags = 0 )
         {
-            return from_buf( static_cast<char*>(buf.data()), buf.size() );
+            return from_buf( static_cast<char*>(buf.data()), buf.size(), flags );
         }
 
-        static json from_buf( const void* buf, size_t buflen )
+        static json from_buf( const void* buf, size_t buflen, int flags = 0 )
+        {
+            json jsn(flags);
+            jerr_t err;
+            if (json_load_buf(&jsn.m_jsn, buf, buflen, &err) != 0)
+            {
+                jsn.clear(); // just in case...
+                throw std::runtime_error(err.msg);
+            }
+            return jsn;
+        }
+
+        /**
+            Parses a doc that looks strings up in a shared, frozen dictionary
+            first. The dictionary must outlive the returned doc.
+            @see json_init_dict
+        */
+        static json from_buf( const void* buf, size_t buflen, const jdict_t* dict, int flags = 0 )
         {
             json jsn;
+            json_destroy(&jsn.m_jsn);
+            json_init_dict(&jsn.m_jsn, dict, flags);
+
             jerr_t err;
             if (json_load_buf(&jsn.m_jsn, buf, buflen, &err) != 0)
             {
@@ -783,9 +975,39 @@ namespace ims
             return jsn;
         }
 
-        static json from_file( const std::string& path )
+        static json from_str( const std::string& str, const jdict_t* dict, int flags = 0 )
+        {
+            return from_buf(str.data(), str.size(), dict, flags);
+        }
+
+        /**
+            Parses a doc that keeps its strings in a concurrent table shared
+            with docs on other threads. The table must outlive the returned doc.
+            @see json_init_cmap
+        */
+        static json from_buf( const void* buf, size_t buflen, jcmap_t* map, int flags = 0 )
         {
             json jsn;
+            json_destroy(&jsn.m_jsn);
+            json_init_cmap(&jsn.m_jsn, map, flags);
+
+            jerr_t err;
+            if (json_load_buf(&jsn.m_jsn, buf, buflen, &err) != 0)
+            {
+                jsn.clear(); // just in case...
+                throw std::runtime_error(err.msg);
+            }
+            return jsn;
+        }
+
+        static json from_str( const std::string& str, jcmap_t* map, int flags = 0 )
+        {
+            return from_buf(str.data(), str.size(), map, flags);
+        }
+
+        static json from_file( const std::string& path, int flags = 0 )
+        {
+            json jsn(flags);
             jerr_t err;
             if (json_load_path(&jsn.m_jsn, path.c_str(), &err) != 0)
             {
@@ -815,6 +1037,15 @@ namespace ims
             json_init(&m_jsn);
         }
 
+        /**
+            Creates an empty json doc with the given document flags.
+            @see JFLAG_LAZY_NUMS
+        */
+        explicit json( int flags )
+        {
+            json_init_flags(&m_jsn, flags);
+        }
+
         ~json()
         {
             json_destroy(&m_jsn);
@@ -987,6 +1218,15 @@ namespace ims
         */
         void clear() { json_clear(&m_jsn); }
 
+        /**
+            Collects values no longer reachable from the root. Invalidates 
+            every obj, array and key taken from this doc before.
+            
+            @see json_gc
+            @return the number of bytes released.
+        */
+        size_t gc() { return json_gc(&m_jsn); }
+
         friend std::ostream& operator<< ( std::ostream& os, const json& j );
         friend std::istream& operator>> ( std::istream& is, json& j );
 
@@ -994,11 +1234,43 @@ namespace ims
         json_t m_jsn;
     };
 
+    //--------------------------------------------------------------------------
+    /**
+        A key resolved against a json document once, for looking it up in many
+        objects without hashing it each time.
+        
+        @code
+        ims::key street(jsn, "STREET");
+        for ( const obj& props : all_properties )
+        {
+            auto name = static_cast<std::string>(props[street]);
+        }
+        @endcode
+        
+        @see jkey_resolve
+    */
+    class key
+    {
+    public:
+        key( const json& jsn, const std::string& k )
+            : m_key(jkey_resolve(&jsn.m_jsn, k.c_str(), k.length()))
+        {}
+
+        key( const obj& o, const std::string& k )
+            : m_key(jkey_resolve(jobj_get_json(o.m_obj), k.c_str(), k.length()))
+        {}
+
+        operator jkey_t () const { return m_key; }
+
+    private:
+        jkey_t m_key;
+    };
+
     //--------------------------------------------------------------------------
     class val
     {
-        friend class obj::setter;
-        friend class array;
+        friend class ims::obj::setter;
+        friend class ims::array;
     public:
         using array = std::vector<val>;
         using obj = std::map<std::string, val>;
@@ -1494,6 +1766,29 @@ namespace ims
         return (*it).second;
     }
 
+    //--------------------------------------------------------------------------
+    inline obj::iterator obj::find( const class key& k ) const
+    {
+        size_t idx = jobj_find_key_idx(m_obj, k);
+        if (idx == SIZE_MAX)
+        {
+            return end();
+        }
+        return iterator(*this, idx);
+    }
+
+    //--------------------------------------------------------------------------
+    inline const_val obj::operator[] ( const class key& k ) const
+    {
+        auto it = find(k);
+        if (it == end())
+        {
+            return const_val(jobj_get_json(m_obj), JNULL_VAL);
+        }
+
+        return (*it).second;
+    }
+
     //--------------------------------------------------------------------------
     template < typename T >
     inline T obj::get( const std::string& key, const T& def ) const
@@ -1571,7 +1866,7 @@ namespace ims
             auto rt = (*it).second;
             if (rt.is_obj())
             {
-                auto obj = static_cast<const ims::obj&>(rt);
+                auto obj = static_cast<ims::obj>(rt);
                 auto it = obj.findr(key.substr(idx+1));
 //                return it;
                 return (it == obj.end()) ? end() : it;
@@ -1612,7 +1907,651 @@ namespace ims
         const char* key = jobj_get(m_parent, m_idx, &val, &klen);
         return std::make_pair(std::string(key, klen), const_val(jsn, val) );
     }
+
+    //--------------------------------------------------------------------------
+    /**
+        A single bound field: the json key and the member it is read into.
+        Normally created with IMS_FIELD or IMS_FIELD_AS inside of IMS_BIND.
+    */
+    template < typename T, typename M >
+    struct field
+    {
+        using type = M;
+
+        const char* name;
+        size_t len;
+        M T::* member;
+    };
+
+    //--------------------------------------------------------------------------
+    template < typename T, typename M, size_t N >
+    constexpr field<T,M> make_field( const char (&name)[N], M T::* member )
+    {
+        return field<T,M>{ name, N-1, member };
+    }
+
+    //--------------------------------------------------------------------------
+    /**
+        Describes the fields of a bindable type. Specialize this with the
+        IMS_BIND macro, e.g.
+
+            struct point { double x, y; };
+            IMS_BIND(point, IMS_FIELD(x), IMS_FIELD(y))
+
+        The specialization must provide a static constexpr fields() function
+        which returns a std::tuple of ims::field.
+    */
+    template < typename T >
+    struct binding;
+
+    namespace detail
+    {
+        //----------------------------------------------------------------------
+        template < typename T, typename = void >
+        struct is_bound : std::false_type {};
+
+        template < typename T >
+        struct is_bound<T, std::void_t<decltype(binding<T>::fields())>> : std::true_type {};
+
+        template < typename T >
+        struct is_vector : std::false_type {};
+
+        template < typename T, typename A >
+        struct is_vector<std::vector<T, A>> : std::true_type {};
+
+        template < typename T >
+        struct is_optional : std::false_type {};
+
+        template < typename T >
+        struct is_optional<std::optional<T>> : std::true_type {};
+
+        template < typename T >
+        struct dependent_false : std::false_type {};
+
+        //----------------------------------------------------------------------
+        /**
+            Minimal pull reader used by ims::bind. Reads directly from the
+            caller's buffer, no json_t is ever built.
+        */
+        class reader
+        {
+        public:
+            reader( const char* buf, size_t blen )
+                : m_beg(buf)
+                , m_cur(buf)
+                , m_end(buf + blen)
+            {}
+
+            [[noreturn]] void fail( const char* msg ) const
+            {
+                size_t line = 1, col = 1;
+                for ( const char* p = m_beg; p < m_cur; p++ )
+                {
+                    if (*p == '\n') { line++; col = 1; }
+                    else col++;
+                }
+                throw std::runtime_error(std::string(msg) + " (line " + std::to_string(line) + ", col " + std::to_string(col) + ")");
+            }
+
+            char peek()
+            {
+                while ( m_cur < m_end && (*m_cur == ' ' || *m_cur == '\t' || *m_cur == '\n' || *m_cur == '\r') )
+                    m_cur++;
+                return (m_cur < m_end) ? *m_cur : '\0';
+            }
+
+            void expect( char ch, const char* msg )
+            {
+                if (peek() != ch) fail(msg);
+                m_cur++;
+            }
+
+            bool consume( char ch )
+            {
+                if (peek() != ch) return false;
+                m_cur++;
+                return true;
+            }
+
+            void finish()
+            {
+                if (peek() != '\0' || m_cur != m_end) fail("unexpected data after the root value");
+            }
+
+            bool read_null()
+            {
+                if (peek() != 'n') return false;
+                literal("null", 4);
+                return true;
+            }
+
+            bool read_bool()
+            {
+                switch (peek())
+                {
+                    case 't': literal("true", 4); return true;
+                    case 'f': literal("false", 5); return false;
+                    default: fail("expected a boolean");
+                }
+            }
+
+            /**
+                Reads the raw lexeme of a json number and validates its syntax.
+                @param integral set to true if the number has no fraction or exponent.
+            */
+            std::pair<const char*, size_t> read_num( bool& integral )
+            {
+                peek();
+                const char* beg = m_cur;
+                integral = true;
+                if (m_cur < m_end && *m_cur == '-') m_cur++;
+                if (m_cur < m_end && *m_cur == '0') m_cur++;
+                else if (!digits()) fail("expected a number");
+                if (m_cur < m_end && *m_cur == '.')
+                {
+                    m_cur++;
+                    integral = false;
+                    if (!digits()) fail("number truncated after '.'");
+                }
+                if (m_cur < m_end && (*m_cur == 'e' || *m_cur == 'E'))
+                {
+                    m_cur++;
+                    integral = false;
+                    if (m_cur < m_end && (*m_cur == '+' || *m_cur == '-')) m_cur++;
+                    if (!digits()) fail("number truncated at 'e'");
+                }
+                return std::make_pair(beg, static_cast<size_t>(m_cur - beg));
+            }
+
+            /**
+                Reads an object key. Keys without escapes are returned as a
+                pointer directly into the input, so no copy is made.
+            */
+            std::pair<const char*, size_t> read_key()
+            {
+                if (peek() != '"') fail("expected a string key");
+                const char* beg = ++m_cur;
+                while ( m_cur < m_end )
+                {
+                    unsigned char ch = static_cast<unsigned char>(*m_cur);
+                    if (ch == '"')
+                    {
+                        return std::make_pair(beg, static_cast<size_t>(m_cur++ - beg));
+                    }
+                    if (ch == '\\' || ch < 0x20 || ch >= 0x80) break;
+                    m_cur++;
+                }
+
+                // slow path, the key needs decoding
+                m_cur = beg - 1;
+                read_str(m_key);
+                return std::make_pair(m_key.data(), m_key.size());
+            }
+
+            void read_str( std::string& out )
+            {
+                if (peek() != '"') fail("expected a string");
+                m_cur++;
+                out.clear();
+
+                const char* run = m_cur;
+                while ( m_cur < m_end )
+                {
+                    unsigned char ch = static_cast<unsigned char>(*m_cur);
+                    if (ch == '"')
+                    {
+                        out.append(run, m_cur++);
+                        return;
+                    }
+                    else if (ch == '\\')
+                    {
+                        out.append(run, m_cur++);
+                        escape(out);
+                        run = m_cur;
+                    }
+                    else if (ch < 0x20)
+                    {
+                        fail("control character found in string");
+                    }
+                    else if (ch >= 0x80)
+                    {
+                        utf8();
+                    }
+                    else
+                    {
+                        m_cur++;
+                    }
+                }
+                fail("string terminated unexpectedly");
+            }
+
+            /**
+                Skips over a value of any type. Iterative so that deeply nested
+                unknown values cannot exhaust the stack.
+            */
+            void skip()
+            {
+                std::vector<char> stack;
+                do
+                {
+                    char ch = peek();
+                    switch (ch)
+                    {
+                        case '{':
+                            m_cur++;
+                            if (consume('}')) break;
+                            stack.push_back('}');
+                            skip_key();
+                            continue;
+
+                        case '[':
+                            m_cur++;
+                            if (consume(']')) break;
+                            stack.push_back(']');
+                            continue;
+
+                        case '"': skip_str(); break;
+                        case 't': literal("true", 4); break;
+                        case 'f': literal("false", 5); break;
+                        case 'n': literal("null", 4); break;
+                        default:
+                        {
+                            bool integral;
+                            read_num(integral);
+                            break;
+                        }
+                    }
+
+                    // close out any finished containers
+                    while ( !stack.empty() )
+                    {
+                        if (consume(','))
+                        {
+                            if (stack.back() == '}') skip_key();
+                            break;
+                        }
+                        expect(stack.back(), "missing ',' separator");
+                        stack.pop_back();
+                    }
+                }
+                while ( !stack.empty() );
+            }
+
+        private:
+            bool digits()
+            {
+                const char* beg = m_cur;
+                while ( m_cur < m_end && *m_cur >= '0' && *m_cur <= '9' ) m_cur++;
+                return m_cur != beg;
+            }
+
+            void literal( const char* lit, size_t len )
+            {
+                if (static_cast<size_t>(m_end - m_cur) < len || memcmp(m_cur, lit, len) != 0)
+                    fail("invalid literal");
+                m_cur += len;
+            }
+
+            void skip_key()
+            {
+                skip_str();
+                expect(':', "expected separator ':' after key");
+            }
+
+            // validates a string like read_str without decoding it anywhere
+            void skip_str()
+            {
+                if (peek() != '"') fail("expected a string");
+                m_cur++;
+                while ( m_cur < m_end )
+                {
+                    unsigned char ch = static_cast<unsigned char>(*m_cur);
+                    if (ch == '"')
+                    {
+                        m_cur++;
+                        return;
+                    }
+                    else if (ch == '\\')
+                    {
+                        m_cur++;
+                        unescape();
+                    }
+                    else if (ch < 0x20)
+                    {
+                        fail("control character found in string");
+                    }
+                    else if (ch >= 0x80)
+                    {
+                        utf8();
+                    }
+                    else
+                    {
+                        m_cur++;
+                    }
+                }
+                fail("string terminated unexpectedly");
+            }
+
+            unsigned hex4()
+            {
+                if (m_end - m_cur < 4) fail("invalid unicode");
+                unsigned val = 0;
+                for ( int i = 0; i < 4; i++ )
+                {
+                    char ch = *m_cur++;
+                    val <<= 4;
+                    if (ch >= '0' && ch <= '9') val |= ch - '0';
+                    else if (ch >= 'a' && ch <= 'f') val |= ch - 'a' + 10;
+                    else if (ch >= 'A' && ch <= 'F') val |= ch - 'A' + 10;
+                    else fail("invalid unicode hex digit");
+                }
+                return val;
+            }
+
+            // validates the escape sequence after a '\\' and returns its codepoint
+            unsigned unescape()
+            {
+                if (m_cur >= m_end) fail("string terminated unexpectedly");
+                switch (*m_cur++)
+                {
+                    case '"':  return '"';
+                    case '\\': return '\\';
+                    case '/':  return '/';
+                    case 'b':  return '\b';
+                    case 'f':  return '\f';
+                    case 'n':  return '\n';
+                    case 'r':  return '\r';
+                    case 't':  return '\t';
+                    case 'u':
+                    {
+                        unsigned cp = hex4();
+                        if (cp >= 0xDC00 && cp <= 0xDFFF) fail("invalid utf8 codepoint");
+                        if (cp >= 0xD800 && cp <= 0xDBFF)
+                        {
+                            if (m_end - m_cur < 2 || m_cur[0] != '\\' || m_cur[1] != 'u') fail("invalid unicode");
+                            m_cur += 2;
+                            unsigned lo = hex4();
+                            if (lo < 0xDC00 || lo > 0xDFFF) fail("invalid utf8 codepoint in surrogate pair");
+                            cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                        }
+                        return cp;
+                    }
+                    default: m_cur--; fail("invalid escape sequence");
+                }
+            }
+
+            void escape( std::string& out )
+            {
+                unsigned cp = unescape();
+                if (cp < 0x80)
+                {
+                    out += static_cast<char>(cp);
+                }
+                else if (cp < 0x800)
+                {
+                    out += static_cast<char>(0xC0 | (cp >> 6));
+                    out += static_cast<char>(0x80 | (cp & 0x3F));
+                }
+                else if (cp < 0x10000)
+                {
+                    out += static_cast<char>(0xE0 | (cp >> 12));
+                    out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                    out += static_cast<char>(0x80 | (cp & 0x3F));
+                }
+                else
+                {
+                    out += static_cast<char>(0xF0 | (cp >> 18));
+                    out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+                    out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                    out += static_cast<char>(0x80 | (cp & 0x3F));
+                }
+            }
+
+            // validates a single multibyte utf8 sequence and steps over it
+            void utf8()
+            {
+                unsigned char ch = static_cast<unsigned char>(*m_cur);
+                size_t n;
+                unsigned cp;
+                if ((ch & 0xE0) == 0xC0) { n = 1; cp = ch & 0x1F; }
+                else if ((ch & 0xF0) == 0xE0) { n = 2; cp = ch & 0x0F; }
+                else if ((ch & 0xF8) == 0xF0) { n = 3; cp = ch & 0x07; }
+                else fail("invalid utf8 codepoint");
+
+                if (static_cast<size_t>(m_end - m_cur) <= n) fail("string terminated unexpectedly");
+                for ( size_t i = 1; i <= n; i++ )
+                {
+                    unsigned char c = static_cast<unsigned char>(m_cur[i]);
+                    if ((c & 0xC0) != 0x80) fail("invalid utf8 codepoint");
+                    cp = (cp << 6) | (c & 0x3F);
+                }
+
+                static const unsigned MIN[] = { 0, 0x80, 0x800, 0x10000 };
+                if (cp < MIN[n] || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) fail("invalid utf8 codepoint");
+                m_cur += n + 1;
+            }
+
+            const char* m_beg;
+            const char* m_cur;
+            const char* m_end;
+            std::string m_key;
+        };
+
+        //----------------------------------------------------------------------
+        template < typename T >
+        void read_value( reader& rd, T& out );
+
+        //----------------------------------------------------------------------
+        template < typename T >
+        void read_int( reader& rd, T& out )
+        {
+            bool integral;
+            auto lex = rd.read_num(integral);
+            if (!integral) rd.fail("expected an integer");
+
+            char buf[32];
+            if (lex.second >= sizeof(buf)) rd.fail("integer overflow");
+            memcpy(buf, lex.first, lex.second);
+            buf[lex.second] = '\0';
+
+            errno = 0;
+            if (std::is_signed<T>::value)
+            {
+                long long v = strtoll(buf, nullptr, 10);
+                if (errno == ERANGE || v < std::numeric_limits<T>::min() || v > std::numeric_limits<T>::max())
+                    rd.fail("integer overflow");
+                out = static_cast<T>(v);
+            }
+            else
+            {
+                if (buf[0] == '-') rd.fail("expected an unsigned integer");
+                unsigned long long v = strtoull(buf, nullptr, 10);
+                if (errno == ERANGE || v > std::numeric_limits<T>::max())
+                    rd.fail("integer overflow");
+                out = static_cast<T>(v);
+            }
+        }
+
+        //----------------------------------------------------------------------
+        template < typename T >
+        void read_float( reader& rd, T& out )
+        {
+            bool integral;
+            auto lex = rd.read_num(integral);
+
+            char buf[64];
+            std::string big;
+            const char* str = buf;
+            if (lex.second < sizeof(buf))
+            {
+                memcpy(buf, lex.first, lex.second);
+                buf[lex.second] = '\0';
+            }
+            else
+            {
+                big.assign(lex.first, lex.second);
+                str = big.c_str();
+            }
+
+            double v = strtod(str, nullptr);
+            if (std::isinf(v)) rd.fail("numeric overflow");
+            out = static_cast<T>(v);
+        }
+
+        //----------------------------------------------------------------------
+        /**
+            Matches a key against the bound fields. Every name length is a
+            compile time constant so the chain reduces to a jump on the length
+            and first byte, the memcmp only runs for a likely match.
+        */
+        template < typename T, typename F, size_t... I >
+        bool match_field( const F& fields, reader& rd, T& out, const std::pair<const char*, size_t>& key, std::index_sequence<I...> )
+        {
+            return ( ... || (
+                key.second == std::get<I>(fields).len &&
+                (key.second == 0 || (key.first[0] == std::get<I>(fields).name[0] && memcmp(key.first, std::get<I>(fields).name, key.second) == 0)) &&
+                (read_value(rd, out.*(std::get<I>(fields).member)), true)
+            ));
+        }
+
+        //----------------------------------------------------------------------
+        template < typename T >
+        void read_obj( reader& rd, T& out )
+        {
+            static constexpr auto FIELDS = binding<T>::fields();
+            using indices = std::make_index_sequence<std::tuple_size<decltype(FIELDS)>::value>;
+
+            rd.expect('{', "expected an object");
+            if (rd.consume('}')) return;
+            do
+            {
+                auto key = rd.read_key();
+                rd.expect(':', "expected separator ':' after key");
+                if (!match_field(FIELDS, rd, out, key, indices{}))
+                    rd.skip();
+            }
+            while ( rd.consume(',') );
+            rd.expect('}', "missing ',' separator");
+        }
+
+        //----------------------------------------------------------------------
+        template < typename T >
+        void read_value( reader& rd, T& out )
+        {
+            if constexpr (is_optional<T>::value)
+            {
+                if (rd.read_null())
+                {
+                    out.reset();
+                }
+                else
+                {
+                    out.emplace();
+                    read_value(rd, *out);
+                }
+            }
+            else if constexpr (std::is_same<T, bool>::value)
+            {
+                out = rd.read_bool();
+            }
+            else if constexpr (std::is_integral<T>::value)
+            {
+                read_int(rd, out);
+            }
+            else if constexpr (std::is_floating_point<T>::value)
+            {
+                read_float(rd, out);
+            }
+            else if constexpr (std::is_same<T, std::string>::value)
+            {
+                rd.read_str(out);
+            }
+            else if constexpr (is_vector<T>::value)
+            {
+                out.clear();
+                rd.expect('[', "expected an array");
+                if (rd.consume(']')) return;
+                do
+                {
+                    out.emplace_back();
+                    read_value(rd, out.back());
+                }
+                while ( rd.consume(',') );
+                rd.expect(']', "missing ',' separator");
+            }
+            else if constexpr (is_bound<T>::value)
+            {
+                read_obj(rd, out);
+            }
+            else
+            {
+                static_assert(dependent_false<T>::value, "type is not bindable, describe it with IMS_BIND");
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /**
+        Typed deserialization. Reads json straight into a C++ type described
+        with IMS_BIND without building a json_t. Supports bool, integral and
+        floating point types, std::string, std::vector, std::optional and
+        nested bound types. Unknown keys are skipped and missing keys leave the
+        member untouched. Errors are reported with std::runtime_error.
+
+            auto cfg = ims::bind<config>::from_str(text);
+    */
+    template < typename T >
+    struct bind
+    {
+        static T from_str( const char* str )
+        {
+            return from_buf(str, str ? strlen(str) : 0);
+        }
+
+        static T from_str( const std::string& str )
+        {
+            return from_buf(str.data(), str.size());
+        }
+
+        static T from_buf( const void* buf, size_t buflen )
+        {
+            T out{};
+            from_buf(buf, buflen, out);
+            return out;
+        }
+
+        static void from_buf( const void* buf, size_t buflen, T& out )
+        {
+            detail::reader rd(static_cast<const char*>(buf), buflen);
+            detail::read_value(rd, out);
+            rd.finish();
+        }
+    };
+
 }
 
+/*!
+    Describes the fields of TYPE for ims::bind. Must be used at global scope.
+    @param TYPE the fully qualified type to bind.
+    @param ... the bound fields, see IMS_FIELD and IMS_FIELD_AS.
+*/
+#define IMS_BIND(TYPE, ...) \
+    namespace ims { \
+        template <> struct binding<TYPE> { \
+            using bound_type = TYPE; \
+            static constexpr auto fields() { return std::make_tuple(__VA_ARGS__); } \
+        }; \
+    }
+
+/*!
+    Binds MEMBER to a key with the same name. Only valid inside IMS_BIND.
+*/
+#define IMS_FIELD(MEMBER) ::ims::make_field(#MEMBER, &bound_type::MEMBER)
+
+/*!
+    Binds MEMBER to the given KEY. Only valid inside IMS_BIND.
+*/
+#define IMS_FIELD_AS(MEMBER, KEY) ::ims::make_field(KEY, &bound_type::MEMBER)
+
 #endif // __cplusplus
 #endif // __json_hpp__
@@ -0,0 +1,651 @@
+/*!
+    @file bench.cpp
+    @author Brian Howard
+    @copyright
+    Copyright (c) 2015 InMotion Software, LLC.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+*/
+
+// timings of the hot paths, kept apart from the tests in main.cpp. Each
+// benchmark prints its numbers, the results are checked only as far as
+// needed to keep the work from being optimized away.
+
+#include <time.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h>
+#include "json.h"
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+
+#define btomb(bytes) (bytes / (double)(1024*1024))
+
+using namespace ims;
+
+static inline void log_debug( const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+    printf("\n");
+}
+
+#define LOG_FUNC() log_debug("starting benchmark: '%s'", __func__)
+
+// the checks must run in release builds too
+#define bench_check(COND) do { if (!(COND)) { log_debug("check failed: %s", #COND); exit(EXIT_FAILURE); } } while (0)
+
+//------------------------------------------------------------------------------
+template < typename F >
+double time_call( F func )
+{
+    static constexpr double CLOCKS_TO_SECS = 1.0 / (double)CLOCKS_PER_SEC;
+    clock_t start = clock();
+    func();
+    return (clock() - start) * CLOCKS_TO_SECS;
+}
+
+//------------------------------------------------------------------------------
+template < typename F >
+double time_wall( F func )
+{
+    // clock() adds up the cpu time of every thread
+    auto start = std::chrono::steady_clock::now();
+    func();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+//------------------------------------------------------------------------------
+static void get_fullpath( const char* path, char* buf, size_t blen )
+{
+    // get the current directory
+    char dbuf[255];
+    strncpy(dbuf, __FILE__, sizeof(dbuf));
+    dbuf[sizeof(dbuf)-1] = '\0';
+    char* dir = dirname(dbuf);
+
+    // get the full path of our json file
+    snprintf(buf, blen, "%s/%s", dir, path);
+    buf[blen-1] = '\0';
+}
+
+//------------------------------------------------------------------------------
+static json_t* load_str( const std::string& jstr, int flags )
+{
+    json_t* jsn = json_init_flags(json_new(), flags);
+    jerr_t err;
+    if (json_load_buf(jsn, jstr.data(), jstr.size(), &err) != 0)
+    {
+        jerr_fprint(stderr, &err);
+        exit(EXIT_FAILURE);
+    }
+    return jsn;
+}
+
+//------------------------------------------------------------------------------
+static inline uint64_t bench_rand( uint64_t& state )
+{
+    // xorshift64*, the same input every run
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1DULL;
+}
+
+//------------------------------------------------------------------------------
+static void bench_num_span()
+{
+    LOG_FUNC();
+
+    // summing coordinates of a large ring
+    static const size_t COUNT = 1000000;
+    std::string ring = "[";
+    for ( size_t i = 0; i < COUNT; i++ ) ring += (i ? ",[" : "[") + std::to_string(i * 0.25 + 0.125) + "," + std::to_string(i * 0.5 + 0.25) + "]";
+    ring += "]";
+    json_t* big = load_str(ring, 0);
+    jarray_t coords = json_root_array(big);
+
+    double sum1 = 0, sum2 = 0;
+    double by_val = time_wall([&]()
+    {
+        for ( size_t i = 0; i < COUNT; i++ )
+        {
+            jarray_t pt = jarray_get_array(coords, i);
+            sum1 += jarray_get_num(pt, 0) + jarray_get_num(pt, 1);
+        }
+    });
+    double by_span = time_wall([&]()
+    {
+        for ( size_t i = 0; i < COUNT; i++ )
+        {
+            const jnum_t* pt;
+            size_t len;
+            jarray_get_num_span(jarray_get_array(coords, i), &pt, &len);
+            sum2 += pt[0] + pt[1];
+        }
+    });
+    bench_check(sum1 == sum2);
+    log_debug("%zu points, by value: %.2f ms, by span: %.2f ms", COUNT, by_val * 1000.0, by_span * 1000.0);
+    json_free(big);
+}
+
+//------------------------------------------------------------------------------
+static void bench_columns()
+{
+    LOG_FUNC();
+
+    // summing a field of many records
+    static const size_t COUNT = 300000;
+    std::string records = "[";
+    for ( size_t i = 0; i < COUNT; i++ )
+    {
+        records += (i ? ",{" : "{");
+        records += "\"type\":\"Feature\",\"properties\":{\"id\":" + std::to_string(i) + ",\"name\":\"n" + std::to_string(i % 100);
+        records += "\",\"area\":" + std::to_string(i * 0.5) + "}}";
+    }
+    records += "]";
+    json_t* big = load_str(records, 0);
+    jarray_t array = json_root_array(big);
+
+    double sum1 = 0, sum2 = 0;
+    double by_obj = time_wall([&]()
+    {
+        for ( size_t i = 0; i < COUNT; i++ )
+        {
+            sum1 += jobj_find_num(jobj_find_obj(jarray_get_obj(array, i), "properties"), "area");
+        }
+    });
+    jtable_t* table = nullptr;
+    double build = time_wall([&]() { table = json_to_columns(array); });
+    double by_col = time_wall([&]()
+    {
+        size_t col = jtable_find_col(table, "properties/area");
+        const jnum_t* nums = jtable_col_nums(table, col);
+        for ( size_t i = 0; i < COUNT; i++ ) sum2 += nums[i];
+    });
+    bench_check(sum1 == sum2);
+    log_debug("%zu records, by object: %.2f ms, by column: %.2f ms (%.2f ms to build)", COUNT, by_obj * 1000.0, by_col * 1000.0, build * 1000.0);
+    jtable_free(table);
+    json_free(big);
+}
+
+//------------------------------------------------------------------------------
+static double worst_strmap_insert( int flags, size_t count )
+{
+    json_t* jsn = json_init_flags(json_new(), flags);
+    jarray_t array = json_root_array(jsn);
+
+    char buf[64];
+    double worst = 0;
+    for ( size_t i = 0; i < count; i++ )
+    {
+        size_t len = (size_t)snprintf(buf, sizeof(buf), "%zx-string", i*2654435761u);
+        double secs = time_wall([&]{ jarray_add_strl(array, buf, len); });
+        if (secs > worst) worst = secs;
+    }
+    bench_check(jarray_len(array) == count);
+
+    json_free(jsn); jsn = NULL;
+    return worst;
+}
+
+//------------------------------------------------------------------------------
+static void bench_incremental_rehash()
+{
+    LOG_FUNC();
+
+    static const size_t COUNT = 2000000;
+    double eager = worst_strmap_insert(0, COUNT);
+    double incremental = worst_strmap_insert(JFLAG_INCREMENTAL_REHASH, COUNT);
+    log_debug("slowest insert of %zu strings: %.3f ms at once, %.3f ms incremental", COUNT, eager * 1e3, incremental * 1e3);
+}
+
+//------------------------------------------------------------------------------
+static void bench_obj_index()
+{
+    LOG_FUNC();
+
+    // a dictionary style object with short (packed) and long keys
+    static const size_t COUNT = 15000;
+    static const size_t ROUNDS = 200000;
+    json_t* jsn = json_new();
+    jobj_t root = json_root_obj(jsn);
+    char key[32];
+    for ( size_t i = 0; i < COUNT; i++ )
+    {
+        snprintf(key, sizeof(key), "%zx", i);
+        jobj_add_int(root, key, (jint_t)i);
+    }
+
+    // lookups no longer depend on the position of the key
+    jint_t sum = 0;
+    double secs = time_wall([&]()
+    {
+        for ( size_t i = 0; i < ROUNDS; i++ )
+        {
+            snprintf(key, sizeof(key), "%zx", (i * 7919) % COUNT);
+            sum += jobj_find_int(root, key);
+        }
+    });
+    bench_check(sum > 0);
+    log_debug("%zu lookups in %zu keys: %.2f ms", ROUNDS, jobj_len(root), secs * 1000.0);
+
+    json_free(jsn);
+}
+
+//------------------------------------------------------------------------------
+static void bench_obj_keys()
+{
+    LOG_FUNC();
+
+    // searching a mid size object for its last key
+    static const size_t ROUNDS = 2000000;
+    std::string jstr = "{";
+    for ( int i = 0; i < 20; i++ ) jstr += "\"long_key_" + std::to_string(i) + "\":" + std::to_string(i) + ",";
+    jstr += "\"\\u0001\":-1,\"\\u0002\":-2,\"abc\":-3}";
+    json_t* jsn = load_str(jstr, 0);
+    jobj_t root = json_root_obj(jsn);
+
+    size_t found = 0;
+    double secs = time_wall([&]()
+    {
+        for ( size_t i = 0; i < ROUNDS; i++ )
+        {
+            found += jobj_findl_idx(root, "long_key_19", 11) == 19;
+        }
+    });
+    bench_check(found == ROUNDS);
+    log_debug("%zu searches of %zu keys: %.2f ms", ROUNDS, jobj_len(root), secs * 1000.0);
+
+    json_free(jsn);
+}
+
+//------------------------------------------------------------------------------
+static void bench_key()
+{
+    LOG_FUNC();
+
+    // geojson style features, each with a few properties
+    static const size_t COUNT = 200000;
+    std::string jstr = "{\"type\":\"FeatureCollection\",\"features\":[";
+    char buf[256];
+    for ( size_t i = 0; i < COUNT; i++ )
+    {
+        snprintf(buf, sizeof(buf), "%s{\"type\":\"Feature\",\"properties\":{\"ID\":%zu,\"STREET\":\"street %zu\",\"CITY\":\"SF\"}}",
+                 i ? "," : "", i, i % 1000);
+        jstr += buf;
+    }
+    jstr += "]}";
+
+    json_t* c = load_str(jstr, 0);
+    jarray_t features = jobj_find_array(json_root_obj(c), "features");
+    jkey_t props = jkey_resolve(c, "properties", strlen("properties"));
+    jkey_t street = jkey_resolve(c, "STREET", strlen("STREET"));
+
+    size_t total1 = 0, total2 = 0;
+    double by_str = time_wall([&]()
+    {
+        for ( size_t i = 0; i < COUNT; i++ )
+        {
+            jobj_t p = jobj_find_obj(jarray_get_obj(features, i), "properties");
+            size_t len;
+            json_get_strl(c, jobj_find(p, "STREET"), &len);
+            total1 += len;
+        }
+    });
+    double by_key = time_wall([&]()
+    {
+        for ( size_t i = 0; i < COUNT; i++ )
+        {
+            jobj_t p = json_get_obj(c, jobj_find_key(jarray_get_obj(features, i), props));
+            size_t len;
+            json_get_strl(c, jobj_find_key(p, street), &len);
+            total2 += len;
+        }
+    });
+    bench_check(total1 == total2);
+    log_debug("properties.STREET of %zu features, by string: %.2f ms, by key: %.2f ms", COUNT, by_str * 1000.0, by_key * 1000.0);
+
+    json_free(c);
+}
+
+//------------------------------------------------------------------------------
+static void bench_cmap()
+{
+    LOG_FUNC();
+
+    // keys of a typical document, a small hot set repeated over and over and
+    // a long tail, zipf distributed. 1 in 16 strings is unique.
+    static const size_t VOCAB = 5000;
+    static const size_t OPS = 2000000;
+
+    uint64_t state = 0x243F6A8885A308D3ULL;
+    std::vector<std::string> vocab;
+    for ( size_t i = 0; i < VOCAB; i++ )
+    {
+        std::string key = "k";
+        size_t len = 3 + bench_rand(state) % 18;
+        while (key.size() < len) key += (char)('a' + bench_rand(state) % 26);
+        vocab.push_back(key + std::to_string(i));
+    }
+
+    std::vector<double> cdf(VOCAB);
+    double sum = 0;
+    for ( size_t i = 0; i < VOCAB; i++ ) cdf[i] = (sum += 1.0 / (i + 1));
+
+    std::vector<std::string> ops;
+    ops.reserve(OPS);
+    for ( size_t i = 0; i < OPS; i++ )
+    {
+        if (i % 16 == 0)
+        {
+            ops.push_back("unique-" + std::to_string(i));
+            continue;
+        }
+        double r = (bench_rand(state) >> 11) * (1.0 / 9007199254740992.0) * sum;
+        ops.push_back(vocab[std::lower_bound(cdf.begin(), cdf.end(), r) - cdf.begin()]);
+    }
+
+    // single threaded intern table for reference
+    {
+        json_t* jsn = json_new();
+        jarray_t array = json_root_array(jsn);
+        double secs = time_wall([&]
+        {
+            for ( auto& s : ops ) jarray_add_strl(array, s.data(), s.size());
+        });
+        log_debug("jmap_t     1 thread : %6.1f Mops/s", OPS / secs / 1e6);
+        json_free(jsn); jsn = NULL;
+    }
+
+    for ( size_t nthreads = 1; nthreads <= 32; nthreads *= 2 )
+    {
+        jcmap_t* map = jcmap_new();
+
+        // the same total work split across the threads
+        std::vector<std::thread> threads;
+        double secs = time_wall([&]
+        {
+            for ( size_t t = 0; t < nthreads; t++ )
+            {
+                threads.emplace_back([&, t]
+                {
+                    for ( size_t i = t; i < OPS; i += nthreads )
+                    {
+                        jcmap_addl(map, ops[i].data(), ops[i].size());
+                    }
+                });
+            }
+            for ( auto& th : threads ) th.join();
+        });
+
+        log_debug("jcmap_t %4zu threads: %6.1f Mops/s, %zu strings", nthreads, OPS / secs / 1e6, jcmap_len(map));
+        jcmap_free(map); map = NULL;
+    }
+    log_debug("hardware threads: %u", std::thread::hardware_concurrency());
+}
+
+//------------------------------------------------------------------------------
+static void bench_pool()
+{
+    LOG_FUNC();
+
+    // a fresh doc per request against docs handed out by a pool
+    static const size_t COUNT = 100000;
+    const char* doc = R"({"id":"4c1c7f1e-6a5b-4bd4-8d43-33b1a6f0e2a9","user":{"name":"someone","roles":["a","b","c","d","e","f","g"]},"count":12,"ratio":0.5})";
+    const size_t dlen = strlen(doc);
+
+    json_pool_t* pool = json_pool_new(NULL, 0);
+    jerr_t err;
+    size_t failed = 0;
+
+    double fresh = time_wall([&]
+    {
+        for ( size_t i = 0; i < COUNT; i++ )
+        {
+            json_t* j = json_new();
+            failed += json_load_buf(j, doc, dlen, &err) != 0;
+            json_free(j);
+        }
+    });
+
+    double pooled = time_wall([&]
+    {
+        for ( size_t i = 0; i < COUNT; i++ )
+        {
+            json_t* j = json_pool_acquire(pool);
+            failed += json_load_buf(j, doc, dlen, &err) != 0;
+            json_pool_release(pool, j);
+        }
+    });
+    bench_check(failed == 0);
+    log_debug("json_new/json_free: %.0f docs/s, pool: %.0f docs/s", COUNT / fresh, COUNT / pooled);
+
+    json_pool_free(pool); pool = NULL;
+}
+
+//------------------------------------------------------------------------------
+static void collect_strs( json_t* jsn, jval_t val, std::vector<std::string>& keys, std::vector<std::string>& strs )
+{
+    switch (jval_type(val))
+    {
+        case JTYPE_STR:
+        {
+            size_t len;
+            const char* str = json_get_strl(jsn, val, &len);
+            strs.emplace_back(str, len);
+            break;
+        }
+
+        case JTYPE_ARRAY:
+        {
+            jarray_t array = json_get_array(jsn, val);
+            for ( size_t i = 0; i < jarray_len(array); i++ )
+            {
+                collect_strs(jsn, jarray_get(array, i), keys, strs);
+            }
+            break;
+        }
+
+        case JTYPE_OBJ:
+        {
+            jobj_t obj = json_get_obj(jsn, val);
+            for ( size_t i = 0; i < jobj_len(obj); i++ )
+            {
+                jval_t child;
+                size_t klen;
+                const char* key = jobj_get(obj, i, &child, &klen);
+                keys.emplace_back(key, klen);
+                collect_strs(jsn, child, keys, strs);
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+//------------------------------------------------------------------------------
+static void hash_strs( const char* name, const std::vector<std::string>& strs )
+{
+    static const size_t ROUNDS = 5000;
+
+    size_t bytes = 0;
+    for ( auto& s : strs ) bytes += s.size();
+
+    uint32_t sum = 0;
+    double secs = time_call([&]
+    {
+        for ( size_t r = 0; r < ROUNDS; r++ )
+        {
+            for ( auto& s : strs ) sum += json_hash(s.data(), s.size(), (uint32_t)r);
+        }
+    });
+
+    double n = (double)(strs.size() * ROUNDS);
+    log_debug("%-8s %6zu strings, avg len %5.1f: %6.1f ns/string, %7.1f MB/s (%x)", name, strs.size(),
+              bytes / (double)strs.size(), secs * 1e9 / n, btomb(bytes * ROUNDS) / secs, sum);
+}
+
+//------------------------------------------------------------------------------
+static void bench_hash()
+{
+    LOG_FUNC();
+
+    // use the key and string lengths found in a real document
+    char path[255];
+    get_fullpath("small.json", path, sizeof(path));
+
+    json_t* jsn = json_new();
+    jerr_t err;
+    if (json_load_path(jsn, path, &err) != 0)
+    {
+        jerr_fprint(stderr, &err);
+        exit(EXIT_FAILURE);
+    }
+
+    std::vector<std::string> keys, strs;
+    collect_strs(jsn, json_root(jsn), keys, strs);
+    json_free(jsn); jsn = NULL;
+
+    hash_strs("keys", keys);
+    hash_strs("strings", strs);
+}
+
+//------------------------------------------------------------------------------
+static void bench_mutation()
+{
+    LOG_FUNC();
+
+    // updating one field of a cached doc over and over
+    static const size_t COUNT = 1000000;
+    json_t* cache = json_new();
+    jobj_t obj = json_root_obj(cache);
+    for ( int i = 0; i < 1000; i++ ) jobj_add_int(obj, ("key" + std::to_string(i)).c_str(), i);
+    double secs = time_wall([&]()
+    {
+        for ( size_t i = 0; i < COUNT; i++ ) jobj_set_num(obj, "key500", (jnum_t)i);
+    });
+    bench_check(jobj_find_num(obj, "key500") == COUNT - 1);
+    size_t reclaimed = json_gc(cache);
+    log_debug("%zu updates: %.1f ns each, %zu bytes collected", COUNT, secs * 1e9 / COUNT, reclaimed);
+    json_free(cache);
+}
+
+//------------------------------------------------------------------------------
+static void bench_bulk()
+{
+    LOG_FUNC();
+
+    // building a large array one value at a time and all at once
+    static const size_t COUNT = 1000000;
+    std::vector<jnum_t> src(COUNT);
+    for ( size_t i = 0; i < COUNT; i++ ) src[i] = i * 0.25;
+
+    json_t* jsn = json_new();
+    jarray_t a = json_root_array(jsn);
+    double one = time_wall([&]()
+    {
+        for ( size_t i = 0; i < COUNT; i++ ) jarray_add_num(a, src[i]);
+    });
+    json_free(jsn);
+
+    jsn = json_new();
+    a = json_root_array(jsn);
+    double many = time_wall([&]()
+    {
+        jarray_add_nums(a, src.data(), COUNT);
+    });
+    bench_check(jarray_len(a) == COUNT && jarray_get_num(a, COUNT - 1) == src.back());
+    json_free(jsn);
+    log_debug("%zu numbers, one at a time: %.2f ms, at once: %.2f ms", COUNT, one * 1000.0, many * 1000.0);
+}
+
+//------------------------------------------------------------------------------
+static void bench_shapes()
+{
+    LOG_FUNC();
+
+    // looking a field up in every record of a doc with shared keys
+    static const size_t COUNT = 100000;
+    std::string jstr = "{\"rows\":[";
+    for ( size_t i = 0; i < COUNT; i++ )
+    {
+        std::string n = std::to_string(i);
+        jstr += (i ? ",{\"id\":" : "{\"id\":") + n + ",\"name\":\"n" + n + "\"";
+        jstr += ",\"x\":1.5,\"y\":2.5,\"a long key name\":true,\"kind\":\"point\",\"tags\":[],\"z\":null}";
+    }
+    jstr += "]}";
+
+    json_t* jsn = load_str(jstr, 0);
+    jarray_t rows = jobj_find_array(json_root_obj(jsn), "rows");
+    const size_t bytes = json_get_mem(jsn).objs.reserved;
+
+    jkey_t name = jkey_resolve(jsn, "name", 4);
+    size_t found = 0;
+    double secs = time_wall([&]()
+    {
+        for ( int pass = 0; pass < 10; pass++ )
+        {
+            for ( size_t i = 0; i < COUNT; i++ ) found += jobj_find_key_idx(jarray_get_obj(rows, i), name) != SIZE_MAX;
+        }
+    });
+    bench_check(found == COUNT * 10);
+    log_debug("%zu records: %.1f ns per lookup, %zu bytes of objects", COUNT, secs * 1e9 / (COUNT * 10), bytes);
+    json_free(jsn);
+}
+
+typedef void (*bench_func)(void);
+
+//------------------------------------------------------------------------------
+bench_func BENCHES[] =
+{
+    bench_num_span,
+    bench_columns,
+    bench_incremental_rehash,
+    bench_obj_index,
+    bench_obj_keys,
+    bench_key,
+    bench_cmap,
+    bench_pool,
+    bench_hash,
+    bench_mutation,
+    bench_bulk,
+    bench_shapes,
+};
+static const size_t BENCH_LEN = sizeof(BENCHES)/sizeof(BENCHES[0]);
+
+//------------------------------------------------------------------------------
+int main(int argc, const char * argv[])
+{
+    for (size_t i = 0; i < BENCH_LEN; i++ )
+    {
+        log_debug("-----------------------------------------------");
+        log_debug("completed in: %.2f secs", time_wall(BENCHES[i]));
+    }
+    return 0;
+}
@@ -29,6 +29,7 @@
 #endif
 
 #include <time.h>
+#include <stdarg.h>
 
 #include <libgen.h>
 #include "json.hpp"
@@ -40,7 +41,12 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <list>
+#include <set>
 #include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <thread>
+#include <atomic>
 
 #define btomb(bytes) (bytes / (double)(1024*1024))
 
@@ -186,6 +192,1775 @@ static void test_numbers()
     json_destroy(&jsn);
 }
 
+//------------------------------------------------------------------------------
+static void test_lazy_nums()
+{
+    LOG_FUNC();
+
+    const std::string jstr = "[12345678901234567890123456789,1.5e-5,1E+2,1000000000,-0,0,1,"
+                             "-134217727,123.4567890,-3.098098e6,1e0,999999999999999999,-0.0]";
+
+    jerr_t err;
+    json_t eager;
+    json_init(&eager);
+    json_t lazy;
+    json_init_flags(&lazy, JFLAG_LAZY_NUMS);
+
+    if (json_load_buf(&eager, jstr.c_str(), jstr.size(), &err) != 0 ||
+        json_load_buf(&lazy, jstr.c_str(), jstr.size(), &err) != 0)
+    {
+        jerr_fprint(stderr, &err);
+        exit(EXIT_FAILURE);
+    }
+    assert(lazy.flags == JFLAG_LAZY_NUMS);
+
+    // untouched numbers are written back exactly as they were read
+    size_t len;
+    char* out = json_to_strl(&lazy, 0, &len);
+    assert(std::string(out, len) == jstr);
+    free(out);
+
+    // conversion must agree with the regular parser, both before and after caching
+    jarray_t a1 = json_root_array(&eager);
+    jarray_t a2 = json_root_array(&lazy);
+    for ( int pass = 0; pass < 2; pass++ )
+    {
+        for ( size_t i = 0; i < jarray_len(a1); i++ )
+        {
+            assert(jarray_get_num(a1, i) == jarray_get_num(a2, i));
+            assert(json_get_int(&eager, jarray_get(a1, i)) == json_get_int(&lazy, jarray_get(a2, i)));
+        }
+    }
+    assert(json_compare(&eager, &lazy) == 0);
+
+    // values added later are regular numbers
+    jarray_add_num(a2, 0.5);
+    jarray_add_int(a2, 1LL << 40);
+    assert(jarray_get_num(a2, jarray_len(a2)-2) == 0.5);
+    assert(json_get_int(&lazy, jarray_get(a2, jarray_len(a2)-1)) == 1LL << 40);
+
+    // overflow is still reported while parsing
+    assert(json_load_str(&lazy, "[1e999]", &err) != 0);
+
+    json_destroy(&eager);
+    json_destroy(&lazy);
+
+    std::ostringstream os;
+    auto jsn = ims::json::from_str("{\"n\":2.50}", JFLAG_LAZY_NUMS);
+    jsn.write(os, 0);
+    assert(os.str() == "{\"n\":2.50}");
+}
+
+//------------------------------------------------------------------------------
+static void test_wide_index()
+{
+    LOG_FUNC();
+
+    assert(sizeof(jval_t) == (JSON_WIDE_INDEX ? 8 : 4));
+
+    // keys shorter than an index are packed inline, a shorter key must not
+    // match one of them by its prefix
+    json_t jsn;
+    json_init(&jsn);
+    jerr_t err;
+    const std::string jstr = "{\"abc\":1,\"abcdefg\":2,\"abcdefgh\":3}";
+    if (json_load_buf(&jsn, jstr.c_str(), jstr.size(), &err) != 0)
+    {
+        jerr_fprint(stderr, &err);
+        exit(EXIT_FAILURE);
+    }
+    jobj_t root = json_root_obj(&jsn);
+    assert(jval_is_nil(jobj_find(root, "ab")));
+    assert(jobj_find_int(root, "abc") == 1);
+    assert(jobj_find_int(root, "abcdefg") == 2);
+    assert(jobj_find_int(root, "abcdefgh") == 3);
+    assert((jobj_get_key_id(root, 1) == SIZE_MAX) == (JSON_WIDE_INDEX || JSON_WIDE_KEYS));
+    json_destroy(&jsn);
+
+    // more values of one type than a 28-bit index can address, by just enough
+    // to cross the limit. This peaks at about 4.1 GB of memory, 5.2 GB with
+    // JSON_WIDE_INDEX, so it only runs when asked for.
+    if (!getenv("IMS_JSON_BIG_TEST")) return;
+
+    static const size_t COUNT = ((size_t)1 << 28) + ((size_t)1 << 20);
+    std::string big = "[";
+    big.reserve(COUNT * 4 + 2);
+    for ( size_t i = 0; i < COUNT; i++ ) big += "0.5,";
+    big.back() = ']';
+
+    json_init(&jsn);
+    int status = json_load_buf(&jsn, big.c_str(), big.size(), &err);
+#if JSON_WIDE_INDEX
+    assert(status == 0);
+    jarray_t array = json_root_array(&jsn);
+    assert(jarray_len(array) == COUNT);
+    assert(jarray_get_num(array, COUNT-1) == 0.5);
+#else
+    // fails cleanly rather than wrapping around to the first numbers
+    assert(status != 0);
+    assert(strstr(err.msg, "JSON_WIDE_INDEX"));
+#endif
+    json_destroy(&jsn);
+}
+
+//------------------------------------------------------------------------------
+static void test_wide_keys()
+{
+    LOG_FUNC();
+
+    // with JSON_WIDE_KEYS keys of up to 15 bytes are packed, they must still
+    // tell apart keys that share a prefix or only differ in their last byte
+    std::string jstr = "[";
+    for ( int i = 0; i < 20; i++ )
+    {
+        if (i) jstr += ",";
+        jstr += "{\"type\":\"f\",\"geometry\":" + std::to_string(i) + ",\"coordinates\":[1,2],\"coordinate\":3,"
+                "\"fifteen_bytes_1\":4,\"fifteen_bytes_2\":5,\"sixteen_bytes_12\":6,\"properties\":{}";
+
+        // enough short keys for the shape to be searched through an index
+        for ( int k = 0; k < 24; k++ ) jstr += ",\"k" + std::to_string(k) + "\":0";
+        jstr += "}";
+    }
+    jstr += "]";
+
+    json_t jsn;
+    json_init(&jsn);
+    jerr_t err;
+    if (json_load_buf(&jsn, jstr.c_str(), jstr.size(), &err) != 0)
+    {
+        jerr_fprint(stderr, &err);
+        exit(EXIT_FAILURE);
+    }
+
+    // only the 16 byte key reaches the string map
+    assert(jsn.strmap.slen == (JSON_WIDE_KEYS ? 1 : (JSON_WIDE_INDEX ? 7 : 8)));
+
+    jarray_t rows = json_root_array(&jsn);
+    jkey_t geometry = jkey_resolve(&jsn, "geometry", 8);
+    for ( size_t i = 0; i < jarray_len(rows); i++ )
+    {
+        // shaped and big enough, so these go through the shared index
+        jobj_t row = jarray_get_obj(rows, i);
+        assert(json_get_int(&jsn, jobj_find_key(row, geometry)) == (jint_t)i);
+        assert(jobj_findl_idx(row, "coordinates", 11) == 2);
+        assert(jobj_findl_idx(row, "coordinate", 10) == 3);
+        assert(jobj_find_int(row, "fifteen_bytes_1") == 4);
+        assert(jobj_find_int(row, "fifteen_bytes_2") == 5);
+        assert(jobj_find_int(row, "sixteen_bytes_12") == 6);
+        assert(jobj_findl_idx(row, "fifteen_bytes_", 14) == SIZE_MAX);
+        assert(jobj_findl_idx(row, "coordinates_", 12) == SIZE_MAX);
+    }
+
+    // a small object is searched linearly
+    json_destroy(&jsn);
+    jobj_t obj = json_root_obj(json_init(&jsn));
+    jobj_add_int(obj, "coordinates", 1);
+    jobj_add_int(obj, "coordinatez", 2);
+    jobj_add_int(obj, "c", 3);
+    assert(jobj_find_int(obj, "coordinatez") == 2);
+    assert(jobj_find_int(obj, "c") == 3);
+    size_t klen;
+    jval_t val;
+    assert(strcmp(jobj_get(obj, 1, &val, &klen), "coordinatez") == 0 && klen == 11);
+
+    char* out = json_to_str(&jsn, 0);
+    assert(strcmp(out, "{\"coordinates\":1,\"coordinatez\":2,\"c\":3}") == 0);
+    free(out);
+    json_destroy(&jsn);
+}
+
+//------------------------------------------------------------------------------
+static void test_num_span()
+{
+    LOG_FUNC();
+
+    const std::string jstr = "{\"ring\":[[-122.41,37.77],[-122.42,37.78],[-122.43,37.79]],"
+                             "\"line\":[0.5,1.5,2.5,3.5,4.5,5.5,6.5,7.5,8.5,9.5],"
+                             "\"mixed\":[0,1.5],\"small\":[1,2,3],\"big\":[10000000000,20000000000],"
+                             "\"empty\":[]}";
+
+    for ( int flags : { 0, (int)JFLAG_LAZY_NUMS } )
+    {
+        json_t jsn;
+        json_init_flags(&jsn, flags);
+        jerr_t err;
+        if (json_load_buf(&jsn, jstr.c_str(), jstr.size(), &err) != 0)
+        {
+            jerr_fprint(stderr, &err);
+            exit(EXIT_FAILURE);
+        }
+        jobj_t root = json_root_obj(&jsn);
+
+        const jnum_t* nums;
+        const jint_t* ints;
+        size_t len;
+
+        jarray_t ring = jobj_find_array(root, "ring");
+        assert(!jarray_get_num_span(ring, &nums, &len));
+        for ( size_t i = 0; i < jarray_len(ring); i++ )
+        {
+            jarray_t pt = jarray_get_array(ring, i);
+            assert(jarray_get_num_span(pt, &nums, &len) && len == 2);
+            assert(nums[0] == jarray_get_num(pt, 0) && nums[1] == jarray_get_num(pt, 1));
+            static const jnum_t LNG[] = { -122.41, -122.42, -122.43 };
+            assert(nums[0] == LNG[i]);
+        }
+
+        jarray_t line = jobj_find_array(root, "line");
+        assert(jarray_get_num_span(line, &nums, &len) && len == 10);
+        for ( size_t i = 0; i < len; i++ ) assert(nums[i] == i + 0.5);
+
+        assert(!jarray_get_num_span(jobj_find_array(root, "mixed"), &nums, &len));
+        assert(!jarray_get_int_span(jobj_find_array(root, "small"), &ints, &len));
+        assert(jarray_get_int_span(jobj_find_array(root, "big"), &ints, &len) && len == 2 && ints[1] == 20000000000LL);
+        assert(jarray_get_num_span(jobj_find_array(root, "empty"), &nums, &len) && len == 0);
+
+        // prints and compares like any other array
+        size_t slen;
+        char* out = json_to_strl(&jsn, 0, &slen);
+        assert(std::string(out, slen) == jstr);
+        free(out);
+
+        // adding to the array gives it its own values again
+        jarray_add_num(line, 10.5);
+        assert(!jarray_get_num_span(line, &nums, &len));
+        assert(jarray_len(line) == 11);
+        for ( size_t i = 0; i < jarray_len(line); i++ ) assert(jarray_get_num(line, i) == i + 0.5);
+
+        // a span added back to its own doc, the pool moves as it grows
+        jarray_t twice = jobj_add_array(root, "twice");
+        for ( int round = 0; round < 8; round++ )
+        {
+            assert(jarray_get_num_span(jarray_get_array(ring, 1), &nums, &len) && len == 2);
+            jarray_add_nums(twice, nums, len);
+            assert(jarray_get_int_span(jobj_find_array(root, "big"), &ints, &len) && len == (size_t)2 << round);
+            jarray_add_ints(jobj_find_array(root, "big"), ints, len);
+        }
+        assert(jarray_len(twice) == 16 && jarray_get_num(twice, 15) == 37.78);
+        assert(jarray_len(jobj_find_array(root, "big")) == 2 << 8);
+        assert(json_get_int(&jsn, jarray_get(jobj_find_array(root, "big"), 511)) == 20000000000LL);
+
+        json_t copy;
+        json_init(&copy);
+        json_copy(&copy, &jsn);
+        assert(json_compare(&copy, &jsn) == 0);
+        json_destroy(&copy);
+        json_destroy(&jsn);
+    }
+
+#if IMS_JSON_HAS_SPAN
+    auto jsn = ims::json::from_str("[1.5,2.5,3.5]");
+    auto span = jsn.root_array().num_span();
+    assert(span && span->size() == 3 && (*span)[2] == 3.5);
+#endif
+
+    // the points of a ring read the same by value and by span
+    static const size_t COUNT = 1000;
+    std::string ring = "[";
+    for ( size_t i = 0; i < COUNT; i++ ) ring += (i ? ",[" : "[") + std::to_string(i * 0.25 + 0.125) + "," + std::to_string(i * 0.5 + 0.25) + "]";
+    ring += "]";
+    json_t* big = json_new();
+    jerr_t err;
+    assert(json_load_buf(big, ring.c_str(), ring.size(), &err) == 0);
+    jarray_t coords = json_root_array(big);
+
+    for ( size_t i = 0; i < COUNT; i++ )
+    {
+        jarray_t pt = jarray_get_array(coords, i);
+        const jnum_t* span;
+        size_t len;
+        assert(jarray_get_num_span(pt, &span, &len) && len == 2);
+        assert(span[0] == jarray_get_num(pt, 0) && span[1] == jarray_get_num(pt, 1));
+    }
+    json_free(big);
+}
+
+//------------------------------------------------------------------------------
+static void test_columns()
+{
+    LOG_FUNC();
+
+    const std::string jstr = "["
+        "{\"id\":1,\"name\":\"a\",\"props\":{\"area\":1,\"zone\":{\"code\":7}},\"ok\":true,\"tags\":[1]},"
+        "{\"id\":2,\"name\":\"b\",\"props\":{\"area\":2.5},\"ok\":false,\"tags\":\"x\"},"
+        "5,"
+        "{\"id\":null,\"name\":\"a\",\"extra\":null}"
+    "]";
+
+    json_t jsn;
+    json_init(&jsn);
+    jerr_t err;
+    if (json_load_buf(&jsn, jstr.c_str(), jstr.size(), &err) != 0)
+    {
+        jerr_fprint(stderr, &err);
+        exit(EXIT_FAILURE);
+    }
+
+    jtable_t* t = json_to_columns(json_root_array(&jsn));
+    assert(jtable_rows(t) == 4);
+    assert(jtable_cols(t) == 7);
+    assert(jtable_find_col(t, "props") == SIZE_MAX);
+    assert(jtable_find_col(t, "missing") == SIZE_MAX);
+
+    size_t col = jtable_find_col(t, "props/zone/code");
+    size_t len;
+    assert(std::string(jtable_col_name(t, col, &len)) == "props/zone/code" && len == 15);
+
+    // integers
+    col = jtable_find_col(t, "id");
+    assert(jtable_col_type(t, col) == JCOL_INT && !jtable_col_nums(t, col));
+    const jint_t* ids = jtable_col_ints(t, col);
+    const uint8_t* valid = jtable_col_valid(t, col);
+    assert(ids[0] == 1 && ids[1] == 2);
+    assert(jtable_is_valid(valid, 0) && jtable_is_valid(valid, 1));
+    assert(!jtable_is_valid(valid, 2) && !jtable_is_valid(valid, 3));
+
+    // integers mixed with doubles
+    col = jtable_find_col(t, "props/area");
+    assert(jtable_col_type(t, col) == JCOL_NUM);
+    const jnum_t* area = jtable_col_nums(t, col);
+    assert(area[0] == 1.0 && area[1] == 2.5);
+
+    // strings
+    col = jtable_find_col(t, "name");
+    assert(jtable_col_type(t, col) == JCOL_STR);
+    assert(std::string(jtable_get_strl(t, col, 3, &len)) == "a" && len == 1);
+    assert(jtable_get_strl(t, col, 2, &len) == NULL);
+
+    // short strings are inline, the entries are values rather than string ids
+    const jidx_t* names = jtable_col_strs(t, col);
+    jval_t name = { JTYPE_STR, names[1] };
+    assert(std::string(json_get_strl(&jsn, name, &len)) == "b" && len == 1);
+
+    // bools
+    col = jtable_find_col(t, "ok");
+    const uint8_t* ok = jtable_col_bools(t, col);
+    assert(ok && ok[0] == 1 && ok[1] == 0);
+
+    // mixed types keep the values
+    col = jtable_find_col(t, "tags");
+    assert(jtable_col_type(t, col) == JCOL_VAL);
+    const jval_t* tags = jtable_col_vals(t, col);
+    assert(jval_is_array(tags[0]) && jval_is_str(tags[1]));
+
+    // only nulls
+    col = jtable_find_col(t, "extra");
+    assert(jtable_col_type(t, col) == JCOL_NIL && !jtable_is_valid(jtable_col_valid(t, col), 3));
+    jtable_free(t);
+    json_destroy(&jsn);
+
+    // a key holding a '/' is escaped and kept apart from the nested path
+    {
+        const std::string escs = R"([{"a/b":1,"a":{"b":2},"c~":3}])";
+        json_t* esc = json_new();
+        assert(json_load_buf(esc, escs.c_str(), escs.size(), &err) == 0);
+        jtable_t* et = json_to_columns(json_root_array(esc));
+        assert(jtable_cols(et) == 3);
+        assert(jtable_col_ints(et, jtable_find_col(et, "a~1b"))[0] == 1);
+        assert(jtable_col_ints(et, jtable_find_col(et, "a/b"))[0] == 2);
+        assert(jtable_col_ints(et, jtable_find_col(et, "c~0"))[0] == 3);
+        jtable_free(et);
+        json_free(esc);
+    }
+
+    // a field of many records reads the same by object and by column
+    static const size_t COUNT = 1000;
+    std::string records = "[";
+    for ( size_t i = 0; i < COUNT; i++ )
+    {
+        records += (i ? ",{" : "{");
+        records += "\"type\":\"Feature\",\"properties\":{\"id\":" + std::to_string(i) + ",\"name\":\"n" + std::to_string(i % 100);
+        records += "\",\"area\":" + std::to_string(i * 0.5) + "}}";
+    }
+    records += "]";
+    json_t* big = json_new();
+    assert(json_load_buf(big, records.c_str(), records.size(), &err) == 0);
+    jarray_t array = json_root_array(big);
+
+    jtable_t* table = json_to_columns(array);
+    assert(jtable_rows(table) == COUNT);
+    const jnum_t* areas = jtable_col_nums(table, jtable_find_col(table, "properties/area"));
+    for ( size_t i = 0; i < COUNT; i++ )
+    {
+        assert(areas[i] == jobj_find_num(jobj_find_obj(jarray_get_obj(array, i), "properties"), "area"));
+    }
+    jtable_free(table);
+    json_free(big);
+}
+
+//------------------------------------------------------------------------------
+static void test_strmap()
+{
+    LOG_FUNC();
+
+    static const size_t COUNT = 200000;
+
+    json_t* jsn = json_new();
+    jarray_t array = json_root_array(jsn);
+
+    // every string is added twice, the second copy must be interned
+    char buf[64];
+    for ( int pass = 0; pass < 2; pass++ )
+    {
+        for ( size_t i = 0; i < COUNT; i++ )
+        {
+            size_t len = (size_t)snprintf(buf, sizeof(buf), "%zx-%s", i*2654435761u, (i & 1) ? "key" : "a-longer-string-value");
+            jarray_add_strl(array, buf, len);
+        }
+    }
+    assert(jsn->strmap.slen == COUNT);
+    assert(jsn->strmap.blen == COUNT);
+    assert((jsn->strmap.bcap & (jsn->strmap.bcap-1)) == 0);
+
+    for ( size_t i = 0; i < COUNT; i++ )
+    {
+        jval_t v1 = jarray_get(array, i);
+        jval_t v2 = jarray_get(array, i + COUNT);
+        assert(v1.idx == v2.idx);
+
+        size_t len = (size_t)snprintf(buf, sizeof(buf), "%zx-%s", i*2654435761u, (i & 1) ? "key" : "a-longer-string-value");
+        size_t slen;
+        const char* str = json_get_strl(jsn, v1, &slen);
+        assert(slen == len && memcmp(str, buf, len) == 0);
+    }
+
+    json_free(jsn); jsn = NULL;
+}
+
+//------------------------------------------------------------------------------
+static void test_str_arena()
+{
+    LOG_FUNC();
+
+    // lengths that leave odd tails at the end of each chunk, with a string
+    // larger than half a chunk now and then, adding up to many chunks
+    static const size_t LENS[] = { 17, 250, 1021, 2047, 3000, 4095, 63, 40000, 511 };
+    static const size_t COUNT = 400;
+
+    json_t* jsn = json_new();
+    jarray_t array = json_root_array(jsn);
+
+    std::vector<std::string> strs;
+    size_t total = 0;
+    for ( size_t i = 0; i < COUNT; i++ )
+    {
+        std::string str(LENS[i % (sizeof(LENS)/sizeof(LENS[0]))], 'a' + (char)(i % 26));
+        str += std::to_string(i);
+        jarray_add_strl(array, str.data(), str.size());
+        total += str.size() + 1;
+        strs.push_back(str);
+    }
+    assert(total > 64 * 1024);
+
+    // every string reads back, and no two strings share any bytes
+    std::vector<std::pair<const char*, size_t>> spans;
+    for ( size_t i = 0; i < COUNT; i++ )
+    {
+        size_t len;
+        const char* str = json_get_strl(jsn, jarray_get(array, i), &len);
+        assert(len == strs[i].size() && memcmp(str, strs[i].data(), len) == 0 && str[len] == '\0');
+        spans.push_back({str, len});
+    }
+    std::sort(spans.begin(), spans.end());
+    for ( size_t i = 1; i < spans.size(); i++ )
+    {
+        assert(spans[i-1].first + spans[i-1].second < spans[i].first);
+    }
+
+    json_free(jsn); jsn = NULL;
+}
+
+//------------------------------------------------------------------------------
+static void build_strmap( int flags, size_t count, jbool_t* migrated )
+{
+    json_t* jsn = json_init_flags(json_new(), flags);
+    jarray_t array = json_root_array(jsn);
+
+    char buf[64];
+    for ( size_t i = 0; i < count; i++ )
+    {
+        size_t len = (size_t)snprintf(buf, sizeof(buf), "%zx-string", i*2654435761u);
+        jarray_add_strl(array, buf, len);
+        if (jsn->strmap.old_slots) *migrated = JTRUE;
+
+        // strings added before the resize started must still be found
+        if ((i & 1023) == 0)
+        {
+            size_t n = i / 2;
+            len = (size_t)snprintf(buf, sizeof(buf), "%zx-string", n*2654435761u);
+            jarray_add_strl(array, buf, len);
+            assert(jarray_get(array, jarray_len(array)-1).idx == n);
+        }
+    }
+    assert(jsn->strmap.slen == count);
+    assert(jsn->strmap.blen == count);
+
+    json_free(jsn); jsn = NULL;
+}
+
+//------------------------------------------------------------------------------
+static void test_incremental_rehash()
+{
+    LOG_FUNC();
+
+    static const size_t COUNT = 100000;
+
+    jbool_t migrated = JFALSE;
+    build_strmap(0, COUNT, &migrated);
+    assert(!migrated);
+
+    build_strmap(JFLAG_INCREMENTAL_REHASH, COUNT, &migrated);
+    assert(migrated);
+}
+
+//------------------------------------------------------------------------------
+static json_t* load_intern( const std::string& doc, int flags )
+{
+    json_t* jsn = json_init_flags(json_new(), flags);
+    jerr_t err;
+    if (json_load_buf(jsn, doc.data(), doc.size(), &err) != 0)
+    {
+        jerr_fprint(stderr, &err);
+        exit(EXIT_FAILURE);
+    }
+    return jsn;
+}
+
+//------------------------------------------------------------------------------
+static void test_obj_index()
+{
+    LOG_FUNC();
+
+    // a dictionary style object with short (packed) and long keys
+    static const size_t COUNT = 5000;
+    json_t* jsn = json_new();
+    jobj_t root = json_root_obj(jsn);
+    char key[32];
+    for ( size_t i = 0; i < COUNT; i++ )
+    {
+        snprintf(key, sizeof(key), "%zx", i);
+        jobj_add_int(root, key, (jint_t)i);
+    }
+    jobj_add_int(root, "0", -1); // repeated key, the first one wins
+
+    // the index is kept with the object, lookups never write to the doc
+    size_t before = json_get_mem(jsn).objs.used;
+    for ( size_t i = 0; i < COUNT; i++ )
+    {
+        snprintf(key, sizeof(key), "%zx", i);
+        assert(jobj_find_int(root, key) == (jint_t)i);
+    }
+    assert(json_get_mem(jsn).objs.used == before);
+    assert(jval_is_nil(jobj_find(root, "missing")));
+    assert(jval_is_nil(jobj_find(root, "zz")));
+    assert(jobj_findl_next_idx(root, 1, "0", 1) == COUNT);
+
+    // keys added after the index is built are found, including the ones that
+    // make it grow
+    for ( size_t i = COUNT; i < COUNT*3; i++ )
+    {
+        snprintf(key, sizeof(key), "%zx", i);
+        jobj_add_int(root, key, (jint_t)i);
+        assert(jobj_find_int(root, key) == (jint_t)i);
+    }
+    assert(jobj_find_int(root, "0") == 0);
+
+    // small objects are still scanned
+    std::string jstr = "{";
+    for ( size_t i = 0; i < 20; i++ ) jstr += (i ? ",\"" : "\"") + std::to_string(i) + "\":" + std::to_string(i);
+    jstr += "}";
+    json_t* small = json_new();
+    jerr_t err;
+    assert(json_load_buf(small, jstr.c_str(), jstr.size(), &err) == 0);
+    for ( size_t i = 0; i < 20; i++ )
+    {
+        std::string k = std::to_string(i);
+        assert(jobj_find_int(json_root_obj(small), k.c_str()) == (jint_t)i);
+    }
+    json_free(small);
+    json_free(jsn);
+}
+
+//------------------------------------------------------------------------------
+static void test_obj_keys()
+{
+    LOG_FUNC();
+
+    // long keys get string ids 0, 1, 2... and "\u0001" packs to the same bits
+    // as id 1. Lookups must still tell them apart.
+    std::string jstr = "{";
+    for ( int i = 0; i < 20; i++ ) jstr += "\"long_key_" + std::to_string(i) + "\":" + std::to_string(i) + ",";
+    jstr += "\"\\u0001\":-1,\"\\u0002\":-2,\"abc\":-3}";
+
+    json_t* jsn = json_new();
+    jerr_t err;
+    if (json_load_buf(jsn, jstr.c_str(), jstr.size(), &err) != 0)
+    {
+        jerr_fprint(stderr, &err);
+        exit(EXIT_FAILURE);
+    }
+    jobj_t root = json_root_obj(jsn);
+    assert(jobj_len(root) == 23);
+    for ( int i = 0; i < 20; i++ )
+    {
+        std::string key = "long_key_" + std::to_string(i);
+        assert(jobj_find_int(root, key.c_str()) == i);
+    }
+    assert(jobj_find_int(root, "\x01") == -1);
+    assert(jobj_find_int(root, "\x02") == -2);
+    assert(jobj_find_int(root, "abc") == -3);
+
+    // iteration is unchanged
+    for ( size_t i = 0; i < jobj_len(root); i++ )
+    {
+        jval_t val;
+        size_t klen;
+        const char* key = jobj_get(root, i, &val, &klen);
+        assert(jobj_findl_idx(root, key, klen) == i);
+    }
+
+    // growing out of, and copying into, the inline buffer
+    jobj_t small = jobj_add_obj(root, "small");
+    for ( int i = 0; i < 10; i++ )
+    {
+        jobj_add_int(small, ("k" + std::to_string(i)).c_str(), i);
+        for ( int j = 0; j <= i; j++ ) assert(jobj_find_int(small, ("k" + std::to_string(j)).c_str()) == j);
+    }
+    json_t* copy = json_new();
+    json_copy(copy, jsn);
+    assert(json_compare(copy, jsn) == 0);
+    json_free(copy);
+    json_free(jsn);
+}
+
+//------------------------------------------------------------------------------
+static void test_key()
+{
+    LOG_FUNC();
+
+    // geojson style features, each with a few properties
+    static const size_t COUNT = 5000;
+    std::string jstr = "{\"type\":\"FeatureCollection\",\"features\":[";
+    char buf[256];
+    for ( size_t i = 0; i < COUNT; i++ )
+    {
+        snprintf(buf, sizeof(buf), "%s{\"type\":\"Feature\",\"properties\":{\"ID\":%zu,\"STREET\":\"street %zu\",\"CITY\":\"SF\"}}",
+                 i ? "," : "", i, i % 1000);
+        jstr += buf;
+    }
+    jstr += "]}";
+
+    json_t* c = json_new();
+    jerr_t err;
+    if (json_load_buf(c, jstr.c_str(), jstr.size(), &err) != 0)
+    {
+        jerr_fprint(stderr, &err);
+        exit(EXIT_FAILURE);
+    }
+    jarray_t features = jobj_find_array(json_root_obj(c), "features");
+    assert(jarray_len(features) == COUNT);
+
+    jkey_t props = jkey_resolve(c, "properties", strlen("properties"));
+    jkey_t street = jkey_resolve(c, "STREET", strlen("STREET"));
+    jkey_t id = jkey_resolve(c, "ID", strlen("ID")); // packed
+    jkey_t missing = jkey_resolve(c, "ZIPCODE", strlen("ZIPCODE"));
+
+    // same answers as searching by string
+    for ( size_t i = 0; i < COUNT; i++ )
+    {
+        jobj_t feature = jarray_get_obj(features, i);
+        jobj_t p = json_get_obj(c, jobj_find_key(feature, props));
+        assert(p.idx == jobj_find_obj(feature, "properties").idx);
+        assert(json_get_int(c, jobj_find_key(p, id)) == (jint_t)i);
+        assert(jobj_find_key_idx(p, street) == jobj_findl_idx(p, "STREET", strlen("STREET")));
+        assert(jobj_find_key_idx(p, missing) == SIZE_MAX);
+        assert(jval_is_nil(jobj_find_key(p, jkey_resolve(c, "I", 1))));
+    }
+
+    json_free(c);
+
+    // C++
+    auto jsn = ims::json::from_str("{\"properties\":{\"ID\":7,\"STREET\":\"Main\"}}");
+    ims::key kprops(jsn, "properties");
+    auto p = static_cast<ims::obj>(jsn.root_obj()[kprops]);
+    assert(static_cast<std::string>(p[ims::key(jsn, "STREET")]) == "Main");
+    assert(static_cast<jint_t>(p[ims::key(p, "ID")]) == 7);
+    assert(p.find(ims::key(p, "ZIPCODE")) == p.end());
+    assert(p[ims::key(p, "ZIPCODE")].is_nil());
+}
+
+//------------------------------------------------------------------------------
+static void test_intern()
+{
+    LOG_FUNC();
+
+    static const size_t COUNT = 20000;
+    static const char* KINDS[] = { "created-item", "updated-item", "deleted-item", "read-the-item" };
+
+    // events with a unique id and a repeating kind, and a doc of unique ids only
+    std::string mixed = "[", unique = "[";
+    char buf[128];
+    for ( size_t i = 0; i < COUNT; i++ )
+    {
+        snprintf(buf, sizeof(buf), "%s{\"id\":\"%08zx-event\",\"category\":\"%s\"}", i ? "," : "", i*2654435761u, KINDS[i%4]);
+        mixed += buf;
+        snprintf(buf, sizeof(buf), "%s\"%08zx-event\"", i ? "," : "", i*2654435761u);
+        unique += buf;
+    }
+    mixed += "]"; unique += "]";
+
+    json_t* all = load_intern(mixed, 0);
+    json_t* keys = load_intern(mixed, JFLAG_INTERN_KEYS);
+    json_t* adaptive = load_intern(mixed, JFLAG_INTERN_ADAPTIVE);
+
+    // same content regardless of the policy
+    assert(json_compare(all, keys) == 0);
+    assert(json_compare(all, adaptive) == 0);
+
+    // ids, kinds and the key "category" ("id" is packed into the key itself,
+    // so is "category" with JSON_WIDE_KEYS)
+    const size_t KEYS = JSON_WIDE_KEYS ? 0 : 1;
+    assert(all->strmap.slen == COUNT + 4 + KEYS);
+    assert(all->strmap.blen == all->strmap.slen);
+
+    // every value is stored, only the key is in the table
+    assert(keys->strmap.slen == COUNT*2 + KEYS);
+    assert(keys->strmap.blen == KEYS);
+
+    // half of the values are repeats, interning stays on
+    assert(!adaptive->intern.off);
+    assert(adaptive->strmap.slen == all->strmap.slen);
+
+    jarray_t array = json_root_array(keys);
+    for ( size_t i = 0; i < COUNT; i += 997 )
+    {
+        jobj_t obj = jarray_get_obj(array, i);
+        size_t len;
+        const char* kind = json_get_strl(keys, jobj_find(obj, "category"), &len);
+        assert(len == strlen(KINDS[i%4]) && memcmp(kind, KINDS[i%4], len) == 0);
+    }
+
+    json_free(all); all = NULL;
+    json_free(keys); keys = NULL;
+    json_free(adaptive); adaptive = NULL;
+
+    // nothing repeats, interning is switched off after the first window
+    all = load_intern(unique, 0);
+    adaptive = load_intern(unique, JFLAG_INTERN_ADAPTIVE);
+    assert(json_compare(all, adaptive) == 0);
+    assert(adaptive->intern.off);
+    assert(adaptive->strmap.slen == COUNT);
+    assert(adaptive->strmap.blen < COUNT/2);
+
+    // values added through the api follow the policy too, clearing the doc
+    // starts interning again
+    json_clear(adaptive);
+    assert(!adaptive->intern.off);
+    jarray_t root = json_root_array(adaptive);
+    jarray_add_str(root, "the same string");
+    jarray_add_str(root, "the same string");
+    assert(adaptive->strmap.slen == 1);
+
+    json_t* jsn = json_init_flags(json_new(), JFLAG_INTERN_KEYS);
+    root = json_root_array(jsn);
+    jarray_add_str(root, "the same string");
+    jarray_add_str(root, "the same string");
+    assert(jsn->strmap.slen == 2);
+    assert(jsn->strmap.blen == 0);
+
+    json_free(jsn); jsn = NULL;
+    json_free(all); all = NULL;
+    json_free(adaptive); adaptive = NULL;
+}
+
+//------------------------------------------------------------------------------
+static void test_dict()
+{
+    LOG_FUNC();
+
+    static const size_t COUNT = 1000;
+
+    // learn the keys from the first record, declare one more up front
+    const char* sample = R"({"timestamp":1,"message":"m","level":"information","id":7,"request":{"request_id":"r"}})";
+    json_t* jsn = json_new();
+    jerr_t err;
+    if (json_load_str(jsn, sample, &err) != 0)
+    {
+        jerr_fprint(stderr, &err);
+        exit(EXIT_FAILURE);
+    }
+
+    jdict_t* dict = jdict_new();
+    jdict_add_keys(dict, jsn);
+    size_t extra = jdict_add(dict, "hostname");
+    jdict_freeze(dict);
+    json_free(jsn); jsn = NULL;
+
+    assert(jdict_len(dict) == 7);
+    assert(jdict_find(dict, "hostname") == extra);
+    assert(jdict_find(dict, "timestamp") != SIZE_MAX);
+    assert(jdict_find(dict, "missing") == SIZE_MAX);
+
+    std::vector<json_t*> docs;
+    size_t used = 0, used_dict = 0;
+    char buf[256];
+    for ( size_t i = 0; i < COUNT; i++ )
+    {
+        snprintf(buf, sizeof(buf), R"({"timestamp":%zu,"message":"event number %zu","level":"%s","id":%zu,"request":{"request_id":"request-%zu"},"hostname":"timestamp","lvl":1})",
+                 1000+i, i, (i & 1) ? "information" : "warning-level", i, i*31);
+
+        json_t* plain = json_new();
+        json_t* shared = json_init_dict((json_t*)malloc(sizeof(json_t)), dict, 0);
+        assert(json_load_str(plain, buf, &err) == 0);
+        assert(json_load_str(shared, buf, &err) == 0);
+        assert(json_compare(plain, shared) == 0);
+
+        used += json_get_mem(plain).strs.used;
+        used_dict += json_get_mem(shared).strs.used;
+
+        // only the values are stored in the doc, the keys come from the dict
+        assert(shared->strmap.slen == 3);
+
+        json_free(plain); plain = NULL;
+        docs.push_back(shared);
+    }
+    log_debug("string bytes per doc: %.1f, with dictionary: %.1f", used / (double)COUNT, used_dict / (double)COUNT);
+    assert(used_dict < used);
+
+    // keys have the same id in every doc
+    for ( size_t i = 0; i < COUNT; i++ )
+    {
+        jobj_t root = json_root_obj(docs[i]);
+        size_t msg = jobj_findl_idx(root, "message", 7);
+        assert(jobj_get_key_id(root, msg) == jdict_find(dict, "message"));
+        assert(jobj_get_key_id(root, jobj_findl_idx(root, "id", 2)) == jdict_find(dict, "id"));
+        assert(jobj_get_key_id(root, jobj_findl_idx(root, "lvl", 3)) == SIZE_MAX);
+
+        // values found in the dictionary share its ids too
+        assert(jobj_find(root, "hostname").idx == jdict_find(dict, "timestamp"));
+
+        jobj_t request = jobj_find_obj(root, "request");
+        assert(jobj_get_key_id(request, 0) == jdict_find(dict, "request_id"));
+        assert(jobj_get_key_id(request, 0) == jobj_get_key_id(jobj_find_obj(json_root_obj(docs[0]), "request"), 0));
+    }
+
+    // clearing keeps the dictionary
+    json_clear(docs[0]);
+    assert(json_load_str(docs[0], sample, &err) == 0);
+    assert(jobj_get_key_id(json_root_obj(docs[0]), 0) == jdict_find(dict, "timestamp"));
+    assert(docs[0]->strmap.slen == 1); // "m" and "r" are stored inline
+
+    json j = json::from_str(std::string(sample), dict);
+    json j2 = json::from_str(std::string(sample));
+    assert(j == j2);
+
+    for ( auto doc : docs )
+    {
+        json_destroy(doc);
+        free(doc);
+    }
+    jdict_free(dict); dict = NULL;
+}
+
+//------------------------------------------------------------------------------
+static inline uint64_t test_rand( uint64_t& state )
+{
+    // xorshift64*, deterministic so failures can be reproduced
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1DULL;
+}
+
+//------------------------------------------------------------------------------
+static double chi_squared( const std::vector<uint32_t>& hashes, int shift, size_t buckets )
+{
+    std::vector<size_t> counts(buckets, 0);
+    for ( auto h : hashes ) counts[(h >> shift) & (buckets-1)]++;
+
+    double expected = hashes.size() / (double)buckets;
+    double chi = 0;
+    for ( auto c : counts ) chi += (c - expected) * (c - expected) / expected;
+    return chi;
+}
+
+//------------------------------------------------------------------------------
+static void test_cmap()
+{
+    LOG_FUNC();
+
+    static const size_t COUNT = 20000;
+    static const size_t THREADS = 8;
+
+    std::vector<std::string> strs;
+    for ( size_t i = 0; i < COUNT; i++ )
+    {
+        strs.push_back(std::to_string(i * 2654435761u) + ((i & 1) ? "" : "-with-a-longer-tail"));
+    }
+
+    jcmap_t* map = jcmap_new();
+    assert(map);
+
+    // every thread adds all strings in its own order, they must agree on ids
+    std::vector<std::vector<size_t>> ids(THREADS, std::vector<size_t>(COUNT));
+    std::vector<std::thread> threads;
+    for ( size_t t = 0; t < THREADS; t++ )
+    {
+        threads.emplace_back([&, t]
+        {
+            std::vector<size_t> order(COUNT);
+            for ( size_t i = 0; i < COUNT; i++ ) order[i] = i;
+            uint64_t state = t + 1;
+            for ( size_t i = COUNT-1; i > 0; i-- ) std::swap(order[i], order[test_rand(state) % (i+1)]);
+
+            for ( auto i : order )
+            {
+                ids[t][i] = jcmap_addl(map, strs[i].data(), strs[i].size());
+            }
+        });
+    }
+    for ( auto& th : threads ) th.join();
+
+    assert(jcmap_len(map) == COUNT);
+    std::vector<bool> seen(COUNT, false);
+    for ( size_t i = 0; i < COUNT; i++ )
+    {
+        size_t id = ids[0][i];
+        for ( size_t t = 1; t < THREADS; t++ ) assert(ids[t][i] == id);
+
+        // ids are dense
+        assert(id < COUNT && !seen[id]);
+        seen[id] = true;
+
+        size_t len;
+        const char* str = jcmap_get_strl(map, id, &len);
+        assert(len == strs[i].size() && memcmp(str, strs[i].data(), len) == 0);
+        assert(jcmap_findl(map, strs[i].data(), strs[i].size()) == id);
+    }
+    assert(jcmap_find(map, "missing") == SIZE_MAX);
+
+    // docs parsed on different threads share the table, a key has the same id
+    // in all of them
+    std::vector<json_t> docs(THREADS);
+    threads.clear();
+    for ( size_t t = 0; t < THREADS; t++ )
+    {
+        threads.emplace_back([&, t]
+        {
+            std::string str = "{\"timestamp-of-the-event\":" + std::to_string(t) + ",\"thread-key-of-the-event-" + std::to_string(t) + "\":\"" + strs[t] + "\",\"message-of-the-event\":\"hello world\"}";
+            json_t* jsn = json_init_cmap(&docs[t], map, 0);
+            jerr_t err;
+            int rc = json_load_buf(jsn, str.data(), str.size(), &err);
+            assert(rc == 0);
+            json_gc(jsn);
+        });
+    }
+    for ( auto& th : threads ) th.join();
+
+    assert(jcmap_len(map) == COUNT + THREADS + 3); // the keys and "hello world"
+    const size_t timestamp = jcmap_find(map, "timestamp-of-the-event");
+    const size_t message = jcmap_find(map, "message-of-the-event");
+    for ( size_t t = 0; t < THREADS; t++ )
+    {
+        jobj_t root = json_get_obj(&docs[t], json_root(&docs[t]));
+        assert(jobj_len(root) == 3);
+        assert(jobj_get_key_id(root, 0) == timestamp);
+        assert(jobj_get_key_id(root, 2) == message);
+        assert(jobj_get_key_id(root, 1) == jcmap_find(map, ("thread-key-of-the-event-" + std::to_string(t)).c_str()));
+
+        // string values resolve against the shared table too
+        size_t len;
+        jval_t val;
+        jobj_get(root, 1, &val, &len);
+        assert(json_get_strl(&docs[t], val, &len) == std::string(jcmap_get_strl(map, ids[0][t], &len)));
+        assert(jcmap_findl(map, strs[t].data(), strs[t].size()) == ids[0][t]);
+        assert(json_get_mem(&docs[t]).strs.reserved == 0);
+
+        json_clear(&docs[t]);
+        assert(docs[t].strmap.shared == map);
+        json_destroy(&docs[t]);
+    }
+
+    jcmap_free(map); map = NULL;
+}
+
+//------------------------------------------------------------------------------
+static void test_gc()
+{
+    LOG_FUNC();
+
+    std::string big = "{";
+    for ( int i = 0; i < 40; i++ ) big += (i ? ",\"field_" : "\"field_") + std::to_string(i) + "\":" + std::to_string(i * 1.5);
+    big += "}";
+
+    const std::string keep = "{\"name\":\"a string longer than the inline buffer\",\"nums\":[1.5,2.5,3.5],"
+                             "\"ints\":[10000000000,20000000000],\"mix\":[1,\"x\",true,null,-0,1e5],"
+                             "\"big\":" + big + ",\"short\":\"ab\",\"empty\":{}}";
+    const std::string jstr = "{\"old\":{\"garbage string keys\":[\"another long string to throw away\",\"z\"],"
+                             "\"nums\":[0.25,12345678901,{\"deep\":[[7.5]]}],\"big\":" + big + "},"
+                             "\"keep\":" + keep + "}";
+
+    for ( int flags : { 0, (int)JFLAG_LAZY_NUMS, (int)JFLAG_INTERN_KEYS, (int)JFLAG_INCREMENTAL_REHASH } )
+    {
+        json_t jsn;
+        json_init_flags(&jsn, flags);
+        jerr_t err;
+        if (json_load_buf(&jsn, jstr.c_str(), jstr.size(), &err) != 0)
+        {
+            jerr_fprint(stderr, &err);
+            exit(EXIT_FAILURE);
+        }
+
+        // only the "keep" object is reachable once it becomes the root
+        json_root(&jsn) = jobj_find(json_root_obj(&jsn), "keep");
+        size_t slen;
+        char* out = json_to_strl(&jsn, 0, &slen);
+        const std::string expected(out, slen);
+        free(out);
+
+        const size_t before = json_get_mem(&jsn).total.reserved;
+        size_t reclaimed = json_gc(&jsn);
+        assert(reclaimed > 0);
+        jmem_stats_t mem = json_get_mem(&jsn);
+        assert(mem.total.reserved + reclaimed == before);
+        assert(mem.reclaimed == reclaimed);
+        assert(json_gc(&jsn) == 0);
+
+        out = json_to_strl(&jsn, 0, &slen);
+        assert(std::string(out, slen) == expected);
+        free(out);
+
+        // lookups through the rebuilt string table and object index
+        jobj_t root = json_root_obj(&jsn);
+        jobj_t obj = jobj_find_obj(root, "big");
+        for ( int i = 0; i < 40; i++ ) assert(jobj_find_num(obj, ("field_" + std::to_string(i)).c_str()) == i * 1.5);
+        assert(json_get_num(&jsn, jobj_find_key(obj, jkey_resolve(&jsn, "field_39", 8))) == 39 * 1.5);
+        assert(jkey_resolve(&jsn, "garbage string keys", 19).kind == 0);
+
+        const jnum_t* nums;
+        size_t len;
+        assert(jarray_get_num_span(jobj_find_array(root, "nums"), &nums, &len) && len == 3 && nums[2] == 3.5);
+
+        // the doc is still fully usable
+        jobj_add_str(root, "name too", "a string longer than the inline buffer");
+        jarray_add_num(jobj_find_array(root, "nums"), 4.5);
+        jobj_add_num(jobj_add_obj(root, "more"), "field_0", 1);
+        assert(jarray_len(jobj_find_array(root, "nums")) == 4);
+
+        json_t copy;
+        json_init(&copy);
+        json_copy(&copy, &jsn);
+        assert(json_compare(&copy, &jsn) == 0);
+        json_destroy(&copy);
+        json_destroy(&jsn);
+    }
+
+    // a long lived doc that keeps replacing its contents, collected every
+    // few generations
+    json_t* cfg = json_new();
+    size_t peak = 0;
+    for ( int gen = 0; gen < 100; gen++ )
+    {
+        json_root(cfg) = JNULL_VAL;
+        jobj_t doc = json_root_obj(cfg);
+        for ( int i = 0; i < 100; i++ ) jobj_add_str(doc, ("setting_" + std::to_string(i)).c_str(), ("generation " + std::to_string(gen)).c_str());
+
+        peak = std::max(peak, json_get_mem(cfg).total.reserved);
+        if (gen % 10 == 9) json_gc(cfg);
+    }
+    jmem_stats_t mem = json_get_mem(cfg);
+    assert(jobj_len(json_root_obj(cfg)) == 100 && mem.reclaimed > 0);
+    log_debug("100 generations: %zu bytes live, %zu bytes peak, %zu bytes reclaimed", mem.total.reserved, peak, mem.reclaimed);
+    json_free(cfg);
+}
+
+//------------------------------------------------------------------------------
+static void test_children()
+{
+    LOG_FUNC();
+
+    // parsed containers get blocks that fit them exactly
+    const char* src = R"({"a":[1.5,2.5],"b":{"x":1,"y":"s","z":[true,null]},"c":[],"d":{}})";
+    json_t* jsn = json_new();
+    jerr_t err;
+    if (json_load_str(jsn, src, &err) != 0)
+    {
+        jerr_fprint(stderr, &err);
+        exit(EXIT_FAILURE);
+    }
+    assert(jsn->children.garbage == 0);
+
+    // the last block grows in place, an index is kept in front of it once
+    // the object is big enough
+    jobj_t root = json_root_obj(jsn);
+    jobj_t big = jobj_add_obj(root, "big");
+    for ( int i = 0; i < 200; i++ )
+    {
+        jobj_add_int(big, ("key_" + std::to_string(i)).c_str(), i);
+        if (i == 40) assert(jobj_find_int(big, "key_7") == 7);
+    }
+    assert(jsn->children.garbage == 0);
+    for ( int i = 0; i < 200; i++ ) assert(jobj_find_int(big, ("key_" + std::to_string(i)).c_str()) == i);
+
+    // any other block moves to the end and leaves its old one behind
+    jarray_t one = jobj_add_array(root, "one");
+    jarray_t two = jobj_add_array(root, "two");
+    for ( int i = 0; i < 100; i++ )
+    {
+        jarray_add_int(one, i);
+        jarray_add_str(two, "v");
+    }
+    assert(jsn->children.garbage > 0);
+    assert(json_get_int(jsn, jarray_get(one, 99)) == 99 && jarray_len(two) == 100);
+
+    // a run of numbers gets its values once it changes
+    jarray_t a = jobj_find_array(root, "a");
+    jarray_add_str(a, "x");
+    size_t slen;
+    assert(jarray_get_num(a, 1) == 2.5 && strcmp(jarray_get_strl(a, 2, &slen), "x") == 0);
+
+    jmem_stats_t mem = json_get_mem(jsn);
+    const size_t held = mem.nums.reserved + mem.ints.reserved + mem.objs.reserved + mem.arrays.reserved + mem.strs.reserved;
+    assert(mem.total.reserved == held + (jsn->children.cap - jsn->children.len + jsn->children.garbage) * sizeof(uint64_t));
+
+    char* out = json_to_str(jsn, 0);
+    const std::string expected(out);
+    free(out);
+
+    // the collector packs what is left, each container shrunk to its length
+    assert(json_gc(jsn) > 0);
+    assert(jsn->children.garbage == 0 && jsn->children.len == jsn->children.cap);
+    out = json_to_str(jsn, 0);
+    assert(expected == out);
+    free(out);
+
+    root = json_root_obj(jsn);
+    big = jobj_find_obj(root, "big");
+    assert(jobj_find_int(big, "key_199") == 199);
+    jobj_add_int(big, "key_200", 200);
+    assert(jobj_find_int(big, "key_200") == 200 && jobj_find_int(big, "key_0") == 0);
+
+    json_free(jsn);
+}
+
+//------------------------------------------------------------------------------
+static void test_pool()
+{
+    LOG_FUNC();
+
+    const char* doc = R"({"id":"4c1c7f1e-6a5b-4bd4-8d43-33b1a6f0e2a9","user":{"name":"someone","roles":["a","b","c","d","e","f","g"]},"count":12,"ratio":0.5})";
+    const size_t dlen = strlen(doc);
+
+    json_pool_t* pool = json_pool_new(NULL, 0);
+    jerr_t err;
+
+    // a released doc is empty and handed out again, keeping its capacity
+    json_t* jsn = json_pool_acquire(pool);
+    assert(json_load_buf(jsn, doc, dlen, &err) == 0);
+    size_t reserved = json_get_mem(jsn).total.reserved;
+    uint32_t seed = jsn->strmap.seed;
+    json_pool_release(pool, jsn);
+
+    json_t* again = json_pool_acquire(pool);
+    assert(again == jsn);
+    assert(jobj_len(json_root_obj(again)) == 0);
+    assert(again->strmap.slen == 0 && again->nums.len == 0 && again->objs.len == 1);
+    assert(again->strmap.seed != seed);
+    json_pool_release(pool, again);
+
+    again = json_pool_acquire(pool);
+    assert(json_load_buf(again, doc, dlen, &err) == 0);
+    assert(json_get_mem(again).total.reserved == reserved);
+
+    json_t* other = json_pool_acquire(pool);
+    assert(other != again);
+    assert(json_load_buf(other, doc, dlen, &err) == 0);
+    assert(json_compare(again, other) == 0);
+    json_pool_release(pool, again);
+    json_pool_release(pool, other);
+
+    // docs move between threads
+    std::vector<std::thread> threads;
+    for ( size_t t = 0; t < 4; t++ )
+    {
+        threads.emplace_back([&]
+        {
+            std::vector<json_t*> held;
+            for ( size_t i = 0; i < 5000; i++ )
+            {
+                json_t* j = json_pool_acquire(pool);
+                jerr_t e;
+                assert(json_load_buf(j, doc, dlen, &e) == 0);
+                assert(jobj_len(json_root_obj(j)) == 4);
+                held.push_back(j);
+                if (held.size() > 16)
+                {
+                    for ( auto h : held ) json_pool_release(pool, h);
+                    held.clear();
+                }
+            }
+            for ( auto h : held ) json_pool_release(pool, h);
+        });
+    }
+    for ( auto& th : threads ) th.join();
+
+    // a thread switching between pools keeps reusing the docs of both
+    json_pool_t* second = json_pool_new(NULL, 0);
+    std::set<json_t*> firsts, seconds;
+    for ( size_t i = 0; i < 10000; i++ )
+    {
+        json_t* a = json_pool_acquire(pool);
+        firsts.insert(a);
+        json_pool_release(pool, a);
+
+        json_t* b = json_pool_acquire(second);
+        seconds.insert(b);
+        json_pool_release(second, b);
+    }
+    assert(firsts.size() <= 2 && seconds.size() <= 2);
+
+    // a thread moving on to another pool hands its cached docs back
+    std::set<json_t*> cached;
+    std::thread([&]
+    {
+        json_t* held[4];
+        for ( auto& h : held ) { h = json_pool_acquire(pool); cached.insert(h); }
+        for ( auto h : held ) json_pool_release(pool, h);
+        json_pool_release(second, json_pool_acquire(second));
+    }).join();
+    json_t* back[4];
+    for ( auto& b : back ) { b = json_pool_acquire(pool); assert(cached.count(b)); }
+    for ( auto b : back ) json_pool_release(pool, b);
+
+    // and drops the docs of a pool freed on another thread
+    json_pool_t* gone = json_pool_new(NULL, 0);
+    json_pool_t* live = json_pool_new(NULL, 0);
+    std::atomic<int> phase(0);
+    std::thread worker([&]
+    {
+        json_pool_release(gone, json_pool_acquire(gone));
+        phase = 1;
+        while (phase != 2) std::this_thread::yield();
+        json_t* a = json_pool_acquire(live);
+        json_pool_release(live, a);
+        assert(json_pool_acquire(live) == a);
+        json_pool_release(live, a);
+    });
+    while (phase != 1) std::this_thread::yield();
+    json_pool_free(gone);
+    phase = 2;
+    worker.join();
+    json_pool_free(live);
+    json_pool_free(second);
+    json_pool_free(pool); pool = NULL;
+}
+
+//------------------------------------------------------------------------------
+static void test_hash()
+{
+    LOG_FUNC();
+
+    // strings are hashed while they are parsed, that must agree with hashing
+    // the whole string later on. Use escapes so the decoded bytes differ from
+    // the source text.
+    std::string doc = "{";
+    std::vector<std::string> keys;
+    for ( size_t len = 0; len < 40; len++ )
+    {
+        std::string key, src;
+        for ( size_t i = 0; i < len; i++ )
+        {
+            switch (i % 5)
+            {
+                case 1: key += "\xC3\xA9"; src += "\\u00e9"; break;
+                case 3: key += "\n"; src += "\\n"; break;
+                default: key += (char)('a' + i % 26); src += (char)('a' + i % 26); break;
+            }
+        }
+        keys.push_back(key);
+        doc += (len ? ",\"" : "\"") + src + "\":" + std::to_string(len);
+    }
+    doc += "}";
+
+    json_t* jsn = json_new();
+    jerr_t err;
+    if (json_load_buf(jsn, doc.data(), doc.size(), &err) != 0)
+    {
+        jerr_fprint(stderr, &err);
+        exit(EXIT_FAILURE);
+    }
+    jobj_t root = json_root_obj(jsn);
+    for ( size_t i = 0; i < keys.size(); i++ )
+    {
+        jval_t val = jobj_findl(root, keys[i].data(), keys[i].size());
+        assert(json_get_int(jsn, val) == (jint_t)i);
+    }
+    json_free(jsn); jsn = NULL;
+
+    // the seed must change the hash
+    assert(json_hash("key", 3, 1) != json_hash("key", 3, 2));
+    assert(json_hash("key", 3, 1) == json_hash("key", 3, 1));
+
+    // avalanche, flipping any input bit should flip each output bit about half
+    // of the time. Cover inputs that end inside a block and on a boundary.
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    const size_t lens[] = { 5, 16, 24 };
+    for ( size_t len : lens )
+    {
+        static const size_t SAMPLES = 2000;
+        std::vector<size_t> flips(len * 8 * 32, 0);
+        for ( size_t n = 0; n < SAMPLES; n++ )
+        {
+            uint8_t buf[24];
+            for ( size_t i = 0; i < len; i++ ) buf[i] = (uint8_t)test_rand(state);
+            uint32_t seed = (uint32_t)test_rand(state);
+            uint32_t h = json_hash(buf, len, seed);
+
+            for ( size_t bit = 0; bit < len * 8; bit++ )
+            {
+                buf[bit/8] ^= (uint8_t)(1 << (bit%8));
+                uint32_t diff = h ^ json_hash(buf, len, seed);
+                buf[bit/8] ^= (uint8_t)(1 << (bit%8));
+
+                for ( size_t out = 0; out < 32; out++ )
+                {
+                    flips[bit*32 + out] += (diff >> out) & 1;
+                }
+            }
+        }
+
+        for ( auto f : flips )
+        {
+            double p = f / (double)SAMPLES;
+            assert(p > 0.4 && p < 0.6);
+        }
+    }
+
+    // similar keys must not collide more than random values would, and must
+    // spread evenly over both the low bits and the high bits.
+    static const size_t COUNT = 1000000;
+    std::vector<uint32_t> hashes;
+    hashes.reserve(COUNT);
+    char buf[32];
+    for ( size_t i = 0; i < COUNT; i++ )
+    {
+        int len = snprintf(buf, sizeof(buf), "key%zu", i);
+        hashes.push_back(json_hash(buf, (size_t)len, 0x1234));
+    }
+
+    // 4095 degrees of freedom, the bound is about 6 standard deviations
+    assert(chi_squared(hashes, 0, 4096) < 4650);
+    assert(chi_squared(hashes, 20, 4096) < 4650);
+
+    std::sort(hashes.begin(), hashes.end());
+    size_t collisions = 0;
+    for ( size_t i = 1; i < hashes.size(); i++ ) collisions += hashes[i] == hashes[i-1];
+    log_debug("collisions: %zu (expected ~116)", collisions);
+    assert(collisions < 300);
+}
+
+//------------------------------------------------------------------------------
+static void test_mutation()
+{
+    LOG_FUNC();
+
+    std::string jstr = "{\"a\":1.25,\"long key\":\"value\",\"nums\":[1.5,2.5,3.5],\"list\":[1,2,3],\"child\":{\"x\":1}";
+    for ( int i = 0; i < 40; i++ ) jstr += ",\"field_" + std::to_string(i) + "\":" + std::to_string(i);
+    jstr += "}";
+
+    for ( int flags : { 0, (int)JFLAG_LAZY_NUMS } )
+    {
+        json_t jsn;
+        json_init_flags(&jsn, flags);
+        jerr_t err;
+        if (json_load_buf(&jsn, jstr.c_str(), jstr.size(), &err) != 0)
+        {
+            jerr_fprint(stderr, &err);
+            exit(EXIT_FAILURE);
+        }
+        jobj_t root = json_root_obj(&jsn);
+        const size_t len = jobj_len(root);
+
+        // replaced in place, the raw text of a lazy number is not printed
+        jobj_set_num(root, "a", 2.5);
+        jobj_set_str(root, "long key", "other");
+        jobj_set_int(root, "new", 7);
+        assert(jobj_len(root) == len + 1);
+        assert(jobj_find_num(root, "a") == 2.5);
+        assert(jval_type(jobj_get_val(root, 1)) == JTYPE_STR);
+
+        size_t slen;
+        char* out = json_to_strl(&jsn, 0, &slen);
+        assert(strncmp(out, "{\"a\":2.5,\"long key\":\"other\",", 28) == 0);
+        free(out);
+
+        jobj_t child = jobj_set_obj(root, "child");
+        assert(jobj_len(child) == 0 && jobj_len(jobj_find_obj(root, "child")) == 0);
+
+        // removing from an object that has an index
+        assert(jobj_find_int(root, "field_20") == 20);
+        assert(jobj_remove(root, "field_10"));
+        assert(!jobj_remove(root, "field_10"));
+        assert(!jobj_contains_key(root, "field_10"));
+        for ( int i = 0; i < 40; i++ ) if (i != 10) assert(jobj_find_int(root, ("field_" + std::to_string(i)).c_str()) == i);
+        jobj_remove_idx(root, 0);
+        assert(!jobj_contains_key(root, "a") && jobj_len(root) == len - 1);
+
+        // a run of numbers gets its own values when changed
+        jarray_t nums = jobj_find_array(root, "nums");
+        jarray_set(nums, 1, json_make_num(&jsn, 9.5));
+        jarray_insert(nums, 0, json_make_str(&jsn, "first"));
+        jarray_insert(nums, 4, json_make_bool(JTRUE));
+        jarray_remove(nums, 2);
+        out = json_to_strl(&jsn, 0, &slen);
+        assert(strstr(out, "\"nums\":[\"first\",1.5,3.5,true]"));
+        free(out);
+
+        jarray_t list = jobj_find_array(root, "list");
+        while (jarray_len(list)) jarray_remove(list, 0);
+        jarray_insert(list, 0, json_make_int(&jsn, 10000000000LL));
+        jarray_insert(list, 0, json_make_array(&jsn));
+        jarray_add_int(jarray_get_array(list, 0), 1);
+        assert(jarray_len(list) == 2 && jarray_get_array(list, 1).json == NULL);
+        assert(json_get_int(&jsn, jarray_get(list, 1)) == 10000000000LL);
+
+        // the replaced values are garbage
+        assert(json_gc(&jsn) > 0);
+        root = json_root_obj(&jsn);
+        assert(jobj_find_num(root, "new") == 7 && jobj_find_int(root, "field_39") == 39);
+        json_destroy(&jsn);
+    }
+
+    auto jsn = ims::json::from_str("{\"a\":1,\"b\":[1,2]}");
+    auto root = jsn.root_obj();
+    root.set("a", "str").set("c", 2.5);
+    assert(root.remove("c") && !root.remove("c"));
+    const ims::obj& croot = root;
+    auto b = static_cast<ims::array>(croot["b"]);
+    b.set(0, 5).insert(0, "x").insert(3, nullptr).remove(2);
+    assert(jsn.str(0) == "{\"a\":\"str\",\"b\":[\"x\",5,null]}");
+
+    // updating one field of a cached doc over and over, the old values are
+    // garbage
+    static const size_t COUNT = 1000;
+    json_t* cache = json_new();
+    jobj_t obj = json_root_obj(cache);
+    for ( int i = 0; i < 1000; i++ ) jobj_add_int(obj, ("key" + std::to_string(i)).c_str(), i);
+    for ( size_t i = 0; i < COUNT; i++ ) jobj_set_num(obj, "key500", (jnum_t)i + 0.5);
+    assert(jobj_len(obj) == 1000 && jobj_find_num(obj, "key500") == COUNT - 0.5);
+    assert(json_gc(cache) > 0);
+    obj = json_root_obj(cache);
+    assert(jobj_find_num(obj, "key500") == COUNT - 0.5 && jobj_find_int(obj, "key999") == 999);
+    json_free(cache);
+}
+
+//------------------------------------------------------------------------------
+static void test_bulk()
+{
+    LOG_FUNC();
+
+    static const jnum_t NUMS[] = { 1.5, 2.5, 3.5 };
+    static const jint_t INTS[] = { 1, 10000000000LL, -2 };
+    static const jint_t BIG[] = { 10000000000LL, 20000000000LL };
+    static const char* STRS[] = { "red", "red", "green", "a longer string value" };
+    static const size_t LENS[] = { 3, 3, 5, 21 };
+
+    for ( int flags : { 0, (int)JFLAG_LAZY_NUMS } )
+    {
+        json_t jsn;
+        json_init_flags(&jsn, flags);
+        jobj_t root = json_root_obj(&jsn);
+
+        // an empty array becomes a run, later calls extend it
+        jarray_t nums = jobj_add_array(root, "nums");
+        jarray_add_nums(nums, NUMS, 3);
+        jarray_add_nums(nums, NUMS, 3);
+        const jnum_t* span;
+        size_t len;
+        assert(jarray_get_num_span(nums, &span, &len) && len == 6 && span[4] == 2.5);
+        jarray_add_num(nums, 4.5);
+        jarray_add_nums(nums, NUMS, 0);
+        assert(jarray_len(nums) == 7 && jarray_get_num(nums, 6) == 4.5);
+
+        jarray_t ints = jobj_add_array(root, "ints");
+        jarray_add_int(ints, 0);
+        jarray_add_ints(ints, INTS, 3);
+        assert(jarray_get(ints, 1).type == JTYPE_SHORT && jarray_get(ints, 2).type == JTYPE_INT);
+        jarray_t big = jobj_add_array(root, "big");
+        jarray_add_ints(big, BIG, 2);
+        const jint_t* ispan;
+        assert(jarray_get_int_span(big, &ispan, &len) && len == 2 && ispan[1] == BIG[1]);
+
+        jarray_t strs = jobj_add_array(root, "strs");
+        jarray_add_strs(strs, STRS, LENS, 4);
+        jarray_add_strs(strs, STRS, NULL, 1);
+        assert(jarray_get(strs, 0).idx == jarray_get(strs, 1).idx);
+
+        // short keys are packed, long ones are interned once for every object
+        const char* names[] = { "id", "a long key name", "score" };
+        jkey_t keys[3];
+        for ( size_t i = 0; i < 3; i++ ) keys[i] = jkey_intern(&jsn, names[i], strlen(names[i]));
+        jarray_t rows = jobj_add_array(root, "rows");
+        for ( int i = 0; i < 20; i++ )
+        {
+            jval_t vals[] = { json_make_int(&jsn, i), json_make_str(&jsn, "name"), json_make_num(&jsn, i * 0.5) };
+            jobj_t row = jarray_add_obj(rows);
+            jobj_add_many(row, keys, vals, i < 10 ? 3 : 2);
+        }
+        jobj_t row = jarray_get_obj(rows, 15);
+        assert(jobj_len(row) == 2 && jobj_find_int(row, "id") == 15 && !jobj_contains_key(row, "score"));
+        assert(jval_type(jobj_find_key(row, jkey_resolve(&jsn, "a long key name", 15))) == JTYPE_STR);
+
+        // adding many to an object with an index
+        jobj_t wide = jobj_add_obj(root, "wide");
+        for ( int i = 0; i < 40; i++ ) jobj_add_int(wide, ("field_" + std::to_string(i)).c_str(), i);
+        assert(jobj_find_int(wide, "field_20") == 20);
+        jval_t more[] = { json_make_int(&jsn, 40), json_make_bool(JTRUE) };
+        jobj_add_many(wide, keys, more, 2);
+        assert(jobj_find_int(wide, "id") == 40 && jobj_find_bool(wide, "a long key name"));
+        assert(jobj_find_int(wide, "field_39") == 39);
+
+        size_t slen;
+        char* out = json_to_strl(&jsn, 0, &slen);
+        const char* expect = "{\"nums\":[1.5,2.5,3.5,1.5,2.5,3.5,4.5],\"ints\":[0,1,10000000000,-2],\"big\":[10000000000,20000000000],"
+            "\"strs\":[\"red\",\"red\",\"green\",\"a longer string value\",\"red\"],\"rows\":[{\"id\":0,\"a long key name\":\"name\",\"score\":0.0},";
+        assert(strncmp(out, expect, strlen(expect)) == 0);
+        free(out);
+        json_destroy(&jsn);
+    }
+
+    // building an array one value at a time and all at once gives the same doc
+    static const size_t COUNT = 1000;
+    std::vector<jnum_t> src(COUNT);
+    for ( size_t i = 0; i < COUNT; i++ ) src[i] = i * 0.25;
+
+    json_t* one = json_new();
+    jarray_t a = json_root_array(one);
+    for ( size_t i = 0; i < COUNT; i++ ) jarray_add_num(a, src[i]);
+
+    json_t* many = json_new();
+    a = json_root_array(many);
+    jarray_add_nums(a, src.data(), COUNT);
+    assert(jarray_len(a) == COUNT && jarray_get_num(a, COUNT - 1) == src.back());
+    assert(json_compare(one, many) == 0);
+    json_free(one);
+    json_free(many);
+}
+
+//------------------------------------------------------------------------------
+static void test_shapes()
+{
+    LOG_FUNC();
+
+    // records share their keys, the odd one out keeps its own
+    static const size_t COUNT = 2000;
+    std::string dropped = "{\"a dropped key\":1,\"b\":2,\"c\":3,\"d\":4,\"e\":5,\"f\":6,\"g\":7}";
+    std::string jstr = "{\"dropped\":[" + dropped + "," + dropped + "],\"rows\":[";
+    for ( size_t i = 0; i < COUNT; i++ )
+    {
+        std::string n = std::to_string(i);
+        if (i) jstr += ",";
+        if (i == 7) jstr += "{\"name\":\"n" + n + "\",\"id\":" + n;
+        else jstr += "{\"id\":" + n + ",\"name\":\"n" + n + "\"";
+        jstr += ",\"x\":1.5,\"y\":2.5,\"a long key name\":true,\"kind\":\"point\",\"tags\":[],\"z\":null}";
+    }
+    jstr += "]}";
+
+    json_t jsn;
+    json_init(&jsn);
+    jerr_t err;
+    if (json_load_buf(&jsn, jstr.c_str(), jstr.size(), &err) != 0)
+    {
+        jerr_fprint(stderr, &err);
+        exit(EXIT_FAILURE);
+    }
+    jarray_t rows = jobj_find_array(json_root_obj(&jsn), "rows");
+    assert(jarray_len(rows) == COUNT);
+    assert(jsn.shapes.len == 2);
+
+    jkey_t id = jkey_resolve(&jsn, "id", 2);
+    jkey_t lkey = jkey_resolve(&jsn, "a long key name", 15);
+    for ( size_t i = 0; i < COUNT; i += 997 )
+    {
+        jobj_t row = jarray_get_obj(rows, i);
+        assert(json_get_int(&jsn, jobj_find_key(row, id)) == (jint_t)i);
+        assert(json_get_bool(&jsn, jobj_find_key(row, lkey)));
+        assert(jobj_findl_idx(row, "missing", 7) == SIZE_MAX && jobj_findl_idx(row, "i", 1) == SIZE_MAX);
+    }
+    assert(jobj_find_int(jarray_get_obj(rows, 7), "id") == 7);
+
+    // the keys are only stored once
+    const size_t shaped = json_get_mem(&jsn).objs.reserved;
+    json_t copy;
+    json_init(&copy);
+    json_copy(&copy, &jsn);
+    assert(shaped < json_get_mem(&copy).objs.reserved);
+    json_destroy(&copy);
+
+    // changing the keys of one record leaves the others alone
+    jobj_t first = jarray_get_obj(rows, 0);
+    jobj_add_int(first, "added", 1);
+    jobj_t second = jarray_get_obj(rows, 1);
+    assert(jobj_remove(second, "x"));
+    assert(jobj_find_int(first, "added") == 1 && jobj_len(first) == 9);
+    assert(jobj_findl_idx(second, "x", 1) == SIZE_MAX && jobj_find_num(second, "y") == 2.5);
+    assert(jobj_find_num(jarray_get_obj(rows, 2), "x") == 1.5);
+
+    // shapes follow their keys through a collection
+    jobj_remove(json_root_obj(&jsn), "dropped");
+    assert(json_gc(&jsn) > 0);
+    assert(jsn.shapes.len == 1);
+    rows = jobj_find_array(json_root_obj(&jsn), "rows");
+    jobj_t row = jarray_get_obj(rows, 500);
+    assert(jobj_find_bool(row, "a long key name") && jobj_find_int(row, "id") == 500);
+    size_t slen;
+    const char* kind = jobj_find_strl(row, "kind", &slen);
+    assert(slen == 5 && strncmp(kind, "point", 5) == 0);
+
+    char* out = json_to_strl(&jsn, 0, &slen);
+    assert(strstr(out, "\"z\":null,\"added\":1},{\"id\":1,\"name\":\"n1\",\"y\":2.5,"));
+    assert(strstr(out, "{\"id\":2,\"name\":\"n2\",\"x\":1.5,\"y\":2.5,\"a long key name\":true,\"kind\":\"point\",\"tags\":[],\"z\":null}"));
+    free(out);
+
+    // a field is found in every record
+    jkey_t name = jkey_resolve(&jsn, "name", 4);
+    for ( size_t i = 0; i < COUNT; i++ ) assert(jobj_find_key_idx(jarray_get_obj(rows, i), name) != SIZE_MAX);
+    json_destroy(&jsn);
+}
+
+//------------------------------------------------------------------------------
+struct jchunks_t
+{
+    const std::string* str;
+    size_t off;
+};
+
+//------------------------------------------------------------------------------
+static size_t read_chunks( void* buf, size_t buflen, void* uptr )
+{
+    // a few bytes at a time, so keys straddle the read buffer
+    jchunks_t* src = (jchunks_t*)uptr;
+    size_t len = std::min(std::min(buflen, (size_t)7), src->str->size() - src->off);
+    memcpy(buf, src->str->data() + src->off, len);
+    src->off += len;
+    return len;
+}
+
+//------------------------------------------------------------------------------
+static void test_key_prediction()
+{
+    LOG_FUNC();
+
+    // records that repeat, drop, reorder, nest and escape their keys
+    std::string jstr = "[";
+    for ( int i = 0; i < 50; i++ )
+    {
+        std::string n = std::to_string(i);
+        if (i) jstr += ",";
+        if (i % 7 == 3) jstr += "{\"ab\":" + n + ",\"abc\":\"x\",\"geo\":{\"lat\":1,\"lng\":2}}";
+        else if (i % 7 == 5) jstr += "{\"abc\":" + n + ",\"a\\u0062\":\"y\",\"geo\":{\"la\\\"t\":1},\"long key name\":[]}";
+        else jstr += "{\"abc\":" + n + ",\"ab\":\"z\",\"geo\":{\"lat\":1,\"lng\":2},\"long key name\":[{\"k\":1},{\"k\":2,\"j\":3}]}";
+    }
+    jstr += "]";
+
+    json_t whole, chunked;
+    json_init(&whole);
+    json_init(&chunked);
+    jerr_t err;
+    jchunks_t src = { &jstr, 0 };
+    if (json_load_buf(&whole, jstr.c_str(), jstr.size(), &err) != 0 ||
+        json_load_user(&chunked, &src, read_chunks, &err) != 0)
+    {
+        jerr_fprint(stderr, &err);
+        exit(EXIT_FAILURE);
+    }
+
+    for ( json_t* jsn : { &whole, &chunked } )
+    {
+        size_t slen;
+        char* out = json_to_strl(jsn, 0, &slen);
+        std::string expect = jstr;
+        for ( size_t pos; (pos = expect.find("a\\u0062")) != std::string::npos; ) expect.replace(pos, 7, "ab");
+        assert(out == expect);
+        free(out);
+
+        jarray_t rows = json_root_array(jsn);
+        for ( size_t i = 0; i < jarray_len(rows); i++ )
+        {
+            jobj_t row = jarray_get_obj(rows, i);
+            assert(jobj_len(row) == ((i % 7 == 3) ? 3 : 4));
+            assert(jobj_findl_idx(row, "ab", 2) != SIZE_MAX && jobj_findl_idx(row, "abc", 3) != SIZE_MAX);
+            assert(jobj_find_int(row, (i % 7 == 3) ? "ab" : "abc") == (jint_t)i);
+        }
+        assert(jobj_find_int(jobj_find_obj(jarray_get_obj(rows, 5), "geo"), "la\"t") == 1);
+        assert(jobj_find_int(jobj_find_obj(jarray_get_obj(rows, 12), "geo"), "la\"t") == 1);
+    }
+    json_destroy(&whole);
+    json_destroy(&chunked);
+}
+
+//------------------------------------------------------------------------------
+static void test_inline_strs()
+{
+    LOG_FUNC();
+
+    const char* src = R"(["Y","N","USA","","\u0000\u0000","Y","United States",{"k":"N"}])";
+    json_t* jsn = json_new();
+    jerr_t err;
+    if (json_load_str(jsn, src, &err) != 0)
+    {
+        jerr_fprint(stderr, &err);
+        exit(EXIT_FAILURE);
+    }
+
+    // only "United States" is long enough to be added to the string map
+    assert(jsn->strmap.slen == 1);
+
+    jarray_t root = json_root_array(jsn);
+    size_t slen = 0;
+    const char* str = jarray_get_strl(root, 2, &slen);
+    assert(slen == 3 && strcmp(str, "USA") == 0);
+    assert(jarray_get_strl(root, 0, &slen) == jarray_get_strl(root, 5, &slen));
+    str = jarray_get_strl(root, 3, &slen);
+    assert(slen == 0 && str[0] == '\0');
+    str = jarray_get_strl(root, 4, &slen);
+    assert(slen == 2 && str[0] == '\0' && str[1] == '\0' && str[2] == '\0');
+    assert(strcmp(jobj_find_strl(jarray_get_obj(root, 7), "k", &slen), "N") == 0 && slen == 1);
+
+    char* out = json_to_str(jsn, 0);
+    assert(strcmp(out, src) == 0);
+    free(out);
+
+    // inline and pooled strings order the same way
+    jarray_add_strl(root, "USA", 3);
+    jarray_add_strl(root, "USAF", 4);
+    assert(jarray_get_strl(root, 2, &slen) == jarray_get_strl(root, 8, &slen));
+    assert(json_compare_val(jsn, jarray_get(root, 2), jarray_get(root, 6)) < 0);
+    assert(json_compare_val(jsn, jarray_get(root, 6), jarray_get(root, 8)) > 0);
+    assert(json_compare_val(jsn, jarray_get(root, 9), jarray_get(root, 2)) > 0);
+    assert(json_compare_val(jsn, jarray_get(root, 8), jarray_get(root, 2)) == 0);
+
+    // wide values hold up to 7 bytes, they still read back NUL terminated
+    jarray_add_strl(root, "Germany", 7);
+    str = jarray_get_strl(root, 10, &slen);
+    assert(slen == 7 && strcmp(str, "Germany") == 0);
+    assert(str == jarray_get_strl(root, 10, &slen));
+    assert(jsn->strmap.slen == (JSON_WIDE_INDEX ? 1 : 3));
+
+    // the collector has nothing to keep for them
+    jarray_remove(root, 6);
+    json_gc(jsn);
+    assert(jsn->strmap.slen == (JSON_WIDE_INDEX ? 0 : 2));
+    assert(strcmp(jarray_get_strl(root, 1, &slen), "N") == 0);
+    assert(strcmp(jarray_get_strl(root, 8, &slen), "USAF") == 0);
+
+    json j = json::from_str(R"({"a":"x","b":"yz"})");
+    assert(static_cast<std::string>(j.root_obj()[ims::key(j, "a")]) == "x");
+    assert(static_cast<std::string>(j.root_obj()[ims::key(j, "b")]) == "yz");
+
+    json_free(jsn);
+}
+
 //------------------------------------------------------------------------------
 static void test_reload()
 {
@@ -213,6 +1988,60 @@ static void test_reload()
     json_free(jsn); jsn = NULL;
 }
 
+//------------------------------------------------------------------------------
+static void test_parse_sizes()
+{
+    LOG_FUNC();
+
+    // containers of every size around the inline buffer, nested in each other
+    std::string jstr = "{";
+    for ( size_t n = 0; n < 12; n++ )
+    {
+        std::string array = "[", obj = "{";
+        for ( size_t i = 0; i < n; i++ )
+        {
+            array += (i ? ",\"" : "\"") + std::to_string(i) + "\"";
+            obj += (i ? ",\"key" : "\"key") + std::to_string(i) + "\":[" + std::to_string(i) + ",{}]";
+        }
+        jstr += (n ? ",\"a" : "\"a") + std::to_string(n) + "\":" + array + "],\"o" + std::to_string(n) + "\":" + obj + "}";
+    }
+    jstr += ",\"deep\":" + std::string(200, '[') + std::string(200, ']') + "}";
+
+    json_t jsn;
+    json_init(&jsn);
+    jerr_t err;
+    if (json_load_buf(&jsn, jstr.c_str(), jstr.size(), &err) != 0)
+    {
+        jerr_fprint(stderr, &err);
+        exit(EXIT_FAILURE);
+    }
+
+    size_t slen;
+    char* out = json_to_strl(&jsn, 0, &slen);
+    assert(std::string(out, slen) == jstr);
+    free(out);
+
+    // parsed containers are exactly full, they still grow when added to
+    jobj_t root = json_root_obj(&jsn);
+    for ( size_t n = 0; n < 12; n++ )
+    {
+        jarray_t array = jobj_find_array(root, ("a" + std::to_string(n)).c_str());
+        jobj_t obj = jobj_find_obj(root, ("o" + std::to_string(n)).c_str());
+        assert(jarray_len(array) == n && jobj_len(obj) == n);
+
+        jarray_add_str(array, "more");
+        jobj_add_str(obj, "more", "more");
+        assert(jarray_len(array) == n+1 && jobj_len(obj) == n+1);
+        assert(strcmp(jarray_get_strl(array, n, &slen), "more") == 0);
+        assert(strcmp(jobj_find_strl(obj, "more", &slen), "more") == 0);
+        if (n) assert(jarray_get_num(jobj_find_array(obj, ("key" + std::to_string(n-1)).c_str()), 0) == n-1);
+    }
+
+    // an error part way through a nested container
+    assert(json_load_str(&jsn, "[[1,2,[3,{\"a\":[4,", &err) != 0);
+    json_destroy(&jsn);
+}
+
 //------------------------------------------------------------------------------
 static void test_read()
 {
@@ -413,6 +2242,91 @@ static void test_construction_cpp()
     std::cout << jsn << std::endl;
 }
 
+//------------------------------------------------------------------------------
+struct bind_endpoint
+{
+    std::string host;
+    uint16_t port = 0;
+    std::optional<std::string> user;
+};
+IMS_BIND(bind_endpoint, IMS_FIELD(host), IMS_FIELD(port), IMS_FIELD(user))
+
+struct bind_config
+{
+    std::string name;
+    bool enabled = false;
+    int64_t retries = 0;
+    double ratio = 0;
+    std::vector<bind_endpoint> servers;
+    std::vector<std::vector<int>> matrix;
+    std::optional<double> timeout;
+    std::optional<bind_endpoint> proxy;
+};
+IMS_BIND(bind_config, IMS_FIELD(name), IMS_FIELD(enabled), IMS_FIELD(retries), IMS_FIELD_AS(ratio, "load-ratio"),
+         IMS_FIELD(servers), IMS_FIELD(matrix), IMS_FIELD(timeout), IMS_FIELD(proxy))
+
+//------------------------------------------------------------------------------
+static void test_bind()
+{
+    LOG_FUNC();
+
+    const char* str = R"({
+        "name": "caf\u00e9 \ud83d\ude00 \"q\"",
+        "enabled": true,
+        "unknown": { "a": [1, 2, {"b": null}], "c": "\\" },
+        "retries": -9000000000,
+        "load-ratio": 0.25e1,
+        "servers": [
+            { "host": "a.local", "port": 80 },
+            { "port": 8080, "host": "b.local", "user": "root" }
+        ],
+        "matrix": [[1,2],[],[3]],
+        "timeout": null,
+        "proxy": { "host": "p", "port": 3128, "user": null }
+    })";
+
+    auto cfg = ims::bind<bind_config>::from_str(str);
+    assert(cfg.name == "caf\xC3\xA9 \xF0\x9F\x98\x80 \"q\"");
+    assert(cfg.enabled);
+    assert(cfg.retries == -9000000000LL);
+    assert(cfg.ratio == 2.5);
+    assert(cfg.servers.size() == 2);
+    assert(cfg.servers[0].host == "a.local" && cfg.servers[0].port == 80 && !cfg.servers[0].user);
+    assert(cfg.servers[1].host == "b.local" && cfg.servers[1].port == 8080 && *cfg.servers[1].user == "root");
+    assert(cfg.matrix.size() == 3 && cfg.matrix[0][1] == 2 && cfg.matrix[1].empty() && cfg.matrix[2][0] == 3);
+    assert(!cfg.timeout);
+    assert(cfg.proxy && cfg.proxy->port == 3128 && !cfg.proxy->user);
+
+    // the result must agree with the DOM
+    ims::json jsn = ims::json::from_str(str);
+    assert(cfg.name == jsn.root_obj().getr("name", std::string()));
+
+    const char* invalid[] =
+    {
+        "{\"port\": 70000}",
+        "{\"port\": 1.5}",
+        "{\"port\": -1}",
+        "{\"host\": 5}",
+        "{\"host\": \"a\",}",
+        "{\"host\": \"a\"} x",
+        "{\"host\" \"a\"}",
+        "{\"x\": [1 2]}",
+        "{\"host\": \"\\ud800\"}",
+        "{\"x\": \"\\q\"}",
+        "{\"x\": [\"\\ud800\"]}",
+        "{\"x\": \"\x01\"}",
+        "{\"x\": \"abc}",
+        "[]",
+    };
+    for ( auto s : invalid )
+    {
+        bool threw = false;
+        try { ims::bind<bind_endpoint>::from_str(s); }
+        catch ( const std::runtime_error& e ) { threw = true; }
+        assert(threw);
+    }
+}
+
 typedef void (*test_func)(void);
 
 //------------------------------------------------------------------------------
@@ -423,7 +2337,32 @@ test_func TESTS[] =
     test_construction,
     test_construction_cpp,
     test_reload,
-    test_numbers
+    test_mutation,
+    test_bulk,
+    test_shapes,
+    test_key_prediction,
+    test_inline_strs,
+    test_parse_sizes,
+    test_numbers,
+    test_lazy_nums,
+    test_wide_index,
+    test_wide_keys,
+    test_num_span,
+    test_columns,
+    test_strmap,
+    test_str_arena,
+    test_incremental_rehash,
+    test_obj_index,
+    test_obj_keys,
+    test_key,
+    test_intern,
+    test_dict,
+    test_cmap,
+    test_gc,
+    test_children,
+    test_pool,
+    test_hash,
+    test_bind
 };
 static const size_t TEST_LEN = sizeof(TESTS)/sizeof(TESTS[0]);
 